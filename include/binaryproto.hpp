@@ -0,0 +1,199 @@
+#ifndef BINARYPROTO_H
+#define BINARYPROTO_H
+
+/*
+server 和 client 公共的二进制协议
+连接建立后客户端发送PROTOCOL_MSG协商，服务器回复PROTOCOL_MSG_ACK之后，这条连接上的聊天消息改用二进制格式，
+其他消息(登录、注册、离线消息等)仍然是json。二进制消息和json消息走同一个长度头的帧，靠消息体的第一个字节区分：
+json消息体总是以'{'开头，二进制消息体以BINARY_MAGIC开头
+
+二进制消息体格式，整数都是网络字节序：
+  0   uint8   magic   BINARY_MAGIC
+  1   uint8   opcode  EnMsgType中的消息类型
+  2   uint16  flags   保留，填0
+  4   int32   id      发送消息的用户id
+  8   int32   target  一对一聊天是toid，群聊是groupid
+  12  int64   seq     接收者的消息序号，客户端发送时填0
+  20  payload
+
+ONE_CHAT_MSG和GROUP_CHAT_MSG的payload：uint16长度 + name，uint16长度 + time，剩下的全部是msg原始字节
+服务器路由时只看固定头，发给二进制连接时只改写固定头中的序号，payload原样转发
+收件箱、离线消息和跨服务器转发仍然使用json文本，每条二进制消息在服务器上转换一次，
+转换时直接写出json文本(见ChatPayload)，不构造json对象
+*/
+#include "json.hpp"
+#include "public.hpp"
+
+#include <arpa/inet.h>
+#include <cstdint>
+#include <cstring>
+#include <string>
+using namespace std;
+using json = nlohmann::json;
+
+// 二进制消息体的第一个字节，json中不会出现的字节
+const uint8_t BINARY_MAGIC = 0xB7;
+// 二进制消息固定头的长度
+const size_t BINARY_HEADER_LEN = 20;
+
+// 二进制消息的固定头
+struct BinaryHeader
+{
+    uint8_t opcode;
+    int32_t id;
+    int32_t target;
+    int64_t seq;
+};
+
+// 二进制消息的编解码
+class BinaryProto
+{
+public:
+    // 消息体是不是二进制消息
+    static bool isBinary(const string &body)
+    {
+        return !body.empty() && static_cast<uint8_t>(body[0]) == BINARY_MAGIC;
+    }
+
+    // 只解析固定头，长度不够或者不是二进制消息返回false
+    static bool decodeHeader(const string &body, BinaryHeader &header)
+    {
+        if (body.size() < BINARY_HEADER_LEN || !isBinary(body))
+        {
+            return false;
+        }
+        const char *p = body.data();
+        header.opcode = static_cast<uint8_t>(p[1]);
+        header.id = static_cast<int32_t>(readUint32(p + 4));
+        header.target = static_cast<int32_t>(readUint32(p + 8));
+        header.seq = static_cast<int64_t>((static_cast<uint64_t>(readUint32(p + 12)) << 32) | readUint32(p + 16));
+        return true;
+    }
+
+    // 编码一条聊天消息，name或time超过uint16能表示的长度时无法编码，返回空串，调用者改用json格式发送
+    static string encodeChat(const BinaryHeader &header, const string &name, const string &time, const string &msg)
+    {
+        string body;
+        if (name.size() > UINT16_MAX || time.size() > UINT16_MAX)
+        {
+            return body;
+        }
+        body.reserve(BINARY_HEADER_LEN + 4 + name.size() + time.size() + msg.size());
+        body.push_back(static_cast<char>(BINARY_MAGIC));
+        body.push_back(static_cast<char>(header.opcode));
+        appendUint16(body, 0);
+        appendUint32(body, static_cast<uint32_t>(header.id));
+        appendUint32(body, static_cast<uint32_t>(header.target));
+        appendUint32(body, static_cast<uint32_t>(static_cast<uint64_t>(header.seq) >> 32));
+        appendUint32(body, static_cast<uint32_t>(header.seq));
+        appendUint16(body, static_cast<uint16_t>(name.size()));
+        body.append(name);
+        appendUint16(body, static_cast<uint16_t>(time.size()));
+        body.append(time);
+        body.append(msg);
+        return body;
+    }
+
+    // 解码一条聊天消息，格式错误返回false
+    static bool decodeChat(const string &body, BinaryHeader &header, string &name, string &time, string &msg)
+    {
+        size_t pos = BINARY_HEADER_LEN;
+        if (!decodeHeader(body, header) || !readString(body, pos, name) || !readString(body, pos, time))
+        {
+            return false;
+        }
+        msg.assign(body, pos, string::npos);
+        return true;
+    }
+
+    // 复制一份消息并写入接收者的序号，其余字节原样保留
+    static string withSeq(const string &body, int64_t seq)
+    {
+        string result(body);
+        if (result.size() >= BINARY_HEADER_LEN)
+        {
+            writeUint32(&result[12], static_cast<uint32_t>(static_cast<uint64_t>(seq) >> 32));
+            writeUint32(&result[16], static_cast<uint32_t>(seq));
+        }
+        return result;
+    }
+
+    // 二进制聊天消息转换成json协议的消息对象，字段和json客户端发送的一致，格式错误返回false
+    // 客户端显示消息时用，收到的json消息同样要解析成对象，这里直接生成对象，不经过json文本
+    static bool chatToJson(const string &body, json &js)
+    {
+        BinaryHeader header;
+        string name, time, msg;
+        if (!decodeChat(body, header, name, time, msg))
+        {
+            return false;
+        }
+        js = json::object();
+        js["msgid"] = header.opcode;
+        js["id"] = header.id;
+        js[header.opcode == GROUP_CHAT_MSG ? "groupid" : "toid"] = header.target;
+        js["name"] = name;
+        js["time"] = time;
+        js["msg"] = msg;
+        if (header.seq != 0)
+        {
+            js["seq"] = header.seq;
+        }
+        return true;
+    }
+
+    // json协议的聊天消息转换成二进制消息，字段不全时抛出json::exception，字段太长无法编码时返回空串
+    static string chatFromJson(const json &js)
+    {
+        BinaryHeader header;
+        header.opcode = static_cast<uint8_t>(js["msgid"].get<int>());
+        header.id = js["id"].get<int>();
+        header.target = header.opcode == GROUP_CHAT_MSG ? js["groupid"].get<int>() : js["toid"].get<int>();
+        header.seq = js.value("seq", 0LL);
+        return encodeChat(header, js["name"].get<string>(), js["time"].get<string>(), js["msg"].get<string>());
+    }
+
+private:
+    static uint32_t readUint32(const char *p)
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return ntohl(value);
+    }
+    static void writeUint32(char *p, uint32_t value)
+    {
+        value = htonl(value);
+        memcpy(p, &value, sizeof(value));
+    }
+    static void appendUint32(string &body, uint32_t value)
+    {
+        value = htonl(value);
+        body.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+    static void appendUint16(string &body, uint16_t value)
+    {
+        value = htons(value);
+        body.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+    // 读取uint16长度 + 字符串，越界返回false
+    static bool readString(const string &body, size_t &pos, string &value)
+    {
+        if (pos + 2 > body.size())
+        {
+            return false;
+        }
+        uint16_t len;
+        memcpy(&len, body.data() + pos, sizeof(len));
+        len = ntohs(len);
+        pos += 2;
+        if (pos + len > body.size())
+        {
+            return false;
+        }
+        value.assign(body, pos, len);
+        pos += len;
+        return true;
+    }
+};
+
+#endif
@@ -17,6 +17,23 @@ enum EnMsgType
     CREATE_GROUP_MSG, // 创建群组
     ADD_GROUP_MSG, // 加入群组
     GROUP_CHAT_MSG, // 群聊天
+
+    OFFLINE_MSG, // 一页离线消息，登录成功后由服务器推送
+    OFFLINE_MSG_ACK, // 客户端确认收到离线消息，带上这一页的cursor
+
+    SYNC_MSG, // 客户端获取序号大于seq的消息，用于断线重连后补齐消息
+    SYNC_MSG_ACK, // 增量同步的响应消息
+
+    PROTOCOL_MSG, // 登录之前协商协议，binary为true表示聊天消息改用二进制格式，见binaryproto.hpp
+    PROTOCOL_MSG_ACK, // 协商结果，binary为服务器同意的格式
+
+    MSG_TYPE_COUNT, // 消息类型的个数，不是消息，新的消息类型加在它前面
 };
 
+// 消息帧格式：4字节包头(网络字节序的int32，表示消息体长度) + 消息体(json字符串，或者协商之后的二进制聊天消息)
+// TCP是字节流，一次读到的数据可能包含多条消息，也可能只有半条，必须靠包头来切分
+const int MSG_HEADER_LEN = 4;
+// 单条消息体允许的最大长度，超过则认为是非法数据，直接断开连接
+const int MSG_MAX_LEN = 16 * 1024 * 1024;
+
 #endif
\ No newline at end of file
@@ -0,0 +1,106 @@
+#ifndef SEQFILTER_H
+#define SEQFILTER_H
+
+/*
+client 按消息序号去重
+同一条消息可能从跨服务器转发、离线消息、增量同步中的多个途径到达，只显示第一次
+
+游标是已经连续收到的最大序号，登录时以登录响应中的seq为起点，增量同步时从游标开始
+实时推送和增量同步的消息：序号不超过游标的已经收到过，丢弃；超过游标的记录在已收到集合中去重
+
+序号不超过登录响应中seq的消息不能按游标过滤：
+1. 离线消息：登录响应中的seq已经包含了离线期间分配给离线消息的序号
+2. 实时推送：服务器先读取seq再记录用户上线，其他服务器在读取seq之前分配了序号、在记录上线之后才查询用户
+   在哪台服务器上，这条消息会在登录响应之后在线推送过来，序号不超过seq，也不在离线消息中
+每条消息只会从离线消息和在线推送中的一条途径到达，这些消息单独记录在登录前集合中去重，不会被当作重复丢掉
+*/
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <set>
+using namespace std;
+
+class SeqFilter
+{
+public:
+    explicit SeqFilter(size_t maxSeen = 4096) : _cursor(0), _loginSeq(0), _maxSeen(maxSeen) {}
+
+    // 登录成功，以登录响应中的seq为起点
+    void reset(long long cursor)
+    {
+        _seen.clear();
+        _early.clear();
+        _loginSeq = cursor;
+        _cursor = cursor;
+    }
+
+    // 已经连续收到的最大序号，可以在其他线程中读取
+    long long cursor() const { return _cursor.load(); }
+
+    // 实时推送、增量同步的消息是否需要显示，seq为0表示没有序号，无法去重，直接显示
+    bool accept(long long seq)
+    {
+        if (seq == 0)
+        {
+            return true;
+        }
+        if (seq <= _loginSeq)
+        {
+            return acceptEarly(seq);
+        }
+        long long cursor = _cursor;
+        if (seq <= cursor || !_seen.insert(seq).second)
+        {
+            return false;
+        }
+
+        // 序号连续时推进游标
+        while (_seen.count(cursor + 1))
+        {
+            ++cursor;
+        }
+        // 记录的序号太多，说明中间有一直没有收到的消息，放弃等待最早的缺口
+        while (_seen.size() > _maxSeen)
+        {
+            cursor = max(cursor, *_seen.begin());
+            _seen.erase(_seen.begin());
+        }
+        // 游标之前的序号不会再被接受，不需要继续记录
+        _seen.erase(_seen.begin(), _seen.upper_bound(cursor));
+        _cursor = cursor;
+        return true;
+    }
+
+    // 离线消息是否需要显示，登录之后才存入的离线消息和实时消息一样去重
+    bool acceptOffline(long long seq)
+    {
+        return accept(seq);
+    }
+
+private:
+    // 序号不超过登录响应中seq的消息，按登录前集合去重
+    bool acceptEarly(long long seq)
+    {
+        if (!_early.insert(seq).second)
+        {
+            return false;
+        }
+        // 离线消息很多时只保留最近的记录，这些消息本来就只从一条途径到达，丢掉最早的记录只是少了一层保险
+        if (_early.size() > _maxSeen)
+        {
+            _early.erase(_early.begin());
+        }
+        return true;
+    }
+
+    atomic<long long> _cursor;
+    // 登录响应中的seq，只在接收线程中访问
+    long long _loginSeq;
+    const size_t _maxSeen;
+    // 游标之后已经收到的序号，只在接收线程中访问
+    set<long long> _seen;
+    // 已经收到的、序号不超过登录响应中seq的消息，只在接收线程中访问
+    set<long long> _early;
+};
+
+#endif
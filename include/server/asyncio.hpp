@@ -0,0 +1,183 @@
+// 服务器 - 协程中等待mysql、redis调用
+#ifndef ASYNCIO_H
+#define ASYNCIO_H
+
+#include <muduo/net/EventLoop.h>
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <variant>
+
+#include "workerpool.hpp"
+using namespace std;
+using namespace muduo::net;
+
+// 在线程池中执行一次阻塞调用，co_await它的协程挂起，调用完成后回到loop上恢复执行
+// 调用中抛出的异常在co_await的地方重新抛出
+// 多个互不依赖的调用可以用whenAll同时进行
+template <typename T>
+class BlockingCall
+{
+public:
+    // 结果类型为void时，whenAll中用monostate占位
+    using Value = conditional_t<is_void_v<T>, monostate, T>;
+
+    BlockingCall(WorkerPool &pool, EventLoop *loop, function<T()> fn)
+        : _pool(pool), _loop(loop), _fn(std::move(fn)) {}
+
+    bool await_ready() noexcept { return false; }
+
+    void await_suspend(coroutine_handle<> handle)
+    {
+        start([handle]() { handle.resume(); });
+    }
+
+    T await_resume()
+    {
+        if constexpr (is_void_v<T>)
+        {
+            take();
+        }
+        else
+        {
+            return take();
+        }
+    }
+
+    // 把调用提交到线程池，完成后在loop上调用done
+    // 调用完成之前协程不会恢复，this所在的协程帧一直有效
+    void start(function<void()> done)
+    {
+        _pool.submit([this, done]() {
+            try
+            {
+                call();
+            }
+            catch (...)
+            {
+                _error = current_exception();
+            }
+            _loop->runInLoop(done);
+        });
+    }
+
+    // 取出调用的结果，调用抛出了异常时重新抛出
+    Value take()
+    {
+        if (_error)
+        {
+            rethrow_exception(_error);
+        }
+        return std::move(*_result);
+    }
+
+private:
+    void call()
+    {
+        if constexpr (is_void_v<T>)
+        {
+            _fn();
+            _result.emplace();
+        }
+        else
+        {
+            _result.emplace(_fn());
+        }
+    }
+
+    WorkerPool &_pool;
+    EventLoop *_loop;
+    function<T()> _fn;
+    optional<Value> _result;
+    exception_ptr _error;
+};
+
+// 同时进行多个BlockingCall，全部完成后恢复协程，结果按参数的顺序放在tuple中：
+//     auto [friends, groups] = co_await whenAll(_async.db(loop, ...), _async.db(loop, ...));
+// 等待时间是最慢的一个调用，而不是所有调用的总和
+// 有调用抛出异常时，等全部调用完成之后重新抛出排在最前面的那个
+// 参数直接传入_async.db、_async.redis的返回值
+template <typename... Calls>
+class WhenAll
+{
+public:
+    explicit WhenAll(Calls &&...calls) : _calls(std::move(calls)...), _remaining(sizeof...(Calls)) {}
+
+    bool await_ready() noexcept { return false; }
+
+    void await_suspend(coroutine_handle<> handle)
+    {
+        _handle = handle;
+        apply([this](Calls &...calls) { (calls.start([this]() { done(); }), ...); }, _calls);
+    }
+
+    tuple<typename Calls::Value...> await_resume()
+    {
+        // 花括号保证从左到右依次取出结果
+        return apply([](Calls &...calls) { return tuple<typename Calls::Value...>{calls.take()...}; }, _calls);
+    }
+
+private:
+    // 每个调用完成时调用，最后一个完成的恢复协程
+    void done()
+    {
+        if (--_remaining == 0)
+        {
+            _handle.resume();
+        }
+    }
+
+    tuple<Calls...> _calls;
+    atomic<int> _remaining;
+    coroutine_handle<> _handle;
+};
+
+template <typename... Calls>
+WhenAll<Calls...> whenAll(Calls &&...calls)
+{
+    return WhenAll<Calls...>(std::forward<Calls>(calls)...);
+}
+
+// 协程业务的mysql、redis调用
+// model、Redis、Presence的接口都是阻塞的，协程把调用交给这里的线程执行，自己挂起，不占用任何线程，
+// 调用完成后回到连接所在的I/O线程(EventLoop)上继续执行，业务代码还是按顺序写：
+//     User user = co_await _async.db(loop, [&]() { return _userModel.query(id); });
+// lambda可以按引用捕获协程中的变量，调用完成之前协程帧一直有效
+//
+// mysql和redis分别使用不同的线程：mysql变慢时，redis调用不会排在mysql调用后面
+// mysql线程数和连接池的最大连接数一致，再多的线程也只是在连接池上等待；redis命令在Redis的小连接池上执行，线程数不超过连接数
+// 同时进行中的登录数不再受线程数限制，超过线程数的调用在这里排队，等待的协程不占用线程
+class AsyncIo
+{
+public:
+    AsyncIo(int dbThreads, int redisThreads);
+
+    // 启动线程
+    void start();
+    // 停止线程，还没有执行的调用不再执行，等待它们的协程不会再恢复
+    void stop();
+
+    // 在mysql线程中执行fn，fn中一般是model的调用
+    template <typename Fn>
+    BlockingCall<invoke_result_t<Fn>> db(EventLoop *loop, Fn fn)
+    {
+        return BlockingCall<invoke_result_t<Fn>>(_dbPool, loop, std::move(fn));
+    }
+
+    // 在redis线程中执行fn，fn中一般是Redis、Presence、Inbox的调用
+    template <typename Fn>
+    BlockingCall<invoke_result_t<Fn>> redis(EventLoop *loop, Fn fn)
+    {
+        return BlockingCall<invoke_result_t<Fn>>(_redisPool, loop, std::move(fn));
+    }
+
+private:
+    WorkerPool _dbPool;
+    WorkerPool _redisPool;
+};
+
+#endif
@@ -4,6 +4,8 @@
 
 #include <muduo/net/TcpServer.h>
 #include <muduo/net/EventLoop.h>
+#include "codec.hpp"
+#include "workerpool.hpp"
 using namespace muduo;
 using namespace muduo::net;
 
@@ -19,17 +21,25 @@ public:
     
     //启动服务
     void start();
+
+    // 业务线程池中还没有执行完的任务数
+    long pendingTasks() const;
 private:
     // 上报连接相关信息的回调函数，即用户的连接和断开
     void onConnection(const TcpConnectionPtr &);
 
-    // 上报读写事件相关信息的回调函数
+    // 编解码器切分出一条完整消息后的回调函数
     void onMessage(const TcpConnectionPtr &, // 连接
-                   Buffer *,                 // 缓冲区
+                   const string &,           // 不带包头的一条完整消息
                    Timestamp);               // 接收到数据的时间信息
 
+    // 在业务线程中处理一条完整消息：解析并分发给业务层
+    static void handleMessage(const TcpConnectionPtr &conn, const string &buf, Timestamp time);
+
     TcpServer _server; // 组合的muduo库，实现服务器功能的类对象
     EventLoop *_loop; // 指向事件循环对象的指针
+    MessageCodec _codec; // 消息编解码器，负责处理TCP粘包、半包
+    WorkerPool _workers; // 业务线程池，I/O线程只收发消息，业务都在这里按连接串行执行
 
 };
 
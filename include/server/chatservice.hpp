@@ -13,70 +13,103 @@
 #include "friendmodel.hpp"
 #include "groupmodel.hpp"
 #include "redis.hpp"
+#include "codec.hpp"
+#include "groupcache.hpp"
+#include "offlinemsgwriter.hpp"
+#include "connectionregistry.hpp"
+#include "presence.hpp"
+#include "dispatcher.hpp"
+#include "inbox.hpp"
+#include "session.hpp"
+#include "request.hpp"
+#include "msgdispatch.hpp"
+#include "task.hpp"
+#include "asyncio.hpp"
+#include "loginack.hpp"
 
 using namespace std;
 using namespace muduo;
 using namespace muduo::net;
 using json = nlohmann::json;
 
-// C++11新语法：using给已经存在的类型定义新的类型名称
-// msgid对应的回调，表示处理消息的事件回调方法类型
-// conn是连接，js就是发送的消息
-using MsgHandler = std::function<void(const TcpConnectionPtr &conn, json &js, Timestamp)>;
+// 一条要转发的聊天消息，在chatservice.cpp中定义
+class ChatPayload;
 
 // 主要是做业务
 // 聊天服务器业务类，单例模式
-// 要给msg_id映射一个事件回调
+// 每个msgid对应一个业务方法，业务方法的参数是这种消息的请求结构体，见dispatch中的分发表
 class ChatService
 {
 public:
     // 获取单例对象的接口函数
     static ChatService *instance();
-    // 因为下面几个业务都是网络层派发回来的回调，所以参数都是一致的
+    // 设置本服务器在集群中的节点id，并订阅本服务器的节点通道
+    void initNode(const string &nodeid);
+    // 因为下面几个业务都是网络层派发回来的回调，所以参数形式都是一致的
     // 处理登录业务
-    void login(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    // 登录要依次查询mysql和redis好几次，写成协程，每次查询时挂起，不占用线程
+    Task<void> login(TcpConnectionPtr conn, LoginRequest req, Timestamp time);
     // 处理注册业务
-    void reg(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    void reg(const TcpConnectionPtr &conn, const RegRequest &req, Timestamp time);
     // 一对一聊天业务
-    void onechat(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    void onechat(const TcpConnectionPtr &conn, const OneChatRequest &req, Timestamp time);
     // 添加好友业务
-    void addFriend(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    void addFriend(const TcpConnectionPtr &conn, const AddFriendRequest &req, Timestamp time);
     // 创建群组业务
-    void createGroup(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    void createGroup(const TcpConnectionPtr &conn, const CreateGroupRequest &req, Timestamp time);
     // 加入群组业务
-    void addGroup(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    void addGroup(const TcpConnectionPtr &conn, const AddGroupRequest &req, Timestamp time);
     // 群组聊天业务
-    void groupChat(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    void groupChat(const TcpConnectionPtr &conn, const GroupChatRequest &req, Timestamp time);
     // 处理注销业务
-    void loginout(const TcpConnectionPtr &conn, json &js, Timestamp time);
+    void loginout(const TcpConnectionPtr &conn, const LoginoutRequest &req, Timestamp time);
+    // 客户端确认收到离线消息，删除已确认的消息，并推送下一页
+    void offlineAck(const TcpConnectionPtr &conn, const OfflineAckRequest &req, Timestamp time);
+    // 增量同步，返回序号大于客户端给出的seq的消息
+    void syncMsg(const TcpConnectionPtr &conn, const SyncRequest &req, Timestamp time);
+    // 协商这条连接上聊天消息的格式
+    void protocol(const TcpConnectionPtr &conn, const ProtocolRequest &req, Timestamp time);
+    // 处理二进制格式的聊天消息，只解析固定头，不构造json对象
+    void handleBinary(const TcpConnectionPtr &conn, const string &body, Timestamp time);
+    // 转发只需要路由字段就能处理的json消息，不构造json对象，原样转发消息原文
+    // 消息不能走这条路径时返回false，由调用者解析成json后按msgid分发
+    bool relay(const TcpConnectionPtr &conn, const string &body, Timestamp time);
 
-    // 获取消息对应的处理器
-    MsgHandler getHandler(int msgid);
+    // 按msgid把消息分发给对应的业务方法
+    void dispatch(int msgid, const TcpConnectionPtr &conn, json &js, Timestamp time);
     // 处理客户端异常退出
     void clientCloseException(const TcpConnectionPtr &conn);
     // 服务器异常，业务重置的方法
     void reset();
-    // 从redis消息队列中获取订阅的消息
-    void handleRedisSubscribeMessage(int, string);
+    // 从本服务器的节点通道中收到其他服务器转发过来的消息
+    void handleNodeMessage(string);
+    // 其他服务器上群组成员发生了变化，删除本地的群组成员缓存
+    void handleGroupCacheInvalidate(string);
+    // 向redis发布消息失败
+    void handleRedisPublishError(string, string);
+    // 获取跨服务器消息分发的运行状态
+    SubscribeDispatcher::Stats dispatchStats();
 
 private:
     ChatService(); // 构造函数私有化
+    ~ChatService();
 
-    // 存储消息id和对应的业务处理方法
-    // 消息处理器表：存的是msg_id对应的处理操作
-    // 这个表不需要考虑线程安全，因为在运行过程中不会添加、删除或修改业务，只是调用业务
-    // key 应该就是msg_id
-    unordered_map<int, MsgHandler> _msgHandlerMap;
+    // 推送用户编号大于afterId的一页离线消息，没有离线消息时不推送
+    void sendOfflinePage(const TcpConnectionPtr &conn, int userid, long long afterId);
+    // 查询用户编号大于afterId的一页离线消息，返回序列化好的OFFLINE_MSG消息，没有离线消息时返回空串
+    string offlinePageOf(int userid, long long afterId);
+    // 一对一聊天消息的转发，json和二进制格式的消息都走这里
+    void routeOneChat(int toid, ChatPayload &payload);
+    // 群聊消息的转发，json和二进制格式的消息都走这里
+    void routeGroupChat(int userid, int groupid, ChatPayload &payload);
+    // 把节点通道中收到的消息转发给本服务器上的一个用户，用户已经下线时存为离线消息
+    void deliverNodeMessage(int userid, const string &msg);
 
     // 存储在线用户的通信连接
-    // 这个map最后会被多个线程调用
-    // 因为onMessage本身就会被多个线程调用，且不同用户可能在不同的工作线程中响应，进行一系列修改map的操作
-    // 所以这个map还需要考虑线程安全问题
-    // int 是用户的id
-    unordered_map<int, TcpConnectionPtr> _userConnMap;
-
-    // 定义互斥锁，保证_userConnMap的线程安全
-    mutex _connMutex;
+    // 这个表最后会被多个线程调用
+    // 因为onMessage本身就会被多个线程调用，且不同用户可能在不同的工作线程中响应，进行一系列修改表的操作
+    // 所以这个表还需要考虑线程安全问题，内部按用户id分片加锁，不同分片的操作互不阻塞
+    ConnectionRegistry _userConnMap;
 
     // 数据操作类对象 --- user表
     // 服务只依赖于model类，不做具体的数据库相关操作
@@ -89,8 +122,30 @@ private:
     // 数据操作类对象 --- groupuser表以及allgroup表
     GroupModel _groupModel;
 
+    // 离线消息的批量异步写入，业务中存储离线消息都通过它，只有登录时的查询和删除直接使用_offlineMsgModel
+    OfflineMsgWriter _offlineWriter;
+
+    // 群组成员缓存，群聊时不再每条消息都查询数据库
+    GroupCache _groupCache;
+
     // redis操作对象
     Redis _redis;
+
+    // 集群在线状态，查询用户登录在哪台服务器上，并异步更新user表的state
+    Presence _presence;
+
+    // 用户消息序号和最近消息收件箱
+    Inbox _inbox;
+
+    // 协程业务的mysql、redis调用，放在model、redis对象之后定义，析构时先停止线程，再析构线程中用到的对象
+    AsyncIo _async;
+
+    // 跨服务器消息的分发器，订阅线程收到的消息交给I/O线程发送，离线消息交给线程池存储
+    // 放在model对象之后定义，析构时先停止线程池，再析构线程池中用到的model对象
+    SubscribeDispatcher _dispatcher;
+
+    // 本服务器在集群中的节点id，用户登录在哪台服务器上，就记录哪台服务器的节点id
+    string _nodeId;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,53 @@
+// 服务器 - 消息编解码层代码
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <muduo/net/TcpConnection.h>
+#include <muduo/net/Buffer.h>
+#include <functional>
+#include <memory>
+#include <string>
+using namespace std;
+using namespace muduo;
+using namespace muduo::net;
+
+// 长度头编解码器
+// 帧格式：4字节包头(消息体长度，网络字节序) + 消息体
+// 负责从muduo的Buffer中切分出完整的消息，以及在发送时给消息加上包头
+class MessageCodec
+{
+public:
+    // 切分出一条完整消息后的回调，string是不带包头的消息体
+    using FrameCallback = function<void(const TcpConnectionPtr &, const string &, Timestamp)>;
+
+    explicit MessageCodec(const FrameCallback &cb);
+
+    // 注册给TcpServer的消息回调
+    // 一次性取出buffer中所有完整的消息，按顺序上报；不完整的半条消息留在buffer中，等待后续数据
+    void onMessage(const TcpConnectionPtr &conn, Buffer *buffer, Timestamp time);
+
+    // 已经加好包头的完整消息帧，只读，可以在多个连接之间共享
+    using FramePtr = shared_ptr<const string>;
+
+    // 给消息加上包头后发送，可以在任意线程中调用
+    static void send(const TcpConnectionPtr &conn, const string &message);
+    // 发送由head和data两段拼成的一条消息，可以在任意线程中调用
+    // 转发时只需要改写消息开头的几个字节(例如写入序号)，消息的其余部分不用先拼成新的字符串
+    static void send(const TcpConnectionPtr &conn, const string &head, const char *data, size_t len);
+    // 发送已经写在buf中的消息体，包头直接写在buf前面预留的空间中，buf中的内容会被取走
+    // 用于直接写入Buffer的大消息，不需要先生成字符串再复制一次
+    static void send(const TcpConnectionPtr &conn, Buffer *buf);
+
+    // 给消息加上包头，编码成可以共享的消息帧
+    // 群发时只编码一次，然后把同一个消息帧发给所有连接
+    static FramePtr encode(const string &message);
+    // 把head和data两段拼成一条消息，编码成可以共享的消息帧
+    static FramePtr encode(const string &head, const char *data, size_t len);
+    // 发送已经编码好的消息帧，可以在任意线程中调用
+    static void send(const TcpConnectionPtr &conn, const FramePtr &frame);
+
+private:
+    FrameCallback _frameCallback;
+};
+
+#endif
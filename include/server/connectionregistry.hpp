@@ -0,0 +1,127 @@
+// 服务层 - 在线用户连接表
+#ifndef CONNECTIONREGISTRY_H
+#define CONNECTIONREGISTRY_H
+
+#include <muduo/net/TcpConnection.h>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// 在线用户连接表，按用户id分片
+// 登录、注销、单聊、群聊、redis转发都要访问在线用户表，而且来自muduo的多个工作线程
+// 如果整个表只用一把锁，所有线程都会在这把锁上排队；分成SHARD_COUNT个分片，每个分片一把锁，
+// 不同用户的操作大概率落在不同的分片上，互不阻塞
+// ConnPtr是连接的智能指针类型，服务器中就是TcpConnectionPtr，做成模板方便单独做性能测试
+template <typename ConnPtr>
+class BasicConnectionRegistry
+{
+public:
+    // 分片个数，取2的幂，用位运算代替取模
+    static const int SHARD_COUNT = 64;
+
+    // 用户不在表中时记录用户的连接，返回true；用户已经在表中则不覆盖，返回false
+    // 登录时以它的返回值判断是否重复登录，检查和插入在同一把锁内完成
+    bool insertIfAbsent(int userid, const ConnPtr &conn)
+    {
+        Shard &shard = getShard(userid);
+        lock_guard<mutex> lock(shard.connMutex);
+        return shard.connMap.insert({userid, conn}).second;
+    }
+
+    // 删除用户的连接，用户不在表中返回false
+    bool erase(int userid)
+    {
+        Shard &shard = getShard(userid);
+        lock_guard<mutex> lock(shard.connMutex);
+        return shard.connMap.erase(userid) > 0;
+    }
+
+    // 查找用户的连接，不在本服务器上返回空指针
+    // 返回的是智能指针的拷贝，出了锁之后连接对象依然有效
+    ConnPtr find(int userid)
+    {
+        Shard &shard = getShard(userid);
+        lock_guard<mutex> lock(shard.connMutex);
+        auto it = shard.connMap.find(userid);
+        return it != shard.connMap.end() ? it->second : ConnPtr();
+    }
+
+    // 批量查找，在本服务器上的用户的连接放入conns，其余用户的id放入others
+    // found不为空时，按conns的顺序放入这些连接对应的用户id
+    // 先把id按分片分组，每个分片只加一次锁
+    void findAll(const vector<int> &userids, vector<ConnPtr> &conns, vector<int> &others, vector<int> *found = nullptr)
+    {
+        vector<int> buckets[SHARD_COUNT];
+        for (int userid : userids)
+        {
+            buckets[shardIndex(userid)].push_back(userid);
+        }
+
+        for (int i = 0; i < SHARD_COUNT; ++i)
+        {
+            if (buckets[i].empty())
+            {
+                continue;
+            }
+            Shard &shard = _shards[i];
+            lock_guard<mutex> lock(shard.connMutex);
+            for (int userid : buckets[i])
+            {
+                auto it = shard.connMap.find(userid);
+                if (it != shard.connMap.end())
+                {
+                    conns.push_back(it->second);
+                    if (found != nullptr)
+                    {
+                        found->push_back(userid);
+                    }
+                }
+                else
+                {
+                    others.push_back(userid);
+                }
+            }
+        }
+    }
+
+    // 只有用户当前的连接就是conn时才删除，返回是否删除
+    // 连接断开时使用，防止把用户在别的连接上的新登录误删掉
+    bool erase(int userid, const ConnPtr &conn)
+    {
+        Shard &shard = getShard(userid);
+        lock_guard<mutex> lock(shard.connMutex);
+        auto it = shard.connMap.find(userid);
+        if (it == shard.connMap.end() || it->second != conn)
+        {
+            return false;
+        }
+        shard.connMap.erase(it);
+        return true;
+    }
+
+private:
+    // 每个分片独占一个缓存行，避免不同分片的锁互相伪共享
+    struct alignas(64) Shard
+    {
+        mutex connMutex;
+        unordered_map<int, ConnPtr> connMap;
+    };
+
+    static int shardIndex(int userid)
+    {
+        return static_cast<unsigned int>(userid) & (SHARD_COUNT - 1);
+    }
+
+    Shard &getShard(int userid)
+    {
+        return _shards[shardIndex(userid)];
+    }
+
+    Shard _shards[SHARD_COUNT];
+};
+
+// 服务器使用的在线用户连接表
+using ConnectionRegistry = BasicConnectionRegistry<muduo::net::TcpConnectionPtr>;
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef CONNECTIONPOOL_H
+#define CONNECTIONPOOL_H
+
+#include "db.h"
+#include <memory>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+using namespace std;
+
+// MySQL连接池，单例模式
+// 每次数据库操作都重新建立连接(TCP三次握手 + mysql认证 + set names)代价很大，
+// 连接池预先创建好一批连接，用完归还而不是关闭，下次直接复用
+class ConnectionPool
+{
+public:
+    // 获取连接池单例对象的接口函数
+    static ConnectionPool *instance();
+
+    // 从连接池中获取一个可用连接
+    // 返回的智能指针析构时会自动把连接归还到连接池，而不是关闭连接
+    // 连接池耗尽时最多等待_connectionTimeout毫秒，超时或者数据库连不上返回nullptr
+    shared_ptr<MySQL> getConnection();
+
+private:
+    ConnectionPool(); // 构造函数私有化
+    ~ConnectionPool();
+
+    // 把连接包装成归还式的智能指针
+    shared_ptr<MySQL> wrapConnection(MySQL *conn);
+
+    // 运行在独立线程中，定期回收空闲时间超过_maxIdleTime的多余连接
+    void scannerConnectionTask();
+
+    int _initSize;          // 初始连接数，也是空闲回收后保留的最小连接数
+    int _maxSize;           // 最大连接数
+    int _maxIdleTime;       // 连接最大空闲时间(毫秒)，超过则被回收
+    int _connectionTimeout; // 连接池耗尽时获取连接的最大等待时间(毫秒)
+    int _pingIdleTime;      // 连接空闲超过该时间(毫秒)，复用前先ping一下检查是否存活
+
+    // 空闲连接队列，尾部是最近归还的连接，头部是空闲最久的连接
+    // 从尾部取连接，让热连接被反复复用，冷连接自然沉到头部被回收
+    deque<MySQL *> _connectionQue;
+    // 当前已经创建的连接总数(包括空闲的和正在使用的)
+    int _connectionCnt;
+    // 连接池是否已经关闭
+    bool _isClosed;
+
+    // 保证连接队列线程安全的互斥锁
+    mutex _queueMutex;
+    // 有连接归还时，通知等待连接的线程
+    condition_variable _cv;
+    // 连接池关闭时，唤醒回收线程
+    condition_variable _scannerCv;
+    // 回收空闲连接的线程
+    thread _scannerThread;
+};
+
+#endif
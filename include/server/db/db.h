@@ -3,6 +3,10 @@
 
 #include <mysql/mysql.h>
 #include <string>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include "statement.hpp"
 using namespace std;
 
 
@@ -22,10 +26,24 @@ public:
     MYSQL_RES *query(string sql);
     // 获取连接
     MYSQL* getConnection();
+    // 获取sql对应的预处理语句，同一条连接上相同的sql只预处理一次，之后直接复用
+    // 预处理失败返回nullptr
+    Statement *prepare(const string &sql);
+
+    // 检查连接是否还活着，连接池复用空闲连接前调用
+    bool ping();
+    // 刷新连接进入空闲状态的起始时间，连接归还到连接池时调用
+    void refreshAliveTime();
+    // 获取连接已经空闲的时长(毫秒)
+    long getIdleTime() const;
 
 private:
     // 可以看作是和mysql的一条连接（但其实不是）
     MYSQL *_conn;
+    // 这条连接上已经预处理过的语句，key是sql
+    unordered_map<string, unique_ptr<Statement>> _stmtCache;
+    // 连接进入空闲状态的时间点
+    chrono::steady_clock::time_point _aliveTime;
 };
 
-#endif
\ No newline at end of file
+#endif
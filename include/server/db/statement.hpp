@@ -0,0 +1,115 @@
+#ifndef STATEMENT_H
+#define STATEMENT_H
+
+#include <mysql/mysql.h>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+using namespace std;
+
+// 预处理语句类，封装MYSQL_STMT
+// sql只在prepare时发给mysql server解析一次，之后每次执行只发送参数，
+// 参数按类型绑定，不再拼接sql字符串，既省去了server端的重复解析，也不存在sql注入和长度截断的问题
+// 一个Statement属于一条MySQL连接，由连接缓存复用，同一时刻只会被取得该连接的一个线程使用
+class Statement
+{
+public:
+    Statement(MYSQL *conn, const string &sql);
+    ~Statement();
+
+    Statement(const Statement &) = delete;
+    Statement &operator=(const Statement &) = delete;
+
+    // 预处理sql语句，失败返回false
+    bool prepare();
+
+    // 绑定第idx个参数(从0开始)，绑定的值会被拷贝保存，直到下一次绑定
+    void bind(int idx, int value);
+    void bind(int idx, long long value);
+    void bind(int idx, const string &value);
+
+    // 执行语句，如果有结果集，会把结果集全部缓存到客户端，之后用fetch逐行读取
+    bool execute();
+    // 按顺序绑定所有参数后执行，例如 stmt->execute(groupid, userid, role)
+    template <typename... Args>
+    bool execute(const Args &...args)
+    {
+        bindAll(0, args...);
+        return execute();
+    }
+
+    // 取下一行结果，没有更多的行返回false
+    bool fetch();
+    // 取下一行结果，并按顺序把各列写入args中，例如 stmt->fetch(id, name, state)
+    template <typename... Args>
+    bool fetch(Args &...args)
+    {
+        if (!fetch())
+        {
+            return false;
+        }
+        getAll(0, args...);
+        return true;
+    }
+
+    // 读取当前行第col列的值(从0开始)，NULL值返回0或空串
+    int getInt(int col) const;
+    long long getLongLong(int col) const;
+    string getString(int col) const;
+
+    // 上一次执行insert语句生成的自增id
+    int insertId();
+    // 上一次执行影响的行数
+    int affectedRows();
+
+private:
+    // MYSQL_BIND中is_null的类型：mysql 5.7是my_bool，8.0是bool
+    using MysqlBool = remove_pointer<decltype(MYSQL_BIND::is_null)>::type;
+
+    void bindAll(int) {}
+    template <typename T, typename... Args>
+    void bindAll(int idx, const T &value, const Args &...args)
+    {
+        bind(idx, value);
+        bindAll(idx + 1, args...);
+    }
+
+    void getAll(int) {}
+    template <typename... Args>
+    void getAll(int col, int &value, Args &...args)
+    {
+        value = getInt(col);
+        getAll(col + 1, args...);
+    }
+    template <typename... Args>
+    void getAll(int col, long long &value, Args &...args)
+    {
+        value = getLongLong(col);
+        getAll(col + 1, args...);
+    }
+    template <typename... Args>
+    void getAll(int col, string &value, Args &...args)
+    {
+        value = getString(col);
+        getAll(col + 1, args...);
+    }
+
+    MYSQL_STMT *_stmt;
+    string _sql;
+
+    // 参数绑定，预处理成功后按参数个数分配好，之后不再扩容，保证绑定的地址一直有效
+    vector<MYSQL_BIND> _params;
+    vector<int> _intParams;
+    vector<long long> _longParams;
+    vector<string> _strParams;
+    vector<unsigned long> _paramLengths;
+
+    // 结果绑定，所有列都按字符串取出，由mysql client负责把数值转换成字符串
+    vector<MYSQL_BIND> _results;
+    vector<string> _resultBuffers;
+    vector<unsigned long> _resultLengths;
+    unique_ptr<MysqlBool[]> _resultNulls;
+};
+
+#endif
@@ -0,0 +1,69 @@
+// 服务层 - 跨服务器消息的分发
+#ifndef DISPATCHER_H
+#define DISPATCHER_H
+
+#include <muduo/base/ThreadPool.h>
+#include <muduo/base/Timestamp.h>
+#include <muduo/net/TcpConnection.h>
+#include <atomic>
+#include <functional>
+
+#include "codec.hpp"
+using namespace std;
+using namespace muduo;
+using namespace muduo::net;
+
+// 跨服务器消息的分发器
+// redis订阅线程只有一个，如果直接在订阅线程里写连接、存离线消息，一次慢的mysql写入就会卡住所有服务器发过来的消息
+// 所以订阅线程只负责拆信封、查在线用户表，然后立刻把工作交出去：
+// 1. 在线的接收者：把发送投递到连接所属的EventLoop中执行，由该连接的I/O线程发送
+// 2. 离线的接收者：把存储离线消息放到独立的线程池中执行，不占用订阅线程和I/O线程
+// 同时统计两个队列的积压深度，以及从订阅线程收到消息到I/O线程真正发送之间的延迟
+class SubscribeDispatcher
+{
+public:
+    // 运行状态统计
+    struct Stats
+    {
+        // 已经投递到EventLoop、还没有发送的消息数
+        long loopPending;
+        // 离线消息线程池中排队的任务数
+        size_t offlinePending;
+        // 上次统计以来发送的消息数
+        long delivered;
+        // 上次统计以来的平均、最大分发延迟，单位微秒
+        long avgLagUs;
+        long maxLagUs;
+    };
+
+    // threadNum是离线消息线程池的线程数，maxQueueSize是线程池的队列上限，队列满时投递方阻塞等待
+    explicit SubscribeDispatcher(int threadNum = 2, int maxQueueSize = 100000);
+    ~SubscribeDispatcher();
+
+    // 把消息帧投递到连接所属的EventLoop中发送，received是订阅线程收到消息的时间
+    void deliver(const TcpConnectionPtr &conn, const MessageCodec::FramePtr &frame, Timestamp received);
+
+    // 在离线消息线程池中执行task，线程池停止之后在调用线程中直接执行
+    void runOffline(function<void()> task);
+
+    // 等线程池中排队的任务执行完，再停止线程池，可以重复调用
+    void stop();
+
+    // 获取运行状态，并重新开始统计延迟
+    Stats stats();
+
+private:
+    // 消息在EventLoop中发送后，记录延迟
+    void recordLag(Timestamp received);
+
+    ThreadPool _offlinePool;
+    // 线程池是否已经停止
+    atomic<bool> _stopped;
+
+    atomic<long> _loopPending;
+    atomic<long> _delivered;
+    atomic<long> _lagSumUs;
+    atomic<long> _lagMaxUs;
+};
+
+#endif
@@ -0,0 +1,75 @@
+// 服务层 - 群组成员缓存
+#ifndef GROUPCACHE_H
+#define GROUPCACHE_H
+
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// 群组成员缓存
+// 群聊每条消息都要知道群里有哪些成员，而群成员很少变化，没必要每条消息都查一次mysql
+// key是群组id，value是排好序的成员id列表，第一次用到时从数据库加载
+// 缓存的成员总数有上限，超过上限时淘汰最久没有用到的群组(LRU)
+class GroupCache
+{
+public:
+    // 成员列表是只读共享的，更新时整体替换，读者拿到的列表不会被修改
+    using MemberList = shared_ptr<const vector<int>>;
+    // 从数据库加载一个群组的所有成员id，加载失败返回false
+    using Loader = function<bool(int groupid, vector<int> &ids)>;
+
+    GroupCache(const Loader &loader, size_t maxMembers = 1000000);
+
+    // 获取群组的所有成员，不在缓存中则从数据库加载
+    // 加载失败时返回空列表，不放入缓存，下次用到时重新加载
+    MemberList getMembers(int groupid);
+
+    // 用户加入了群组，如果该群组在缓存中，把用户加入成员列表
+    void addMember(int groupid, int userid);
+
+    // 新建了群组，直接以已知的成员列表放入缓存
+    void putGroup(int groupid, vector<int> members);
+
+    // 群组成员在其他服务器上发生了变化，删除本地缓存，下次用到时重新加载
+    void invalidate(int groupid);
+
+private:
+    // 放入或替换一个群组的成员列表，并淘汰超出上限的部分，调用时需要持有_mutex
+    void putLocked(int groupid, const MemberList &members);
+    // 群组成员发生了变化，正在从数据库加载该群组的结果作废，调用时需要持有_mutex
+    void bumpLocked(int groupid);
+
+    struct Entry
+    {
+        MemberList members;
+        list<int>::iterator lruIt; // 在_lruList中的位置
+    };
+
+    Loader _loader;
+    // 缓存的成员id总数上限，一个id占4字节
+    size_t _maxMembers;
+    // 当前缓存的成员id总数
+    size_t _memberCount;
+
+    // 正在从数据库加载的群组
+    struct Loading
+    {
+        // 该群组每次更新或失效都会加1，加载期间发生了变化则丢弃加载的结果，防止旧数据覆盖新数据
+        unsigned long generation;
+        // 同时在加载该群组的线程数，都加载完之后删除
+        int loaders;
+    };
+    // 只记录正在加载的群组，大小不超过同时加载的线程数；一个群组的变化不会作废其他群组的加载
+    unordered_map<int, Loading> _loading;
+
+    unordered_map<int, Entry> _groupMap;
+    // LRU链表，头部是最近用到的群组id，尾部是最久没用到的
+    list<int> _lruList;
+    mutex _mutex;
+};
+
+#endif
@@ -0,0 +1,58 @@
+// 服务层 - 用户消息序号和最近消息收件箱
+#ifndef INBOX_H
+#define INBOX_H
+
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "redis.hpp"
+using namespace std;
+
+// 用户消息收件箱
+// 发给用户的每条聊天消息都带一个该用户的序号"seq"，从1开始连续递增，由redis分配，集群中所有服务器共用
+// 同时把带序号的消息放入redis中该用户的收件箱(有序集合，分数是序号)，只保留最近的MAX_SIZE条，空闲TTL秒后过期
+// 只有一个接收者时收件箱中直接存放带序号的消息；多个接收者(群聊)时消息只存一份，收件箱中存放消息的引用
+//
+// 序号的用处：
+// 1. 客户端网络闪断重连后，发送SYNC_MSG带上已经连续收到的最大序号，只取回之后的消息，而不是全部重新获取
+// 2. 同一条消息可能既通过跨服务器转发又通过离线消息到达，客户端按序号去重
+//
+// 消息在发送时才把序号写进json：{"seq":N, 原来的字段...}，不需要重新解析、序列化原始消息
+class Inbox
+{
+public:
+    explicit Inbox(Redis &redis);
+
+    // 给每个接收者分配一个序号，并把带序号的消息放入收件箱，一次redis往返完成
+    // 返回和userids一一对应的序号，redis出错时返回空数组，这时消息不带序号照常发送
+    vector<long long> append(const vector<int> &userids, const string &payload);
+
+    // 获取用户收件箱中序号大于afterSeq的消息，按序号从小到大，最多count条，每条是序号和带序号的消息
+    // 收件箱只保留最近的消息，更早的消息需要通过离线消息获取；引用的共享消息已经过期时，消息是空串
+    vector<pair<long long, string>> query(int userid, long long afterSeq, int count);
+
+    // 用户当前的最大序号，没有消息时是0
+    long long currentSeq(int userid);
+
+    // 在json对象消息的最前面加上序号字段，seq为0表示没有序号，原样返回
+    static string withSeq(const string &payload, long long seq);
+
+    // 和withSeq一样，只是不拼接：带序号的消息是head加上payload从返回的位置开始的部分
+    // 转发时两段直接写入发送缓冲区，不需要先复制出一条新消息
+    static size_t seqHead(const string &payload, long long seq, string &head);
+
+private:
+    // 分配一个集群中唯一的共享消息编号，出错返回0
+    long long nextMessageId();
+
+    Redis &_redis;
+
+    // 本服务器从redis取到的一段共享消息编号(_nextId, _idEnd]，_nextId是上一个用掉的编号
+    long long _nextId;
+    long long _idEnd;
+    mutex _idMutex;
+};
+
+#endif
@@ -0,0 +1,79 @@
+// 服务器 - 不构造json对象直接输出json文本
+#ifndef JSONWRITER_H
+#define JSONWRITER_H
+
+#include <muduo/net/Buffer.h>
+#include <cstring>
+#include <string>
+using namespace std;
+using namespace muduo::net;
+
+// 把json文本按顺序直接写入Buffer，不构造json对象，不产生中间字符串
+// 用于登录响应这类字段多、元素多的大消息：一遍写完，写完的Buffer直接交给MessageCodec发送
+//
+// 调用者负责结构正确：对象中先key再写值，begin和end成对出现；逗号由JsonWriter自动添加
+// 字符串的转义规则和json::dump一样，不合法的UTF-8字节替换成U+FFFD(json::dump遇到时会抛出异常)
+class JsonWriter
+{
+public:
+    explicit JsonWriter(Buffer &buf) : _buf(buf), _needComma(false) {}
+
+    void beginObject()
+    {
+        separator();
+        _buf.append("{", 1);
+        _needComma = false;
+    }
+    void endObject()
+    {
+        _buf.append("}", 1);
+        _needComma = true;
+    }
+    void beginArray()
+    {
+        separator();
+        _buf.append("[", 1);
+        _needComma = false;
+    }
+    void endArray()
+    {
+        _buf.append("]", 1);
+        _needComma = true;
+    }
+
+    // 写入对象的字段名，接下来写入的就是这个字段的值
+    void key(const char *name)
+    {
+        separator();
+        writeString(name, strlen(name));
+        _buf.append(":", 1);
+        _needComma = false;
+    }
+
+    void value(int v) { value(static_cast<long long>(v)); }
+    void value(long long v);
+    void value(const string &s) { value(s.data(), s.size()); }
+    void value(const char *s, size_t len)
+    {
+        separator();
+        writeString(s, len);
+        _needComma = true;
+    }
+
+private:
+    // 同一层中不是第一个元素时，先写逗号
+    void separator()
+    {
+        if (_needComma)
+        {
+            _buf.append(",", 1);
+        }
+    }
+    // 写入带引号、转义后的字符串
+    void writeString(const char *data, size_t len);
+
+    Buffer &_buf;
+    bool _needComma;
+};
+
+#endif
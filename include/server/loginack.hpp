@@ -0,0 +1,28 @@
+// 服务层 - 登录成功的响应
+#ifndef LOGINACK_H
+#define LOGINACK_H
+
+#include <muduo/net/Buffer.h>
+#include <vector>
+
+#include "user.hpp"
+#include "group.hpp"
+using namespace std;
+using namespace muduo::net;
+
+// 登录成功的响应，一遍直接写入发送用的Buffer，不构造json对象
+// 好友多、群组多、群成员多的用户，登录响应有几千个元素，原来每个元素都要构造一个json对象再dump一次
+//
+// 响应的两种格式，由登录请求中的"structured"字段选择：
+// 1. structured：friends、groups、users中的元素直接是json对象
+// 2. 兼容老客户端(默认)：元素是json对象序列化之后的字符串，客户端要对每个元素再解析一次，
+//    字符串中的引号都要转义，消息也更长
+class LoginAck
+{
+public:
+    // 把登录成功的响应写入buf，friends、groups为空时不写这个字段，和原来一样
+    static void write(Buffer &buf, User &user, long long seq, vector<User> &friends, vector<Group> &groups,
+                      bool structured);
+};
+
+#endif
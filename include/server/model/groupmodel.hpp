@@ -18,6 +18,9 @@ public:
     vector<Group> queryGroups(int userid);
     // 根据指定的groupid查询群组用户id列表，除userid自己，主要用户群聊业务给群组其它成员群发消息
     vector<int> queryGroupUsers(int userid, int groupid);
+    // 根据指定的groupid查询群组所有成员的id列表，用于加载群组成员缓存
+    // 获取连接或者执行查询失败返回false，和查询成功但群组没有成员区分开，失败的结果不能放入缓存
+    bool queryGroupMembers(int groupid, vector<int> &idVec);
 };
 
 #endif
\ No newline at end of file
@@ -1,22 +1,34 @@
 #ifndef OFFLINEMESSAGEMODEL_H
 #define OFFLINEMESSAGEMODEL_H
 
+#include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 using namespace std;
 
 // 提供离线消息表的操作接口方法
+// 每条离线消息有一个编号，是offlinemessage表的自增主键，同一用户的离线消息按写入顺序递增
+// 离线消息按编号分页发给客户端，客户端确认之后才删除，已有的库需要先加上编号列：
+// alter table offlinemessage add column id bigint not null auto_increment primary key first;
 class OfflineMsgModel
 {
 public:
     // 存储用户的离线消息
-    void insert(int userid, string msg);
+    void insert(int userid, const string &msg);
 
-    // 删除用户的离线消息
-    void remove(int userid);
+    // 一条待写入的离线消息，群消息的所有接收者共享同一份消息内容
+    using OfflineMsg = pair<int, shared_ptr<const string>>;
+    // 批量写入多条离线消息，返回从头开始连续写入成功的条数，出错时后面的消息都没有写入
+    size_t insert(const vector<OfflineMsg> &msgs);
 
-    // 查询用户的离线消息
-    vector<string> query(int userid);
+    // 删除用户编号不大于id的离线消息
+    void remove(int userid, long long id);
+
+    // 带编号的离线消息
+    using IdMsg = pair<long long, string>;
+    // 按编号从小到大查询用户编号大于afterId的离线消息，最多limit条
+    vector<IdMsg> query(int userid, long long afterId, int limit);
 };
 
 #endif
\ No newline at end of file
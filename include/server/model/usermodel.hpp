@@ -2,6 +2,8 @@
 #define USERMODEL_H
 
 #include "user.hpp"
+#include <vector>
+using namespace std;
 
 // User表的数据操作类
 // 这里和业务不相关，只针对表的，比如增删查改
@@ -16,6 +18,9 @@ public:
     // 更新用户的状态信息
     bool updateState(User user);
 
+    // 把多个用户的状态信息更新为同一个state
+    bool updateState(const vector<int> &ids, const string &state);
+
     // 重置用户的状态信息
     void resetState();
 
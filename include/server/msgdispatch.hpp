@@ -0,0 +1,76 @@
+// 服务器 - 编译期生成的消息分发表
+#ifndef MSGDISPATCH_H
+#define MSGDISPATCH_H
+
+#include <muduo/net/TcpConnection.h>
+#include <cstddef>
+
+#include "json.hpp"
+#include "task.hpp"
+#include "workerpool.hpp"
+using namespace std;
+using namespace muduo;
+using namespace muduo::net;
+using json = nlohmann::json;
+
+// 消息分发表
+// 分发表是一个下标就是msgid的数组，每一项是一个普通的函数指针，指向为"请求类型 + 业务方法"生成的调用函数：
+// 先把json转换成这种消息的请求结构体，再直接调用业务方法
+// 分发只是一次数组下标加一次函数调用：不查哈希表，不复制std::function，找不到业务方法时也不分配内存
+//
+// 分发表在编译期生成，用dense检查表是稠密的(第i项就是msgid为i的消息)，漏写或者写错顺序都编译不过
+//
+// 业务方法也可以是返回Task<void>的协程，这时参数按值传递，分发时启动协程，
+// 并暂停连接的串行队列，协程执行完之后这个连接的下一条消息才会被处理
+template <typename Service>
+struct MsgDispatch
+{
+    // 调用一个业务方法
+    using Invoker = void (*)(Service &, const TcpConnectionPtr &, json &, Timestamp);
+
+    // 分发表中的一项，invoker为空表示这种消息没有业务方法，例如服务器发给客户端的响应消息
+    struct Route
+    {
+        int msgid;
+        Invoker invoker;
+    };
+
+    // 生成调用函数：把json转换成Request之后调用Handler
+    template <typename Request, void (Service::*Handler)(const TcpConnectionPtr &, const Request &, Timestamp)>
+    static void invoke(Service &service, const TcpConnectionPtr &conn, json &js, Timestamp time)
+    {
+        (service.*Handler)(conn, Request(js), time);
+    }
+
+    // 生成调用函数：把json转换成Request之后启动协程Handler
+    template <typename Request, Task<void> (Service::*Handler)(TcpConnectionPtr, Request, Timestamp)>
+    static void invoke(Service &service, const TcpConnectionPtr &conn, json &js, Timestamp time)
+    {
+        // 请求格式不对时在这里抛出异常，还没有暂停串行队列
+        Request req(js);
+        function<void()> resume = WorkerPool::suspendCurrent();
+        spawn((service.*Handler)(conn, std::move(req), time), std::move(resume));
+    }
+
+    // 检查从第i项开始，每一项的msgid都等于它的下标
+    template <size_t N>
+    static constexpr bool dense(const Route (&routes)[N], size_t i = 0)
+    {
+        return i == N || (routes[i].msgid == static_cast<int>(i) && dense(routes, i + 1));
+    }
+
+    // 按msgid分发，msgid超出范围或者没有业务方法时返回false
+    template <size_t N>
+    static bool dispatch(const Route (&routes)[N], Service &service, int msgid,
+                         const TcpConnectionPtr &conn, json &js, Timestamp time)
+    {
+        if (msgid < 0 || static_cast<size_t>(msgid) >= N || routes[msgid].invoker == nullptr)
+        {
+            return false;
+        }
+        routes[msgid].invoker(service, conn, js, time);
+        return true;
+    }
+};
+
+#endif
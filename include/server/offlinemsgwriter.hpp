@@ -0,0 +1,82 @@
+// 服务层 - 离线消息的批量异步写入
+#ifndef OFFLINEMSGWRITER_H
+#define OFFLINEMSGWRITER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "offlinemessagemodel.hpp"
+using namespace std;
+
+// 离线消息的批量异步写入(write-behind)
+// 给1000个离线成员的一条群消息，原来要在I/O线程上同步执行insert，现在只是放入队列，
+// 由后台线程攒够flushRows条或者每隔flushInterval，把队列中的消息用多行insert一起写入mysql
+//
+// 持久性说明：
+// 1. 放入队列就返回，此时消息还只在内存中，进程崩溃(kill -9、断电)会丢失队列中还没写入的消息，
+//    正常情况下最多丢失一个flushInterval内的离线消息
+// 2. mysql写入失败的消息留在队列头部，下个周期重试，不会丢失，也不会乱序；
+//    队列中的消息达到maxPendingRows时write会阻塞等待，内存占用有上限
+// 3. 正常退出时(stop或析构)把队列中的消息全部写完，写不进去的打印错误日志
+// 4. 用户登录查询离线消息之前调用flush，保证本服务器上之前放入队列的消息都已经写入
+class OfflineMsgWriter
+{
+public:
+    using OfflineMsg = OfflineMsgModel::OfflineMsg;
+
+    OfflineMsgWriter(OfflineMsgModel &model,
+                     size_t flushRows = 512,
+                     chrono::milliseconds flushInterval = chrono::milliseconds(50),
+                     size_t maxPendingRows = 1000000);
+    ~OfflineMsgWriter();
+
+    // 存储用户的离线消息
+    void write(int userid, const string &msg);
+
+    // 存储多条离线消息，例如同一条群消息带上每个接收者各自的序号之后的多个版本
+    void write(vector<OfflineMsg> msgs);
+
+    // 等待调用之前放入队列的消息全部写入mysql，最多等待timeout，全部写入返回true
+    bool flush(chrono::milliseconds timeout = chrono::milliseconds(1000));
+
+    // 写完队列中的消息后停止后台线程，之后的write直接同步写入mysql
+    void stop();
+
+    // 队列中等待写入的消息数
+    size_t pendingRows();
+
+private:
+    // 把消息放入队列，队列已满时等待
+    void push(vector<OfflineMsg> &msgs);
+    // 后台写入线程
+    void writerTask();
+
+    OfflineMsgModel &_model;
+    const size_t _flushRows;
+    const chrono::milliseconds _flushInterval;
+    const size_t _maxPendingRows;
+
+    // 等待写入的消息，写入失败的消息放回头部
+    deque<OfflineMsg> _pending;
+    // 放入队列的消息总数，和已经写入的消息总数，flush用来判断之前的消息是否都写完了
+    uint64_t _pushedRows;
+    uint64_t _writtenRows;
+    // 有flush在等待，后台线程不再等满flushInterval
+    int _flushWaiters;
+    bool _stop;
+
+    mutex _mutex;
+    // 通知后台线程有消息需要写入
+    condition_variable _writerCv;
+    // 通知write队列有空位了、通知flush消息已经写入
+    condition_variable _doneCv;
+    thread _thread;
+};
+
+#endif
@@ -0,0 +1,121 @@
+// 服务层 - 集群在线状态
+#ifndef PRESENCE_H
+#define PRESENCE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "redis.hpp"
+#include "usermodel.hpp"
+using namespace std;
+
+// 集群在线状态服务，回答"用户X是否在线，登录在哪台服务器上"，不再查询mysql的user.state
+//
+// redis中保存两类数据：
+// 1. 哈希表chat:usernode，字段是用户id，值是用户登录的服务器节点id，登录时写入，下线时删除
+// 2. 每台服务器一个心跳key presence:node:<节点id>，带过期时间，由心跳线程定期续期
+//    服务器宕机后心跳key过期，哈希表中指向它的用户都当作离线，不需要逐个清理
+//
+// 本地缓存其他服务器上用户的查询结果(包括离线)，用户上线、下线时在presence通道上广播用户id，
+// 所有服务器收到后删除本地缓存；广播丢失时由缓存的过期时间兜底
+//
+// user表的state字段不再在登录、注销的路径上同步更新，而是放入队列，由后台线程合并后批量写入(write-behind)
+// 同一用户在一个刷新周期内多次变化只写最后一次，mysql中的state最多落后FLUSH_INTERVAL
+class Presence
+{
+public:
+    // 用户上线、下线的广播通道，发布的内容是用户id
+    static const string CHANNEL;
+
+    explicit Presence(Redis &redis);
+    ~Presence();
+
+    // 设置本服务器的节点id，清理本节点上次退出时留下的用户记录，启动心跳和state写入线程
+    void start(const string &nodeid);
+
+    // 停止后台线程：把还没写入的state写入mysql，删除登录在本服务器上的用户记录和本服务器的心跳key，
+    // 其他服务器立刻把本服务器上的用户当作离线
+    void stop();
+
+    // 用户在本服务器上登录
+    void online(int userid);
+
+    // 用户从本服务器上下线，用户已经在其他服务器上重新登录时不会删除其他服务器的记录
+    void offline(int userid);
+
+    // 查询用户登录所在的节点id，离线返回空串
+    // cached为false时跳过本地缓存直接查询redis，用于登录时判断重复登录
+    string query(int userid, bool cached = true);
+
+    // 批量查询，结果和userids一一对应
+    vector<string> query(const vector<int> &userids);
+
+    // 其他服务器广播了用户的上线、下线，删除本地缓存
+    void invalidate(int userid);
+
+private:
+    using Clock = chrono::steady_clock;
+
+    // 节点是否存活，结果在本地缓存NODE_CHECK_INTERVAL
+    bool nodeAlive(const string &nodeid);
+    // 删除哈希表中登录在本服务器上的所有用户，启动和停止时调用
+    void purgeOwnUsers();
+    // 开始从redis查询用户所在节点，返回该用户当前的版本号，调用时需要持有_cacheMutex
+    unsigned long beginLoadLocked(int userid);
+    // 查询结束，查询期间没有收到该用户的失效广播时才放入本地缓存，调用时需要持有_cacheMutex
+    void endLoadLocked(int userid, unsigned long generation, const string &nodeid);
+    // 放入本地缓存，调用时需要持有_cacheMutex
+    void putCacheLocked(int userid, const string &nodeid);
+    // state写入队列
+    void pushState(int userid, const string &state);
+    // 心跳和state写入线程
+    void backgroundTask();
+    // 把state写入队列中的内容批量写入mysql
+    void flushState(unordered_map<int, string> &pending);
+
+    struct CacheEntry
+    {
+        string nodeid;
+        Clock::time_point expire;
+    };
+    struct NodeEntry
+    {
+        bool alive;
+        Clock::time_point checkTime;
+    };
+
+    Redis &_redis;
+    UserModel _userModel;
+    string _nodeId;
+
+    // 用户id -> 所在节点，只缓存其他服务器上的用户和离线用户，本服务器上的用户以在线用户表为准
+    unordered_map<int, CacheEntry> _cache;
+    // 节点id -> 是否存活
+    unordered_map<string, NodeEntry> _nodes;
+
+    // 正在从redis查询的用户
+    struct Loading
+    {
+        // 收到该用户的失效广播时加1，查询期间发生了变化则丢弃查询的结果，防止旧的节点覆盖新的上线、下线
+        unsigned long generation;
+        // 同时在查询该用户的线程数，都查询完之后删除
+        int loaders;
+    };
+    // 只记录正在查询的用户，和GroupCache一样按key记录版本号，一个用户的变化不影响其他用户的查询
+    unordered_map<int, Loading> _loading;
+    mutex _cacheMutex;
+
+    // 用户id -> 等待写入mysql的state
+    unordered_map<int, string> _pendingState;
+    mutex _stateMutex;
+    condition_variable _stateCv;
+    bool _stop;
+    thread _thread;
+};
+
+#endif
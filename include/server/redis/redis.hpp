@@ -4,6 +4,12 @@
 #include <hiredis/hiredis.h>
 #include <thread>
 #include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <utility>
 using namespace std;
 
 /*
@@ -19,20 +25,72 @@ public:
     // 连接redis服务器 
     bool connect();
 
-    // 向redis指定的通道channel发布消息
-    bool publish(int channel, string message);
+    // 向redis指定的通道channel发布消息，例如服务器的节点通道、缓存失效的广播通道
+    // 只是把消息放入发布队列，由独立的发布线程批量发送，不阻塞调用的工作线程
+    // 队列已满返回false
+    bool publish(const string &channel, const string &message);
 
-    // 向redis指定的通道subscribe订阅消息
-    bool subscribe(int channel);
+    // 订阅通道，该通道上的消息在订阅线程中交给这里注册的fn处理
+    bool subscribe(const string &channel, function<void(string)> fn);
 
-    // 向redis指定的通道unsubscribe取消订阅消息
-    bool unsubscribe(int channel);
+    // 设置哈希表key中字段field的值
+    bool hset(const string &key, const string &field, const string &value);
+
+    // 只有哈希表key中字段field的值等于value时才删除该字段，判断和删除在redis server上原子执行
+    bool hdel_if_equal(const string &key, const string &field, const string &value);
+
+    // 删除哈希表key中所有值等于value的字段，用HSCAN分批扫描，每批的判断和删除在redis server上原子执行
+    // 返回删除的字段数，出错返回-1
+    long long hdel_by_value(const string &key, const string &value);
+
+    // 获取哈希表key中字段field的值，不存在或者出错返回空串
+    string hget(const string &key, const string &field);
+
+    // 批量获取哈希表key中多个字段的值，和fields一一对应，不存在的字段是空串
+    vector<string> hmget(const string &key, const vector<string> &fields);
+
+    // 设置key的值，并在seconds秒后过期
+    bool setex(const string &key, int seconds, const string &value);
+
+    // 删除key
+    bool del(const string &key);
+
+    // 判断key是否存在，出错也返回false
+    bool exists(const string &key);
+
+    // 把key的值加上increment，返回加之后的值，出错返回0
+    long long incrby(const string &key, long long increment);
+
+    // 批量获取多个key的值，和keys一一对应，不存在的key是空串
+    vector<string> mget(const vector<string> &keys);
+
+    // 按分数从小到大获取有序集合key中分数在[min, max]之间的成员，最多count个
+    // min、max的写法和redis一致，例如"(100"表示大于100，"+inf"表示没有上限
+    vector<string> zrangebyscore(const string &key, const string &min, const string &max, int count);
+
+    // 和zrangebyscore一样，同时返回每个成员的分数
+    vector<pair<string, long long>> zrangebyscore_withscores(const string &key, const string &min,
+                                                             const string &max, int count);
+
+    // 执行返回整数数组的lua脚本，脚本用到的key放在keys中(KEYS)，其余参数放在args中(ARGV)，出错返回空数组
+    // 脚本第一次执行时SCRIPT LOAD，之后用EVALSHA只发送sha1，redis server的脚本缓存被清空时自动重新加载
+    vector<long long> eval_integers(const string &script, const vector<string> &keys, const vector<string> &args);
 
     // 在独立线程中接收订阅通道中的消息
     void observer_channel_message();
 
-    // 初始化向业务层上报通道消息的回调对象
-    void init_notify_handler(function<void(int, string)> fn);
+    // 初始化发布失败的回调对象，在发布线程中调用，参数是通道名和消息
+    void init_publish_error_handler(function<void(string, string)> fn);
+
+    // 发布队列中等待发送的消息数
+    size_t publish_queue_size();
+
+    // 在独立线程中批量发送发布队列中的消息
+    void publish_channel_message();
+
+    // 让发布线程把队列中剩下的消息发完再退出，发送失败的消息仍然交给发布失败的回调，可以重复调用
+    // 回调中用到的业务层对象要在调用之后才能停止；之后再发布直接返回false
+    void stop_publish();
 
 private:
     // 两个客户端，创建两个上下文(一个上下文就是一个连接环境)，因为一个上下文subscribe的话，当前上下文会被阻塞，等待消息
@@ -44,9 +102,73 @@ private:
     // hiredis同步上下文对象，负责subscribe订阅消息
     redisContext *_subcribe_context;
 
-    // 回调操作，收到订阅的消息，给service层上报 - 即拿到的业务层的事件回调
-    // int - 通道号 string - 发生的数据是什么
-    function<void(int, string)> _notify_message_handler;
+    // hiredis同步上下文对象的连接池，负责hset、hget、收件箱脚本等需要等待结果的普通命令
+    // 一个同步连接同一时间只能执行一条命令，所有工作线程共用一个连接时，聊天路径上的redis命令全部串行
+    // 每条命令从池中借出一个连接，执行完归还，不同线程的命令在不同的连接上同时进行
+    vector<redisContext *> _command_contexts;
+    // 空闲的连接
+    vector<redisContext *> _idle_contexts;
+    // 保证_idle_contexts的线程安全
+    mutex _command_mutex;
+    // 有连接归还时，通知等待的线程
+    condition_variable _command_cv;
+    // 借出一个连接，没有空闲连接时等待，还没有连接redis server时返回nullptr
+    redisContext *acquire_command_context();
+    // 归还借出的连接，连接出错时先重新连接
+    void release_command_context(redisContext *context);
+    // 重新建立出错的普通命令连接，返回新的连接，失败时返回原来的连接，下次归还时再试
+    redisContext *reconnect_command_context(redisContext *context);
+
+    // 在作用域内借出一个普通命令连接，离开作用域时归还
+    class CommandConnection
+    {
+    public:
+        explicit CommandConnection(Redis &redis) : _redis(redis), _context(redis.acquire_command_context()) {}
+        ~CommandConnection() { _redis.release_command_context(_context); }
+        redisContext *context() const { return _context; }
+
+    private:
+        Redis &_redis;
+        redisContext *_context;
+    };
+
+    // 已经加载到redis server的lua脚本 -> 脚本的sha1
+    unordered_map<string, string> _script_sha;
+    // 保证_script_sha的线程安全
+    mutex _script_mutex;
+    // 在连接context上加载lua脚本并记录sha1，出错返回空串
+    string load_script(redisContext *context, const string &script);
+
+    // 通道 -> 该通道消息的回调
+    unordered_map<string, function<void(string)>> _channel_handlers;
+    // 保证_channel_handlers的线程安全，订阅线程会并发读取
+    mutex _handler_mutex;
+
+    // 发布队列中的一条消息
+    struct PublishItem
+    {
+        string channel;
+        string message;
+    };
+    // 把消息放入发布队列
+    bool push_publish_item(string channel, const string &message);
+    // 发布失败，上报给业务层
+    void notify_publish_error(const PublishItem &item);
+    // 重新建立发布上下文的连接
+    bool reconnect_publish_context();
+
+    // 发布队列，多个工作线程放入，发布线程一次性全部取走
+    vector<PublishItem> _publish_queue;
+    // 保证_publish_queue的线程安全
+    mutex _publish_mutex;
+    // 有新消息放入队列时，通知发布线程
+    condition_variable _publish_cv;
+    // 通知发布线程退出
+    bool _publish_stop;
+    // 发布线程
+    thread _publish_thread;
+    // 发布失败的回调
+    function<void(string, string)> _publish_error_handler;
 };
 
 #endif
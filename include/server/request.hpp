@@ -0,0 +1,140 @@
+// 服务层 - 客户端请求的结构体
+#ifndef REQUEST_H
+#define REQUEST_H
+
+#include <string>
+
+#include "json.hpp"
+using namespace std;
+using json = nlohmann::json;
+
+// 客户端发来的每种消息对应一个请求结构体，分发时从json中取出业务需要的字段，业务方法不再直接读json
+// 字段缺失或者类型不对时抛出json::exception，由ChatService::dispatch记录错误日志后丢弃这条消息
+
+// 要转发的聊天消息，去掉客户端自己填写的seq字段
+// 序号由服务器分配，写在消息的最前面；客户端填写的seq留在消息中就成了重复的字段，json解析时后出现的生效，
+// 接收者拿到的是发送者随意填写的序号，真正的消息会被接收者的去重当作已经收到过的丢掉
+inline string chatBody(const json &js)
+{
+    if (!js.contains("seq"))
+    {
+        return js.dump();
+    }
+    json copy(js);
+    copy.erase("seq");
+    return copy.dump();
+}
+
+// 登录
+struct LoginRequest
+{
+    int id;
+    string password;
+    // 登录响应中的好友、群组是否直接用json对象，老客户端不带这个字段，仍然是json字符串
+    bool structured;
+
+    explicit LoginRequest(const json &js)
+        : id(js.at("id").get<int>()), password(js.at("password").get<string>()),
+          structured(js.value("structured", false)) {}
+};
+
+// 注销
+struct LoginoutRequest
+{
+    int id;
+
+    explicit LoginoutRequest(const json &js)
+        : id(js.at("id").get<int>()) {}
+};
+
+// 注册
+struct RegRequest
+{
+    string name;
+    string password;
+
+    explicit RegRequest(const json &js)
+        : name(js.at("name").get<string>()), password(js.at("password").get<string>()) {}
+};
+
+// 一对一聊天，body是要转发的消息
+struct OneChatRequest
+{
+    int toid;
+    string body;
+
+    explicit OneChatRequest(const json &js)
+        : toid(js.at("toid").get<int>()), body(chatBody(js)) {}
+};
+
+// 添加好友
+struct AddFriendRequest
+{
+    int id;
+    int friendid;
+
+    explicit AddFriendRequest(const json &js)
+        : id(js.at("id").get<int>()), friendid(js.at("friendid").get<int>()) {}
+};
+
+// 创建群组
+struct CreateGroupRequest
+{
+    int id;
+    string groupname;
+    string groupdesc;
+
+    explicit CreateGroupRequest(const json &js)
+        : id(js.at("id").get<int>()), groupname(js.at("groupname").get<string>()),
+          groupdesc(js.at("groupdesc").get<string>()) {}
+};
+
+// 加入群组
+struct AddGroupRequest
+{
+    int id;
+    int groupid;
+
+    explicit AddGroupRequest(const json &js)
+        : id(js.at("id").get<int>()), groupid(js.at("groupid").get<int>()) {}
+};
+
+// 群聊，body是要转发的消息
+struct GroupChatRequest
+{
+    int id;
+    int groupid;
+    string body;
+
+    explicit GroupChatRequest(const json &js)
+        : id(js.at("id").get<int>()), groupid(js.at("groupid").get<int>()), body(chatBody(js)) {}
+};
+
+// 确认收到一页离线消息，cursor是这一页最后一条消息的编号
+struct OfflineAckRequest
+{
+    long long cursor;
+
+    explicit OfflineAckRequest(const json &js)
+        : cursor(js.at("cursor").get<long long>()) {}
+};
+
+// 增量同步，seq是客户端已经连续收到的最大序号
+struct SyncRequest
+{
+    long long seq;
+
+    explicit SyncRequest(const json &js)
+        : seq(js.at("seq").get<long long>()) {}
+};
+
+// 协商聊天消息的格式
+struct ProtocolRequest
+{
+    bool binary;
+
+    explicit ProtocolRequest(const json &js)
+        : binary(js.value("binary", false)) {}
+};
+
+#endif
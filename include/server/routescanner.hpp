@@ -0,0 +1,68 @@
+// 服务器 - 不构造json对象读取消息的路由字段
+#ifndef ROUTESCANNER_H
+#define ROUTESCANNER_H
+
+#include <string>
+using namespace std;
+
+// 消息的路由字段，只取顶层的整数字段
+struct RouteFields
+{
+    // present中每个字段对应的位
+    enum Field
+    {
+        MSGID = 1,
+        ID = 2,
+        TOID = 4,
+        GROUPID = 8,
+        SEQ = 16,
+    };
+
+    // 消息中出现了哪些字段，值不是int范围内的整数时当作没有出现
+    unsigned present;
+    int msgid;
+    int id;
+    int toid;
+    int groupid;
+
+    RouteFields() : present(0), msgid(0), id(0), toid(0), groupid(0) {}
+
+    // fields中的字段是否都出现了
+    bool has(unsigned fields) const { return (present & fields) == fields; }
+};
+
+// 路由字段扫描器
+// 一对一聊天、群聊这类纯转发消息，服务器只需要msgid和toid(或者id和groupid)就能决定发给谁，消息原文可以原样转发
+// 扫描器一遍扫过消息原文：校验整条消息是合法的json对象(语法、转义、UTF-8都和json::parse一样严格)，
+// 同时读出顶层的路由字段，不构造json对象，不分配内存
+//
+// 校验是必须的：原样转发的消息接收方要能解析，不能把格式错误的消息转发出去
+// 消息的大部分字节在字符串中，字符串用SIMD(SSE2/AVX2，运行时按CPU选择)整块跳过普通字符，
+// 只在引号、反斜杠、控制字符和非ASCII字节上逐字节处理
+//
+// 扫描器拿不准的情况一律返回false，交给json::parse按原来的方式处理，包括：
+// 路由字段重复出现、字段名中带转义字符、嵌套超过MAX_DEPTH层、以BOM开头等
+class RouteScanner
+{
+public:
+    // 嵌套的最大层数
+    static const int MAX_DEPTH = 64;
+
+    // 跳过字符串时使用的指令集，按支持程度从低到高
+    enum Isa
+    {
+        SCALAR,
+        SSE2,
+        AVX2,
+    };
+
+    // 校验text是合法的json对象，并读取顶层的路由字段，不能确定时返回false
+    static bool scan(const string &text, RouteFields &fields);
+
+    // 当前使用的指令集，启动时选择CPU支持的最高的一个
+    static Isa isa();
+    // 指定使用的指令集，CPU不支持时返回false，只用于性能测试对比，不能和scan并发调用
+    static bool setIsa(Isa isa);
+};
+
+#endif
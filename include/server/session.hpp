@@ -0,0 +1,43 @@
+// 服务器 - 连接上的会话信息
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <muduo/net/TcpConnection.h>
+#include <boost/any.hpp>
+
+#include "workerpool.hpp"
+using namespace muduo::net;
+
+// 连接上的会话信息，连接建立时由ChatServer创建，保存在TcpConnection的context中
+// 这条连接的业务都在它的串行队列中按顺序执行，userid等字段只在串行队列中修改；
+// 协程业务(例如登录)挂起之后会在I/O线程上继续执行，这期间串行队列是暂停的，同样不会和这条连接的其他业务同时修改；
+// 其他线程在在线用户表中找到连接之后才读取binary，修改都发生在放入在线用户表之前，在线用户表的锁保证其他线程能读到修改后的值
+struct Session
+{
+    // 这条连接的业务串行队列，创建后不再修改，I/O线程通过它提交收到的消息
+    WorkerPool::SerialQueuePtr queue;
+    // 在这条连接上登录的用户id，-1表示没有登录或者已经注销
+    int userid;
+    // 这条连接是否协商了二进制协议
+    bool binary;
+    // 第一次登录之后协议格式就固定下来，不能再协商
+    // 注销之后连接可能还在其他线程的转发过程中，这时修改binary会和读取冲突
+    bool protocolFixed;
+
+    explicit Session(const WorkerPool::SerialQueuePtr &q = WorkerPool::SerialQueuePtr())
+        : queue(q), userid(-1), binary(false), protocolFixed(false) {}
+};
+
+// 取出连接上的会话信息用来修改，只能在这条连接的串行队列中调用
+inline Session *getSession(const TcpConnectionPtr &conn)
+{
+    return boost::any_cast<Session>(conn->getMutableContext());
+}
+
+// 只读取连接上的会话信息，没有返回nullptr
+inline const Session *peekSession(const TcpConnectionPtr &conn)
+{
+    return boost::any_cast<Session>(&conn->getContext());
+}
+
+#endif
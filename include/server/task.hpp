@@ -0,0 +1,167 @@
+// 服务器 - 协程任务类型
+#ifndef TASK_H
+#define TASK_H
+
+#include <muduo/base/Logging.h>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <utility>
+using namespace std;
+
+// 协程的返回类型，Task<T>表示一个最终得到T的异步操作
+// 创建时不执行，被co_await时才开始执行，执行完之后直接回到co_await它的协程继续执行
+// 协程中抛出的异常保存下来，在co_await的地方重新抛出
+//
+// 业务方法写成协程时，参数要按值传递(例如TcpConnectionPtr而不是const TcpConnectionPtr &)：
+// 协程第一次挂起时调用者就返回了，引用指向的对象可能已经不在了，按值传递的参数保存在协程帧中
+template <typename T = void>
+class Task;
+
+// promise中和结果类型无关的部分
+struct TaskPromiseBase
+{
+    // co_await这个任务的协程，执行完之后回到它
+    coroutine_handle<> continuation;
+    exception_ptr error;
+
+    // 协程执行完时挂起，由co_await它的协程负责销毁协程帧
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept { return false; }
+        template <typename Promise>
+        coroutine_handle<> await_suspend(coroutine_handle<Promise> handle) noexcept
+        {
+            coroutine_handle<> next = handle.promise().continuation;
+            return next ? next : noop_coroutine();
+        }
+        void await_resume() noexcept {}
+    };
+
+    suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { error = current_exception(); }
+
+    void rethrowIfError()
+    {
+        if (error)
+        {
+            rethrow_exception(error);
+        }
+    }
+};
+
+// 保存协程的结果
+template <typename T>
+struct TaskPromise : TaskPromiseBase
+{
+    optional<T> value;
+
+    template <typename U>
+    void return_value(U &&v)
+    {
+        value.emplace(std::forward<U>(v));
+    }
+
+    T result()
+    {
+        rethrowIfError();
+        return std::move(*value);
+    }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase
+{
+    void return_void() {}
+    void result() { rethrowIfError(); }
+};
+
+template <typename T>
+class Task
+{
+public:
+    struct promise_type : TaskPromise<T>
+    {
+        Task get_return_object() { return Task(coroutine_handle<promise_type>::from_promise(*this)); }
+    };
+
+    Task(Task &&other) noexcept : _handle(std::exchange(other._handle, nullptr)) {}
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task()
+    {
+        if (_handle)
+        {
+            _handle.destroy();
+        }
+    }
+
+    // co_await一个任务：记下自己，开始执行这个任务，任务执行完回到自己，取出结果
+    auto operator co_await() noexcept
+    {
+        struct Awaiter
+        {
+            coroutine_handle<promise_type> handle;
+
+            bool await_ready() noexcept { return false; }
+            coroutine_handle<> await_suspend(coroutine_handle<> caller) noexcept
+            {
+                handle.promise().continuation = caller;
+                return handle;
+            }
+            T await_resume() { return handle.promise().result(); }
+        };
+        return Awaiter{_handle};
+    }
+
+private:
+    explicit Task(coroutine_handle<promise_type> handle) : _handle(handle) {}
+
+    coroutine_handle<promise_type> _handle;
+};
+
+// 在后台执行一个任务，没有人co_await它，执行完自己销毁
+// 只在spawn中使用
+struct DetachedTask
+{
+    struct promise_type
+    {
+        DetachedTask get_return_object() { return {}; }
+        suspend_never initial_suspend() noexcept { return {}; }
+        suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        // runDetached已经捕获了所有异常
+        void unhandled_exception() { terminate(); }
+    };
+};
+
+inline DetachedTask runDetached(Task<void> task, function<void()> done)
+{
+    try
+    {
+        co_await task;
+    }
+    catch (const exception &e)
+    {
+        LOG_ERROR << "coroutine task failed: " << e.what();
+    }
+    catch (...)
+    {
+        LOG_ERROR << "coroutine task failed with unknown exception";
+    }
+    if (done)
+    {
+        done();
+    }
+}
+
+// 开始执行一个任务，不等待它完成
+// 在当前线程中执行到第一次挂起就返回，任务执行完(包括抛出异常)之后在最后执行它的线程中调用done
+inline void spawn(Task<void> task, function<void()> done = function<void()>())
+{
+    runDetached(std::move(task), std::move(done));
+}
+
+#endif
@@ -0,0 +1,92 @@
+// 服务器 - 业务线程池
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// 业务线程池
+// 登录要查好几次mysql，一对一聊天可能要写离线消息，这些业务原来都在收到消息的I/O线程上执行，
+// 一次慢的mysql调用会卡住这个I/O线程上的所有连接。现在I/O线程只负责收发和切分消息，业务交给这里的线程执行
+//
+// 同一个连接的消息必须按顺序处理(例如先登录再聊天)，所以每个连接有一个串行队列：
+// 同一个串行队列中的任务按提交顺序一个接一个执行，同一时刻最多只有一个线程在执行它；不同串行队列的任务并行执行
+// 一个连接上的慢任务只会让这个连接后面的消息等待，不会占住其他连接
+//
+// 业务方法是协程时，任务在协程第一次挂起时就返回了，但这个连接后面的消息要等协程执行完才能处理：
+// 任务中调用suspendCurrent暂停当前串行队列，协程执行完之后调用返回的函数恢复，暂停期间不占用线程
+class WorkerPool
+{
+public:
+    using Task = function<void()>;
+
+    // 串行队列，由createQueue创建，通过submit提交任务
+    class SerialQueue
+    {
+    private:
+        friend class WorkerPool;
+        mutex _mutex;
+        deque<Task> _tasks;
+        // 已经放入就绪队列或者正在被某个线程执行，暂停期间也保持为true，新提交的任务不会被执行
+        bool _scheduled = false;
+        // 被suspendCurrent暂停，还没有恢复
+        bool _suspended = false;
+        // 执行它的线程已经发现暂停，放下了这个队列，恢复时要重新放入就绪队列
+        bool _parked = false;
+    };
+    using SerialQueuePtr = shared_ptr<SerialQueue>;
+
+    // threadNum是线程数，maxQueueTasks是每个串行队列中等待执行的任务上限
+    explicit WorkerPool(int threadNum, size_t maxQueueTasks = 10000);
+    ~WorkerPool();
+
+    // 启动工作线程
+    void start();
+    // 停止工作线程，还没有执行的任务不再执行
+    void stop();
+
+    // 创建一个串行队列，一般每个连接一个
+    SerialQueuePtr createQueue();
+
+    // 把任务提交到串行队列，可以在任意线程中调用
+    // 队列中等待的任务已经达到上限时不提交，返回false，说明对方发送的速度远远超过了处理的速度
+    // force为true时不检查上限，用于连接断开后的清理这类必须执行的任务
+    bool submit(const SerialQueuePtr &queue, Task task, bool force = false);
+    // 提交一个不需要和其他任务保持顺序的任务，不检查上限
+    bool submit(Task task);
+
+    // 暂停当前线程正在执行的串行队列：当前任务返回之后，队列中后面的任务等到调用返回的函数之后才执行
+    // 只能在任务中调用，每个任务最多调用一次；返回的函数可以在任意线程中调用，必须调用一次
+    // 不在工作线程中调用时返回空函数
+    static function<void()> suspendCurrent();
+
+    // 所有串行队列中提交了、还没有执行完的任务数
+    long pendingTasks() const;
+
+private:
+    // 工作线程
+    void workerTask();
+    // 恢复被suspendCurrent暂停的串行队列
+    void resume(const SerialQueuePtr &queue);
+
+    const int _threadNum;
+    const size_t _maxQueueTasks;
+    vector<thread> _threads;
+
+    // 有任务等待执行的串行队列，一个串行队列同时最多在这里出现一次
+    deque<SerialQueuePtr> _ready;
+    mutex _mutex;
+    condition_variable _cv;
+    bool _stop;
+
+    atomic<long> _pendingTasks;
+};
+
+#endif
@@ -9,6 +9,7 @@
 #include <chrono>
 #include <ctime>
 #include <unordered_map>
+#include <set>
 #include <functional>
 using namespace std;
 using json = nlohmann::json;
@@ -19,11 +20,15 @@ using json = nlohmann::json;
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <semaphore.h>
+#include <cerrno>
 #include <atomic>
+#include <mutex>
 
 #include "group.hpp"
 #include "user.hpp"
 #include "public.hpp"
+#include "binaryproto.hpp"
+#include "seqfilter.hpp"
 
 // 记录当前系统已经登录的用户信息
 User g_currentUser;
@@ -35,10 +40,19 @@ vector<Group> g_currentUserGroupList;
 // 控制主菜单页面程序
 bool isMainMenuRunning = false;
 
+// 按消息序号去重，游标是已经连续收到的最大序号，增量同步时从这里开始
+SeqFilter g_seqFilter;
+
 // 用于读写线程之间的通信 -- 暂时没讲
 sem_t rwsem;
 // 记录登录状态 -- 暂时没讲
 atomic_bool g_isLoginSuccess{false};
+// 服务器是否同意这条连接上的聊天消息使用二进制格式
+atomic_bool g_useBinary{false};
+// 已经发送协商请求、还在等待服务器的响应
+atomic_bool g_protocolPending{false};
+// 等待协商响应的最长时间
+const int PROTOCOL_TIMEOUT_SECONDS = 3;
 
 
 // 接收线程
@@ -49,15 +63,23 @@ string getCurrentTime();
 void mainMenu(int);
 // 显示当前登录成功用户的基本信息
 void showCurrentUserData();
+// 显示一条聊天消息，个人聊天信息或者群组消息
+void showChatMessage(json &js);
+// 按消息序号去重，重复的消息返回false
+bool acceptMessage(json &js);
+// 按"4字节包头+消息体"的帧格式发送一条消息，失败返回-1
+int sendMsg(int clientfd, const string &msg);
+// 按帧格式接收一条完整的消息，连接断开或数据非法返回false
+bool recvMsg(int clientfd, string &msg);
 
 // 聊天客户端程序实现，main线程用作发送线程，接收用户输入；子线程用作接收线程，接收服务器转发过来的业务数据
 // argc --- 命令的个数， argv --- 接收命令行传递的ip和port
 int main(int argc, char **argv)
 {
-    // 判断命令的个数
+    // 判断命令的个数，第三个参数binary表示聊天消息使用二进制格式
     if (argc < 3)
     {
-        cerr << "command invalid! example: ./ChatClient 127.0.0.1 6000" << endl;
+        cerr << "command invalid! example: ./ChatClient 127.0.0.1 6000 [binary]" << endl;
         exit(-1);
     }
 
@@ -99,6 +121,41 @@ int main(int argc, char **argv)
     readTask.detach();                               // pthread_detach
     // 设置一个分离线程，线程运行完自动回收线程所占用的内核的PCB资源
 
+    // 登录之前和服务器协商聊天消息的格式，服务器不同意时仍然使用json
+    if (argc > 3 && string(argv[3]) == "binary")
+    {
+        json js;
+        js["msgid"] = PROTOCOL_MSG;
+        js["binary"] = true;
+        g_protocolPending = true;
+        if (-1 == sendMsg(clientfd, js.dump()))
+        {
+            g_protocolPending = false;
+            cerr << "send protocol msg error" << endl;
+        }
+        else
+        {
+            // 等待子线程处理完协商的响应消息，老版本的服务器没有协商的业务，不会回复，超时后使用json
+            timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += PROTOCOL_TIMEOUT_SECONDS;
+            int ret;
+            while (-1 == (ret = sem_timedwait(&rwsem, &deadline)) && errno == EINTR)
+            {
+            }
+            if (g_protocolPending.exchange(false))
+            {
+                cerr << "server does not answer the protocol negotiation, use json" << endl;
+            }
+            else if (-1 == ret)
+            {
+                // 超时的同时子线程收到了响应，它已经通知了信号量，这里取走，不影响之后的登录、注册
+                sem_wait(&rwsem);
+            }
+        }
+        cout << "chat message protocol: " << (g_useBinary ? "binary" : "json") << endl;
+    }
+
     // main线程用于接收用户输入，负责发送数据
     for (;;)
     {
@@ -131,12 +188,14 @@ int main(int argc, char **argv)
             js["msgid"] = LOGIN_MSG;
             js["id"] = id;
             js["password"] = pwd;
+            // 登录响应中的好友、群组直接用json对象，不再是需要二次解析的json字符串
+            js["structured"] = true;
             string request = js.dump();
 
             g_isLoginSuccess = false;
 
             // 将序列化的js发送出去，发送到服务器，等待处理
-            int len = send(clientfd, request.c_str(), strlen(request.c_str()) + 1, 0);
+            int len = sendMsg(clientfd, request);
             if (len == -1)
             {
                 cerr << "send login msg error:" << request << endl;
@@ -169,7 +228,7 @@ int main(int argc, char **argv)
             string request = js.dump();
 
             // 将序列化的js发送出去，发送到服务器，等待处理
-            int len = send(clientfd, request.c_str(), strlen(request.c_str()) + 1, 0);
+            int len = sendMsg(clientfd, request);
             if (len == -1)
             {
                 cerr << "send reg msg error:" << request << endl;
@@ -205,6 +264,13 @@ void doRegResponse(json &responsejs)
     }
 }
 
+// 登录响应中好友、群组、群成员数组的一个元素
+// 新服务器直接是json对象，老服务器是json对象序列化之后的字符串，需要再解析一次
+static json loginElement(const json &element)
+{
+    return element.is_string() ? json::parse(element.get<string>()) : element;
+}
+
 // 处理登录的响应逻辑
 void doLoginResponse(json &responsejs)
 {
@@ -218,6 +284,8 @@ void doLoginResponse(json &responsejs)
         // 记录当前用户的id和name
         g_currentUser.setId(responsejs["id"].get<int>());
         g_currentUser.setName(responsejs["name"]);
+        // 登录时的最大消息序号，之后的消息从这里开始连续递增
+        g_seqFilter.reset(responsejs.value("seq", 0LL));
 
         // 记录当前用户的好友列表信息
         if (responsejs.contains("friends"))
@@ -225,10 +293,9 @@ void doLoginResponse(json &responsejs)
             // 初始化，防止登录成功后异常退出，全局变量未清空
             g_currentUserFriendList.clear();
 
-            vector<string> vec = responsejs["friends"];
-            for (string &str : vec)
+            for (const json &element : responsejs["friends"])
             {
-                json js = json::parse(str);
+                json js = loginElement(element);
                 User user;
                 user.setId(js["id"].get<int>());
                 user.setName(js["name"]);
@@ -243,20 +310,18 @@ void doLoginResponse(json &responsejs)
             // 初始化，防止登录成功后异常退出，全局变量未清空
             g_currentUserGroupList.clear();
 
-            vector<string> vec1 = responsejs["groups"];
-            for (string &groupstr : vec1)
+            for (const json &groupElement : responsejs["groups"])
             {
-                json grpjs = json::parse(groupstr);
+                json grpjs = loginElement(groupElement);
                 Group group;
                 group.setId(grpjs["id"].get<int>());
                 group.setName(grpjs["groupname"]);
                 group.setDesc(grpjs["groupdesc"]);
 
-                vector<string> vec2 = grpjs["users"];
-                for (string &userstr : vec2)
+                for (const json &userElement : grpjs["users"])
                 {
                     GroupUser user;
-                    json js = json::parse(userstr);
+                    json js = loginElement(userElement);
                     user.setId(js["id"].get<int>());
                     user.setName(js["name"]);
                     user.setState(js["state"]);
@@ -271,28 +336,58 @@ void doLoginResponse(json &responsejs)
         // 显示登录用户的基本信息
         showCurrentUserData();
 
-        // 显示当前用户的离线消息  个人聊天信息或者群组消息
-        if (responsejs.contains("offlinemsg"))
+        g_isLoginSuccess = true;
+    }
+}
+
+// 处理服务器推送的一页离线消息，显示之后回复确认，服务器收到确认才删除这些消息并推送下一页
+void doOfflineMsg(int clientfd, json &responsejs)
+{
+    // 显示当前用户的离线消息  个人聊天信息或者群组消息
+    vector<string> vec = responsejs["offlinemsg"];
+    for (string &str : vec)
+    {
+        json js = json::parse(str);
+        // 离线消息的序号在登录响应的seq之前，不能按游标过滤
+        if (g_seqFilter.acceptOffline(js.value("seq", 0LL)))
         {
-            vector<string> vec = responsejs["offlinemsg"];
-            for (string &str : vec)
-            {
-                json js = json::parse(str);
-                // time + [id] + name + " said: " + xxx
-                if (ONE_CHAT_MSG == js["msgid"].get<int>())
-                {
-                    cout << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
-                            << " said: " << js["msg"].get<string>() << endl;
-                }
-                else
-                {
-                    cout << "群消息[" << js["groupid"] << "]:" << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
-                            << " said: " << js["msg"].get<string>() << endl;
-                }
-            }
+            showChatMessage(js);
         }
+    }
 
-        g_isLoginSuccess = true;
+    json js;
+    js["msgid"] = OFFLINE_MSG_ACK;
+    js["cursor"] = responsejs["cursor"];
+    string buffer = js.dump();
+    if (-1 == sendMsg(clientfd, buffer))
+    {
+        cerr << "send offline msg ack error -> " << buffer << endl;
+    }
+}
+
+// 处理增量同步的响应，还有更多消息时继续同步
+void doSyncResponse(int clientfd, json &responsejs)
+{
+    vector<string> vec = responsejs["msgs"];
+    for (string &str : vec)
+    {
+        json js = json::parse(str);
+        if (acceptMessage(js))
+        {
+            showChatMessage(js);
+        }
+    }
+
+    if (responsejs["more"].get<bool>())
+    {
+        json js;
+        js["msgid"] = SYNC_MSG;
+        js["seq"] = responsejs["seq"];
+        string buffer = js.dump();
+        if (-1 == sendMsg(clientfd, buffer))
+        {
+            cerr << "send sync msg error -> " << buffer << endl;
+        }
     }
 }
 
@@ -302,29 +397,47 @@ void readTaskHandler(int clientfd)
     for (;;)
     {
         // buffer只做接收数据和显示数据
-        char buffer[1024] = {0};
-        int len = recv(clientfd, buffer, 1024, 0);  // 阻塞了
-        if (-1 == len || 0 == len)
+        string buffer;
+        if (!recvMsg(clientfd, buffer))  // 阻塞了
         {
             close(clientfd);
             exit(-1);
         }
 
-        // 接收ChatServer转发的数据，反序列化生成json数据对象
-        json js = json::parse(buffer);
+        json js;
+        if (BinaryProto::isBinary(buffer))
+        {
+            // 二进制格式的聊天消息转换成和json协议一样的字段，后面统一处理
+            if (!BinaryProto::chatToJson(buffer, js))
+            {
+                cerr << "invalid binary message" << endl;
+                continue;
+            }
+        }
+        else
+        {
+            // 接收ChatServer转发的数据，反序列化生成json数据对象
+            js = json::parse(buffer);
+        }
         int msgtype = js["msgid"].get<int>();
-        if (ONE_CHAT_MSG == msgtype) // 表示该消息是一对一聊天消息
+        if (ONE_CHAT_MSG == msgtype || GROUP_CHAT_MSG == msgtype) // 表示该消息是一对一聊天消息或者群聊聊天消息
+        {
+            if (acceptMessage(js))
+            {
+                showChatMessage(js);
+            }
+            continue;
+        }
+
+        if (SYNC_MSG_ACK == msgtype) // 表示该消息是增量同步的响应消息
         {
-            // 打印具体信息，什么时间，那个用户说了什么。
-            cout << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
-                 << " said: " << js["msg"].get<string>() << endl;
+            doSyncResponse(clientfd, js);
             continue;
         }
 
-        if (GROUP_CHAT_MSG == msgtype) // 表示该消息是群聊聊天消息
+        if (OFFLINE_MSG == msgtype) // 表示该消息是服务器推送的离线消息
         {
-            cout << "群消息[" << js["groupid"] << "]:" << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
-                 << " said: " << js["msg"].get<string>() << endl;
+            doOfflineMsg(clientfd, js);
             continue;
         }
 
@@ -341,6 +454,17 @@ void readTaskHandler(int clientfd)
             sem_post(&rwsem);    // 通知主线程，注册结果处理完成
             continue;
         }
+
+        if (PROTOCOL_MSG_ACK == msgtype) // 表示该消息是协商协议的响应消息
+        {
+            // 主线程已经等待超时、改用json时，忽略迟到的响应，也不能再通知信号量
+            if (g_protocolPending.exchange(false))
+            {
+                g_useBinary = js["binary"].get<bool>();
+                sem_post(&rwsem);    // 通知主线程，协商完成
+            }
+            continue;
+        }
     }
 }
 
@@ -373,6 +497,30 @@ void showCurrentUserData()
     cout << "======================================================" << endl;
 }
 
+// 显示一条聊天消息
+void showChatMessage(json &js)
+{
+    // time + [id] + name + " said: " + xxx
+    if (ONE_CHAT_MSG == js["msgid"].get<int>())
+    {
+        // 打印具体信息，什么时间，那个用户说了什么。
+        cout << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
+             << " said: " << js["msg"].get<string>() << endl;
+    }
+    else
+    {
+        cout << "群消息[" << js["groupid"] << "]:" << js["time"].get<string>() << " [" << js["id"] << "]" << js["name"].get<string>()
+             << " said: " << js["msg"].get<string>() << endl;
+    }
+}
+
+// 按消息序号去重
+// 同一条消息可能从跨服务器转发、增量同步等多个途径到达，只显示第一次
+bool acceptMessage(json &js)
+{
+    return g_seqFilter.accept(js.value("seq", 0LL));
+}
+
 // "help" command handler
 void help(int fd = 0, string str = "");
 // "chat" command handler
@@ -387,6 +535,8 @@ void addgroup(int, string);
 void groupchat(int, string);
 // "loginout" command handler
 void loginout(int, string);
+// "sync" command handler
+void syncmsg(int, string);
 
 // 系统支持的客户端命令列表
 unordered_map<string, string> commandMap = {
@@ -396,7 +546,8 @@ unordered_map<string, string> commandMap = {
     {"creategroup", "创建群组，格式creategroup:groupname:groupdesc"},
     {"addgroup", "加入群组，格式addgroup:groupid"},
     {"groupchat", "群聊，格式groupchat:groupid:message"},
-    {"loginout", "注销，格式loginout"}};
+    {"loginout", "注销，格式loginout"},
+    {"sync", "获取断线期间没有收到的消息，格式sync"}};
 
 // 注册系统支持的客户端命令处理
 // 一个命令对应一个处理函数
@@ -407,7 +558,8 @@ unordered_map<string, function<void(int, string)>> commandHandlerMap = {
     {"creategroup", creategroup},
     {"addgroup", addgroup},
     {"groupchat", groupchat},
-    {"loginout", loginout}};
+    {"loginout", loginout},
+    {"sync", syncmsg}};
 
 // 主聊天页面程序
 void mainMenu(int clientfd)
@@ -472,7 +624,7 @@ void addfriend(int clientfd, string str)
     string buffer = js.dump();
 
     // 发送出去
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendMsg(clientfd, buffer);
     if (-1 == len)
     {
         cerr << "send addfriend msg error -> " << buffer << endl;
@@ -501,10 +653,16 @@ void chat(int clientfd, string str)
     js["toid"] = friendid;
     js["msg"] = message;
     js["time"] = getCurrentTime();
-    string buffer = js.dump();
+    // 协商了二进制协议时发送二进制格式，服务器只看固定头就能转发
+    // 字段太长无法编码成二进制时改用json，服务器两种格式都接受
+    string buffer = g_useBinary ? BinaryProto::chatFromJson(js) : string();
+    if (buffer.empty())
+    {
+        buffer = js.dump();
+    }
 
     // 发送出去
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendMsg(clientfd, buffer);
     if (-1 == len)
     {
         cerr << "send chat msg error -> " << buffer << endl;
@@ -535,7 +693,7 @@ void creategroup(int clientfd, string str)
     string buffer = js.dump();
 
     // 发送出去
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendMsg(clientfd, buffer);
     if (-1 == len)
     {
         cerr << "send creategroup msg error -> " << buffer << endl;
@@ -554,7 +712,7 @@ void addgroup(int clientfd, string str)
     string buffer = js.dump();
 
     // 发送出去
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendMsg(clientfd, buffer);
     if (-1 == len)
     {
         cerr << "send addgroup msg error -> " << buffer << endl;
@@ -583,11 +741,15 @@ void groupchat(int clientfd, string str)
     js["groupid"] = groupid;
     js["msg"] = message;
     js["time"] = getCurrentTime();
-    // 序列化
-    string buffer = js.dump();
+    // 序列化，协商了二进制协议时发送二进制格式，字段太长无法编码成二进制时改用json
+    string buffer = g_useBinary ? BinaryProto::chatFromJson(js) : string();
+    if (buffer.empty())
+    {
+        buffer = js.dump();
+    }
 
     // 发送出去
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendMsg(clientfd, buffer);
     if (-1 == len)
     {
         cerr << "send groupchat msg error -> " << buffer << endl;
@@ -601,7 +763,7 @@ void loginout(int clientfd, string)
     js["id"] = g_currentUser.getId();
     string buffer = js.dump();
 
-    int len = send(clientfd, buffer.c_str(), strlen(buffer.c_str()) + 1, 0);
+    int len = sendMsg(clientfd, buffer);
     if (-1 == len)
     {
         cerr << "send loginout msg error -> " << buffer << endl;
@@ -613,6 +775,20 @@ void loginout(int clientfd, string)
     }   
 }
 
+// "sync" command handler
+void syncmsg(int clientfd, string)
+{
+    json js;
+    js["msgid"] = SYNC_MSG;
+    js["seq"] = g_seqFilter.cursor();
+    string buffer = js.dump();
+
+    if (-1 == sendMsg(clientfd, buffer))
+    {
+        cerr << "send sync msg error -> " << buffer << endl;
+    }
+}
+
 // 获取系统时间（聊天信息需要添加时间信息）
 string getCurrentTime()
 {
@@ -623,4 +799,71 @@ string getCurrentTime()
             (int)ptm->tm_year + 1900, (int)ptm->tm_mon + 1, (int)ptm->tm_mday,
             (int)ptm->tm_hour, (int)ptm->tm_min, (int)ptm->tm_sec);
     return std::string(date);
-}
\ No newline at end of file
+}
+
+// 循环发送，直到len个字节全部发送完毕
+static bool writen(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = send(fd, data, len, 0);
+        if (n <= 0)
+        {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// 循环接收，直到收满len个字节
+static bool readn(int fd, char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = recv(fd, data, len, 0);
+        if (n <= 0)
+        {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// 按"4字节包头+消息体"的帧格式发送一条消息，失败返回-1
+int sendMsg(int clientfd, const string &msg)
+{
+    // 包头是网络字节序的消息体长度，和服务器的MessageCodec保持一致
+    uint32_t header = htonl(static_cast<uint32_t>(msg.size()));
+    string frame(reinterpret_cast<const char *>(&header), MSG_HEADER_LEN);
+    frame.append(msg);
+    // 主线程发送用户的命令，接收线程发送离线消息的确认，一帧要完整写完，不能和另一个线程的帧交错
+    static mutex sendMutex;
+    lock_guard<mutex> lock(sendMutex);
+    if (!writen(clientfd, frame.data(), frame.size()))
+    {
+        return -1;
+    }
+    return frame.size();
+}
+
+// 按帧格式接收一条完整的消息，连接断开或数据非法返回false
+bool recvMsg(int clientfd, string &msg)
+{
+    uint32_t header = 0;
+    if (!readn(clientfd, reinterpret_cast<char *>(&header), MSG_HEADER_LEN))
+    {
+        return false;
+    }
+    int32_t len = static_cast<int32_t>(ntohl(header));
+    if (len < 0 || len > MSG_MAX_LEN)
+    {
+        cerr << "invalid message length " << len << endl;
+        return false;
+    }
+    msg.resize(len);
+    return len == 0 || readn(clientfd, &msg[0], len);
+}
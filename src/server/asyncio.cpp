@@ -0,0 +1,20 @@
+#include "asyncio.hpp"
+
+AsyncIo::AsyncIo(int dbThreads, int redisThreads)
+    : _dbPool(dbThreads), _redisPool(redisThreads)
+{
+}
+
+// 启动线程
+void AsyncIo::start()
+{
+    _dbPool.start();
+    _redisPool.start();
+}
+
+// 停止线程
+void AsyncIo::stop()
+{
+    _dbPool.stop();
+    _redisPool.stop();
+}
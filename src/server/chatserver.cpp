@@ -1,6 +1,8 @@
 #include "chatserver.hpp"
 #include "json.hpp"
 #include "chatservice.hpp"
+#include "binaryproto.hpp"
+#include <muduo/base/Logging.h>
 
 #include <functional>
 #include <string>
@@ -8,25 +10,31 @@ using namespace std;
 using namespace placeholders;
 using json = nlohmann::json;
 
+// 业务线程数，业务中有大量mysql、redis的同步调用，线程数要比I/O线程多
+static const int WORKER_THREADS = 16;
+// 每个连接最多积压的消息数，超过说明客户端发送得太快，断开连接
+static const size_t MAX_PENDING_MESSAGES = 10000;
 
 /*
 网络模块代码
 使用muduo库得到了一个非常强大的基于事件驱动的I/O复用epoll+线程池的网络代码
 是完全基于reactor模型的，设置了四个线程，有一个主reactor是I/O线程，三个子reactor是工作线程
 主reactor主要负责新用户的链接
-子reactor主要负责已连接用户的读写事件的处理
+子reactor主要负责已连接用户的读写事件的处理，切分出完整的消息后交给业务线程池，不在I/O线程上执行业务
 */ 
 // 初始化聊天服务器对象
 ChatServer::ChatServer(EventLoop *loop,               // 事件循环
                        const InetAddress &listenAddr, // IP+Port --- IP地址+端口号
                        const string &nameArg)
-    : _server(loop, listenAddr, nameArg), _loop(loop)
+    : _server(loop, listenAddr, nameArg), _loop(loop),
+      _codec(std::bind(&ChatServer::onMessage, this, _1, _2, _3)),
+      _workers(WORKER_THREADS, MAX_PENDING_MESSAGES)
 {
     // 注册链接回调
     _server.setConnectionCallback(std::bind(&ChatServer::onConnection, this, _1));
 
-    // 注册消息回调
-    _server.setMessageCallback(std::bind(&ChatServer::onMessage, this, _1, _2, _3));
+    // 注册消息回调，先交给编解码器切分出完整的消息，再回调ChatServer::onMessage
+    _server.setMessageCallback(std::bind(&MessageCodec::onMessage, &_codec, _1, _2, _3));
 
     // 设置线程数量
     _server.setThreadNum(4);
@@ -35,42 +43,93 @@ ChatServer::ChatServer(EventLoop *loop,               // 事件循环
 // 启动服务
 void ChatServer::start()
 {
+    _workers.start();
     _server.start();
 }
 
+// 业务线程池中还没有执行完的任务数
+long ChatServer::pendingTasks() const
+{
+    return _workers.pendingTasks();
+}
+
 // 上报连接相关信息的回调函数，即用户的连接和断开
 void ChatServer::onConnection(const TcpConnectionPtr & conn)
 {
+    if (conn->connected())
+    {
+        // 新连接，创建会话信息和这条连接的业务串行队列
+        conn->setContext(Session(_workers.createQueue()));
+        return;
+    }
+
     // 表示客户端断开连接
-    if(!conn->connected())
+    // 当客户端异常关闭时的处理，排在这条连接还没处理完的消息后面执行，不能因为队列满了而丢弃
+    const Session *session = peekSession(conn);
+    if (session != nullptr)
     {
-        // 当客户端异常关闭时的处理
-        ChatService::instance()->clientCloseException(conn);
-        // 关闭连接
-        conn->shutdown();
+        _workers.submit(session->queue, std::bind(&ChatService::clientCloseException, ChatService::instance(), conn), true);
     }
+    // 关闭连接
+    conn->shutdown();
 }
 
-// 上报读写事件相关信息的回调函数
+// 编解码器切分出一条完整消息后的回调函数
+// 在I/O线程中执行，只把消息提交到这条连接的串行队列，同一连接的消息按收到的顺序处理
 void ChatServer::onMessage(const TcpConnectionPtr &conn,  // 连接
-                           Buffer *buffer,                // 缓冲区
+                           const string &buf,             // 不带包头的一条完整消息
                            Timestamp time)                // 接收到数据的时间信息
 {
-    // 从buffer的缓冲区拿到数据，放到buf中
-    string buf = buffer->retrieveAllAsString();
+    const Session *session = peekSession(conn);
+    if (session == nullptr)
+    {
+        return;
+    }
+    if (!_workers.submit(session->queue, std::bind(&ChatServer::handleMessage, conn, buf, time)))
+    {
+        LOG_ERROR << "too many pending messages from " << conn->name() << ", force close";
+        conn->forceClose();
+    }
+}
+
+// 在业务线程中处理一条完整消息
+void ChatServer::handleMessage(const TcpConnectionPtr &conn, const string &buf, Timestamp time)
+{
+    // 协商了二进制协议的连接发来的聊天消息，只解析固定头就能路由，不经过json
+    if (BinaryProto::isBinary(buf))
+    {
+        ChatService::instance()->handleBinary(conn, buf, time);
+        return;
+    }
+
+    // 一对一聊天、群聊这类纯转发的消息，只读出路由字段，消息原文原样转发，省掉解析和重新序列化
+    if (ChatService::instance()->relay(conn, buf, time))
+    {
+        return;
+    }
 
     // 数据的反序列化，相当于对数据进行解码
     // 其中一定包含了message_id或者其他信息，以表示业务
-    json js = json::parse(buf);
+    json js;
+    try
+    {
+        js = json::parse(buf);
+    }
+    catch (const json::exception &e)
+    {
+        // 一条消息格式错误只丢弃这一条，不影响同一连接上的后续消息
+        LOG_ERROR << "invalid json message from " << conn->name() << ": " << e.what();
+        return;
+    }
+    if (!js.contains("msgid") || !js["msgid"].is_number_integer())
+    {
+        LOG_ERROR << "message without msgid from " << conn->name();
+        return;
+    }
 
     // 目的：完全解耦网络模块的代码和业务模块的代码
     // 为了防止网络模块和业务模块耦合到一起
-    // 通过js["msgid"]绑定一个回调操作，一个msgid对应一个操作
-    // 这样就可以通过msgid获取一个业务处理器handler（事先绑定好的，就是构造函数中绑定的）
-    // 通过回调handler，可以把接收到的数据，例如conn，js，time等等传进去
-
-    // js["msgid"].get<int>() 将js中的msgid获取到，并转换为int型
-    auto msgHandler = ChatService::instance()->getHandler(js["msgid"].get<int>());
-    // 回调信息绑定好的事件处理器，来执行相应的业务处理
-    msgHandler(conn, js, time);
-}
+    // 通过js["msgid"]找到对应的业务方法，一个msgid对应一个业务
+    // 业务层按msgid在分发表中取出业务方法，把json转换成这种消息的请求结构体后调用
+    ChatService::instance()->dispatch(js["msgid"].get<int>(), conn, js, time);
+}
\ No newline at end of file
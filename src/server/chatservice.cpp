@@ -1,10 +1,251 @@
 #include "chatservice.hpp"
 #include "public.hpp"
+#include "binaryproto.hpp"
+#include "routescanner.hpp"
+#include "jsonwriter.hpp"
 #include <muduo/base/Logging.h>
 #include <vector>
+#include <cstdlib>
 using namespace std;
 using namespace muduo;
 
+// 群组成员缓存失效的广播通道，所有服务器都订阅，发布的内容是群组id
+// 发布者自己也会收到，只是多一次重新加载，不影响正确性
+static const string GROUP_CACHE_CHANNEL = "groupcache";
+
+// 每页离线消息的最大条数和最大字节数，至少发送一条
+static const int OFFLINE_PAGE_SIZE = 100;
+static const size_t OFFLINE_PAGE_BYTES = 64 * 1024;
+// 每次增量同步最多返回的消息条数
+static const int SYNC_PAGE_SIZE = 100;
+
+// 协程业务执行mysql调用的线程数，和连接池的最大连接数一致
+static const int ASYNC_DB_THREADS = 32;
+// 协程业务执行redis调用的线程数，redis命令在Redis的小连接池上执行，不超过连接数
+static const int ASYNC_REDIS_THREADS = 4;
+
+// 服务器节点的redis通道名，每台服务器只订阅自己的这一个通道
+static string nodeChannel(const string &nodeid)
+{
+    return "node:" + nodeid;
+}
+
+// 消息的一个接收者：用户id和分配给该用户的消息序号，序号为0表示没有序号
+using Recipient = pair<int, long long>;
+
+// 打包发给其他服务器的消息信封
+// 第一行是接收者列表，每个接收者是"用户id:序号"，用逗号分隔，换行之后是不带序号的原始消息(json序列化后不含换行)
+// 由接收的服务器在转发给每个用户时再写入各自的序号
+static string makeEnvelope(const vector<Recipient> &recipients, const string &msg)
+{
+    string envelope;
+    for (const Recipient &recipient : recipients)
+    {
+        if (!envelope.empty())
+        {
+            envelope += ',';
+        }
+        envelope += to_string(recipient.first);
+        envelope += ':';
+        envelope += to_string(recipient.second);
+    }
+    envelope += '\n';
+    envelope += msg;
+    return envelope;
+}
+
+// 解析其他服务器发来的消息信封，格式错误返回false
+static bool parseEnvelope(const string &envelope, vector<Recipient> &recipients, string &msg)
+{
+    size_t pos = envelope.find('\n');
+    if (pos == string::npos)
+    {
+        return false;
+    }
+
+    const char *p = envelope.data();
+    const char *end = p + pos;
+    while (p < end)
+    {
+        char *next = nullptr;
+        int userid = static_cast<int>(strtol(p, &next, 10));
+        if (next == p || *next != ':')
+        {
+            return false;
+        }
+        p = next + 1; // 跳过冒号
+        long long seq = strtoll(p, &next, 10);
+        if (next == p)
+        {
+            return false;
+        }
+        recipients.emplace_back(userid, seq);
+        p = next + 1; // 跳过逗号
+    }
+    msg = envelope.substr(pos + 1);
+    return true;
+}
+
+// 给每个接收者生成写入了各自序号的离线消息
+static vector<OfflineMsgWriter::OfflineMsg> makeOfflineMsgs(const vector<Recipient> &recipients, const string &msg)
+{
+    vector<OfflineMsgWriter::OfflineMsg> msgs;
+    msgs.reserve(recipients.size());
+    for (const Recipient &recipient : recipients)
+    {
+        msgs.emplace_back(recipient.first, make_shared<const string>(Inbox::withSeq(msg, recipient.second)));
+    }
+    return msgs;
+}
+
+// 账号已经在线、不允许重复登录的登录响应
+static string accountInUseResponse()
+{
+    // response - 响应
+    json response;
+    // LOGIN_MSG_ACK --- 对应的就是登录响应消息
+    response["msgid"] = LOGIN_MSG_ACK;
+    // errno = 2，表示响应出错，就会有errmsg说明错误信息
+    response["errno"] = 2;
+    response["errmsg"] = "this account is using, input another!"; // 该账号已经登录，请重新输入新账号
+    // json.dump() -- 将json对象序列化为字符串格式
+    return response.dump();
+}
+
+// 二进制聊天消息转换成json文本，字段和json客户端发送的一致，格式错误返回空串
+// 每条二进制消息都要转换一次，直接写出json文本，不构造json对象再dump
+static string binaryChatToJson(const string &body)
+{
+    BinaryHeader header;
+    string name, time, msg;
+    if (!BinaryProto::decodeChat(body, header, name, time, msg))
+    {
+        return string();
+    }
+
+    Buffer buf;
+    JsonWriter writer(buf);
+    writer.beginObject();
+    writer.key("msgid");
+    writer.value(static_cast<int>(header.opcode));
+    writer.key("id");
+    writer.value(header.id);
+    writer.key(header.opcode == GROUP_CHAT_MSG ? "groupid" : "toid");
+    writer.value(header.target);
+    writer.key("name");
+    writer.value(name);
+    writer.key("time");
+    writer.value(time);
+    writer.key("msg");
+    writer.value(msg);
+    if (header.seq != 0)
+    {
+        writer.key("seq");
+        writer.value(static_cast<long long>(header.seq));
+    }
+    writer.endObject();
+    return buf.retrieveAllAsString();
+}
+
+// 一条要转发的聊天消息
+// 消息可能来自json客户端，也可能来自协商了二进制协议的客户端。收件箱、离线消息和跨服务器转发统一使用json，
+// 发给二进制连接时使用二进制格式。两种格式按需转换并缓存，同一条消息最多转换一次，来源和目标格式相同时不转换
+// 只借用收到的消息原文，不复制，只能在原文的生命周期内、处理这条消息的线程中使用
+class ChatPayload
+{
+public:
+    // body是收到的消息原文，json或者二进制格式
+    explicit ChatPayload(const string &body)
+        : _json(nullptr), _binary(nullptr)
+    {
+        if (BinaryProto::isBinary(body))
+        {
+            _binary = &body;
+        }
+        else
+        {
+            _json = &body;
+        }
+    }
+
+    // json格式的消息，二进制消息格式错误时返回空串
+    const string &jsonText()
+    {
+        if (_json == nullptr)
+        {
+            _jsonOwned = binaryChatToJson(*_binary);
+            _json = &_jsonOwned;
+        }
+        return *_json;
+    }
+
+    // 二进制格式的消息，json消息字段不全或者太长无法编码时返回空串，这时按json格式发送
+    const string &binaryBody()
+    {
+        if (_binary == nullptr)
+        {
+            try
+            {
+                _binaryOwned = BinaryProto::chatFromJson(json::parse(*_json));
+            }
+            catch (const json::exception &e)
+            {
+                LOG_ERROR << "convert chat message to binary failed: " << e.what();
+            }
+            _binary = &_binaryOwned;
+        }
+        return *_binary;
+    }
+
+    // 按连接协商的格式把消息发给这条连接，并写入接收者的序号，seq为0表示不带序号
+    void send(const TcpConnectionPtr &conn, long long seq)
+    {
+        string head;
+        size_t offset;
+        const string &body = bodyFor(conn, seq, head, offset);
+        MessageCodec::send(conn, head, body.data() + offset, body.size() - offset);
+    }
+
+    // 和send一样，只是编码成消息帧，交给分发器发送
+    MessageCodec::FramePtr encode(const TcpConnectionPtr &conn, long long seq)
+    {
+        string head;
+        size_t offset;
+        const string &body = bodyFor(conn, seq, head, offset);
+        return MessageCodec::encode(head, body.data() + offset, body.size() - offset);
+    }
+
+private:
+    // 选出发给这条连接的格式，写入了序号的消息开头放在head中，返回的消息从offset开始接在head后面
+    const string &bodyFor(const TcpConnectionPtr &conn, long long seq, string &head, size_t &offset)
+    {
+        const Session *session = peekSession(conn);
+        if (session != nullptr && session->binary && !binaryBody().empty())
+        {
+            // 二进制消息只改写固定头中的序号，payload原样转发
+            offset = 0;
+            if (seq != 0)
+            {
+                head = BinaryProto::withSeq(_binary->substr(0, BINARY_HEADER_LEN), seq);
+                offset = BINARY_HEADER_LEN;
+            }
+            return *_binary;
+        }
+        offset = Inbox::seqHead(jsonText(), seq, head);
+        return *_json;
+    }
+
+    // 两种格式的消息，可能指向原文，也可能指向转换后保存在本对象中的消息
+    const string *_json;
+    const string *_binary;
+    string _jsonOwned;
+    string _binaryOwned;
+
+    // 指向自己的成员，不能复制
+    ChatPayload(const ChatPayload &) = delete;
+    ChatPayload &operator=(const ChatPayload &) = delete;
+};
+
 // 获取单例对象的接口函数
 ChatService *ChatService::instance()
 {
@@ -13,183 +254,190 @@ ChatService *ChatService::instance()
     return &service;
 }
 
-// 注册消息以及对应的handler回调操作，包括初始化成员变量和方法
+// 初始化成员变量，连接redis服务器，消息和业务方法的对应关系见dispatch中的分发表
 ChatService::ChatService()
+    : _offlineWriter(_offlineMsgModel),
+      _groupCache(std::bind(&GroupModel::queryGroupMembers, &_groupModel, _1, _2)),
+      _presence(_redis),
+      _inbox(_redis),
+      _async(ASYNC_DB_THREADS, ASYNC_REDIS_THREADS)
 {
-    // 业务设计核心，同时也是将网络模块和业务模块解耦的核心
-    // 需要进行绑定，否则无法派发出去
-    // LOGIN_MSG 对应的就是登录业务
-    _msgHandlerMap.insert({LOGIN_MSG, std::bind(&ChatService::login, this, _1, _2, _3)});
-    // LOGINOUT_MSG 对应的就是注销业务
-    _msgHandlerMap.insert({LOGINOUT_MSG, std::bind(&ChatService::loginout, this, _1, _2, _3)});
-    // REG_MSG 对应的就是注册业务
-    _msgHandlerMap.insert({REG_MSG, std::bind(&ChatService::reg, this, _1, _2, _3)});
-    // ONE_CHAT_MSG 对应的就是一对一聊天业务
-    _msgHandlerMap.insert({ONE_CHAT_MSG, std::bind(&ChatService::onechat, this, _1, _2, _3)});
-    // ADD_FRIEND_MSG 对应的是添加好友业务
-    _msgHandlerMap.insert({ADD_FRIEND_MSG, std::bind(&ChatService::addFriend, this, _1, _2, _3)});
-
-    // 群组业务管理相关事件处理回调注册
-    _msgHandlerMap.insert({CREATE_GROUP_MSG, std::bind(&ChatService::createGroup, this, _1, _2, _3)});
-    _msgHandlerMap.insert({ADD_GROUP_MSG, std::bind(&ChatService::addGroup, this, _1, _2, _3)});
-    _msgHandlerMap.insert({GROUP_CHAT_MSG, std::bind(&ChatService::groupChat, this, _1, _2, _3)});
+    _async.start();
 
     // 连接redis服务器
     if(_redis.connect())
     {
-        // 设置上报消息的回调
-        _redis.init_notify_handler(std::bind(&ChatService::handleRedisSubscribeMessage, this, _1, _2));
+        // 设置发布失败的回调
+        _redis.init_publish_error_handler(std::bind(&ChatService::handleRedisPublishError, this, _1, _2));
+        // 订阅群组成员缓存失效的广播通道
+        _redis.subscribe(GROUP_CACHE_CHANNEL, std::bind(&ChatService::handleGroupCacheInvalidate, this, _1));
     }
 }
 
+// 没有经过reset退出时，成员按定义的逆序析构，_dispatcher比_redis先析构
+// 发布线程停止前还会调用发布失败的回调，用到_dispatcher，所以先在这里停止
+ChatService::~ChatService()
+{
+    _redis.stop_publish();
+    _dispatcher.stop();
+}
+
+// 设置本服务器的节点id，并订阅本服务器的节点通道
+// 发给本服务器上用户的跨服务器消息，都从这一个通道过来
+void ChatService::initNode(const string &nodeid)
+{
+    _nodeId = nodeid;
+    _presence.start(_nodeId);
+    _redis.subscribe(nodeChannel(_nodeId), std::bind(&ChatService::handleNodeMessage, this, _1));
+}
+
 // 服务器异常，业务重置的方法
 void ChatService::reset()
 {
+    // 先把还没写入的state写完，否则可能在重置之后又把用户写成online
+    _presence.stop();
     // 把online状态的用户设置为offline
     _userModel.resetState();
+    // 按依赖顺序停止后台线程：发布失败的消息交给分发器的线程池存为离线消息，线程池再交给离线消息写入线程
+    // 发布线程不能等到Redis析构时才停止，那时分发器已经析构了
+    _redis.stop_publish();
+    _dispatcher.stop();
+    // 把队列中还没写入的离线消息写完
+    _offlineWriter.stop();
 }
 
-// 获取消息对应的处理器
-MsgHandler ChatService::getHandler(int msgid)
-// msgid 就是不同业务的编号，可以通过哈希表_msgHandlerMap查找到对应的业务
+// 按msgid把消息分发给对应的业务方法
+// 业务设计核心，同时也是将网络模块和业务模块解耦的核心
+void ChatService::dispatch(int msgid, const TcpConnectionPtr &conn, json &js, Timestamp time)
 {
-    // 记录错误日志，msgid没有对应的事件处理回调
-    auto it = _msgHandlerMap.find(msgid);
-    if (it == _msgHandlerMap.end()) // 表示没有找到
+    using Dispatch = MsgDispatch<ChatService>;
+    // 分发表：下标就是msgid，编译期生成，运行过程中不会修改，不需要考虑线程安全
+    // 服务器发给客户端的响应消息没有业务方法
+    static constexpr Dispatch::Route routes[] = {
+        {0, nullptr},
+        {LOGIN_MSG, &Dispatch::invoke<LoginRequest, &ChatService::login>},
+        {LOGIN_MSG_ACK, nullptr},
+        {LOGINOUT_MSG, &Dispatch::invoke<LoginoutRequest, &ChatService::loginout>},
+        {REG_MSG, &Dispatch::invoke<RegRequest, &ChatService::reg>},
+        {REG_MSG_ACK, nullptr},
+        {ONE_CHAT_MSG, &Dispatch::invoke<OneChatRequest, &ChatService::onechat>},
+        {ADD_FRIEND_MSG, &Dispatch::invoke<AddFriendRequest, &ChatService::addFriend>},
+        {CREATE_GROUP_MSG, &Dispatch::invoke<CreateGroupRequest, &ChatService::createGroup>},
+        {ADD_GROUP_MSG, &Dispatch::invoke<AddGroupRequest, &ChatService::addGroup>},
+        {GROUP_CHAT_MSG, &Dispatch::invoke<GroupChatRequest, &ChatService::groupChat>},
+        {OFFLINE_MSG, nullptr},
+        {OFFLINE_MSG_ACK, &Dispatch::invoke<OfflineAckRequest, &ChatService::offlineAck>},
+        {SYNC_MSG, &Dispatch::invoke<SyncRequest, &ChatService::syncMsg>},
+        {SYNC_MSG_ACK, nullptr},
+        {PROTOCOL_MSG, &Dispatch::invoke<ProtocolRequest, &ChatService::protocol>},
+        {PROTOCOL_MSG_ACK, nullptr},
+    };
+    static_assert(Dispatch::dense(routes), "routes must be indexed by msgid");
+    static_assert(sizeof(routes) / sizeof(routes[0]) == MSG_TYPE_COUNT, "every EnMsgType needs a route");
+
+    try
     {
-        // 返回一个默认的处理器，空操作
-        return [=](const TcpConnectionPtr &conn, json &js, Timestamp)
+        if (!Dispatch::dispatch(routes, *this, msgid, conn, js, time))
         {
-            // 通过muduo库日志进行错误信息打印
-            // LOG_ERROR 表示错误类消息
-            LOG_ERROR << "msgid: " << msgid << " can not find handler!"; // 表示找不到相应的处理器
-        };
+            // 通过muduo库日志进行错误信息打印，msgid没有对应的业务方法
+            LOG_ERROR << "msgid: " << msgid << " can not find handler!";
+        }
     }
-    else
+    catch (const json::exception &e)
     {
-        // 如果找到了，就返回对应的处理器
-        return _msgHandlerMap[msgid];
+        // 请求缺少字段或者字段类型不对，只丢弃这一条消息
+        LOG_ERROR << "invalid request, msgid: " << msgid << ", " << e.what();
     }
 }
 
 // 处理登录业务
 // 即输入id + pwd 并检测是否对应正确，即可登录
-void ChatService::login(const TcpConnectionPtr &conn, json &js, Timestamp time)
+// 每次查询mysql、redis都co_await，查询在AsyncIo的线程中执行，完成后回到连接所在的I/O线程继续执行
+// 协程执行期间连接的串行队列是暂停的，这个连接的下一条消息要等登录处理完
+//
+// 互不依赖的查询用whenAll同时进行，登录只等三轮：
+// 1. 用户信息和是否已经在线
+// 2. 密码正确之后，读取最大消息序号并记录在线状态
+// 3. 好友、群组、第一页离线消息
+// 登录耗时接近每一轮中最慢的那个查询之和，而不是所有查询的总和
+Task<void> ChatService::login(TcpConnectionPtr conn, LoginRequest req, Timestamp time)
 {
-    // js["id"]默认是字符串类型，.get<int>() 将其转换为int型
-    int id = js["id"].get<int>();
-    string pwd = js["password"];
+    EventLoop *loop = conn->getLoop();
+    int id = req.id;
+    string pwd = req.password;
 
     // 根据用户id号码查询用户信息
-    User user = _userModel.query(id);
-    // 查询到的user的id等于js["id"]并且密码正确，才能登录成功
+    // user表的state是异步写入的，可能还没更新，是否在线以集群在线状态为准
+    // 这里跳过本地缓存直接查询redis，尽量避免同一账号在两台服务器上同时登录
+    auto [user, nodeid] = co_await whenAll(
+        _async.db(loop, [&]() { return _userModel.query(id); }),
+        _async.redis(loop, [&]() { return _presence.query(id, false); }));
+    // 查询到的user的id等于请求中的id并且密码正确，才能登录成功
     if (user.getId() == id && user.getPwd() == pwd)
     {
-        if (user.getState() == "online")
+        // 记录的节点是本服务器、但在线用户表中没有这个用户，是本服务器上次异常退出时留下的记录，当作离线，登录时覆盖
+        if (_userConnMap.find(id) || (!nodeid.empty() && nodeid != _nodeId))
         {
-            // 该用户已经登录，不允许重复登录
-            // response - 响应
-            json response;
-            // LOGIN_MSG_ACK --- 对应的就是登录响应消息
-            response["msgid"] = LOGIN_MSG_ACK;
-            // errno = 2，表示响应出错，就会有errmsg说明错误信息
-            response["errno"] = 2;
-            response["errmsg"] = "this account is using, input another!"; // 该账号已经登录，请重新输入新账号
-            // 登陆失败，将json发送回去
-            // json.dump() -- 将json对象序列化为字符串格式
-            conn->send(response.dump());
+            // 该用户已经登录，不允许重复登录，登陆失败，将json发送回去
+            MessageCodec::send(conn, accountInUseResponse());
         }
         else
         {
             // 登录成功，记录用户连接信息
-            // 添加互斥锁，保证线程安全 （而对于数据库中的并发操作不需要考虑，因为mysql server会保证多线程安全）
-            // 互斥锁是在{}结束时，自动解锁，所以这里将两行代码放到{}中，以及时解锁，防止多线程并发程序变为单线程
-            // 使锁的力度尽可能小
+            // 在线用户表内部按用户id分片加锁，保证线程安全 （而对于数据库中的并发操作不需要考虑，因为mysql server会保证多线程安全）
+            // 把用户id记录在连接上，连接断开时直接取出来，不需要遍历在线用户表反查
+            // 要在放入在线用户表之前修改，其他线程从在线用户表中拿到连接之后才读取会话信息
+            // 上面的检查和这里之间协程挂起过，同一账号可能已经在本服务器的另一条连接上登录成功，
+            // 以放入在线用户表是否成功为准，失败时恢复会话信息，和已经登录一样处理
+            Session *session = getSession(conn);
+            int prevUserid = session->userid;
+            bool prevProtocolFixed = session->protocolFixed;
+            session->userid = id;
+            session->protocolFixed = true;
+            if (!_userConnMap.insertIfAbsent(id, conn))
             {
-                lock_guard<mutex> lock(_connMutex);
-                _userConnMap.insert({id, conn});
-            } // 出做用户，即{}结束自动解锁
-
-            // id用户登录成功后，向redis订阅channel(id)
-            // 也就是用户登录成功后，向详细队列中订阅一下，当有发给该用户的消息的时候，可以从消息队列中转发过来
-            _redis.subscribe(id);
-
-            // 登录成功，更新用户状态信息state: offline -> online
-            // 先将user的状态改为online
-            user.setState("online");
-            // 再同步到user表中
-            _userModel.updateState(user);
-
-            // 准备给客户端返回消息
-            // response - 响应
-            json response;
-            // LOGIN_MSG_ACK --- 对应的就是登录响应消息
-            response["msgid"] = LOGIN_MSG_ACK;
-            // 如果errno = 0，表示响应成功，没有出错
-            // 如果errno = 1，表示响应出错，就会有errmsg说明错误信息
-            response["errno"] = 0;
-            response["id"] = user.getId();
-            response["name"] = user.getName();
-
-            // 查询该用户是否有离线消息
-            vector<string> vec = _offlineMsgModel.query(id);
-            // vec不为空，表示有离线消息
-            if(!vec.empty())
-            {
-                // 将vec添加到json中
-                response["offlinemsg"] = vec;
-                // 读取该用户的离线消息后，把该用户的所有离线消息删除掉
-                _offlineMsgModel.remove(id);
+                session->userid = prevUserid;
+                session->protocolFixed = prevProtocolFixed;
+                MessageCodec::send(conn, accountInUseResponse());
+                co_return;
             }
 
-            // 查询该用户的好友信息，并返回
-            vector<User> userVec = _friendModel.query(id);
-            if(!userVec.empty())
-            {
-                vector<string> vec2;
-                for(User &user : userVec)
-                {
-                    json js;
-                    js["id"] = user.getId();
-                    js["name"] = user.getName();
-                    js["state"] = user.getState();
-                    vec2.emplace_back(js.dump());
-                }
-                response["friends"] = vec2;
-            }
+            // id用户登录成功后，在redis中记录该用户登录在本服务器上，
+            // 其他服务器有发给该用户的消息时，发布到本服务器的节点通道，不再需要每个用户订阅一个通道；
+            // 更新用户状态信息state: offline -> online，由后台线程异步写入user表
+            // 必须在查询离线消息之前写完：写入之前发来的消息存为离线消息，写入之后发来的消息在线转发，
+            // 和查询同时进行的话，两者之间存入的离线消息这次登录收不到
+            //
+            // 用户当前的最大消息序号，客户端以此为起点判断之后的消息有没有缺失，必须在记录上线之前读取：
+            // 记录上线之后分配的序号都比它大，在线推送过来时客户端不会当作已经收到过的消息丢掉
+            // 读取之前分配了序号、记录上线之后才在线推送的消息，客户端按登录前的消息单独去重，见SeqFilter
+            long long seq = co_await _async.redis(loop, [&]() {
+                long long current = _inbox.currentSeq(id);
+                _presence.online(id);
+                return current;
+            });
+
+            // 下面几个查询同时进行：
+            // - 好友和群组信息
+            // - 第一页离线消息，离线消息是异步写入的，先等本服务器之前放入队列的消息写完
+            //   离线消息不放在登录响应中，登录响应发出之后再推送这一页，客户端确认一页再推送下一页
+            auto [userVec, groupuserVec, offlinePage] = co_await whenAll(
+                _async.db(loop, [&]() { return _friendModel.query(id); }),
+                _async.db(loop, [&]() { return _groupModel.queryGroups(id); }),
+                _async.db(loop, [&]() {
+                    _offlineWriter.flush();
+                    return offlinePageOf(id, 0);
+                }));
 
-            // 查询用户的群组信息
-            vector<Group> groupuserVec = _groupModel.queryGroups(id);
-            if (!groupuserVec.empty())
+            // 登录成功，把响应直接写入发送用的Buffer，好友、群组按客户端要求的格式写入
+            Buffer buf;
+            LoginAck::write(buf, user, seq, userVec, groupuserVec, req.structured);
+            MessageCodec::send(conn, &buf);
+
+            if (!offlinePage.empty())
             {
-                // group:[{groupid:[xxx, xxx, xxx, xxx]}]
-                vector<string> groupV;
-                for (Group &group : groupuserVec)
-                {
-                    json grpjson;
-                    grpjson["id"] = group.getId();
-                    grpjson["groupname"] = group.getName();
-                    grpjson["groupdesc"] = group.getDesc();
-                    vector<string> userV;
-                    for (GroupUser &user : group.getUsers())
-                    {
-                        json js;
-                        js["id"] = user.getId();
-                        js["name"] = user.getName();
-                        js["state"] = user.getState();
-                        js["role"] = user.getRole();
-                        userV.push_back(js.dump());
-                    }
-                    grpjson["users"] = userV;
-                    groupV.push_back(grpjson.dump());
-                }
-
-                response["groups"] = groupV;
+                MessageCodec::send(conn, offlinePage);
             }
-
-            // 登录成功，将json发送回去
-            // json.dump() -- 将json对象序列化为字符串格式
-            conn->send(response.dump());
         }
     }
     else
@@ -204,17 +452,17 @@ void ChatService::login(const TcpConnectionPtr &conn, json &js, Timestamp time)
         response["errmsg"] = "id or password is invalid!"; // 用户名或密码错误
         // 登陆失败，将json发送回去
         // json.dump() -- 将json对象序列化为字符串格式
-        conn->send(response.dump());
+        MessageCodec::send(conn, response.dump());
     }
 }
 
 // 处理注册业务
 // user表中一共有四个字段，填一个name password就可以
 // id是注册成功之后返回给用户的，state也不用填
-void ChatService::reg(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::reg(const TcpConnectionPtr &conn, const RegRequest &req, Timestamp time)
 {
-    string name = js["name"];
-    string pwd = js["password"];
+    string name = req.name;
+    string pwd = req.password;
 
     User user;
     user.setName(name);
@@ -233,7 +481,7 @@ void ChatService::reg(const TcpConnectionPtr &conn, json &js, Timestamp time)
         response["id"] = user.getId();
         // 注册成功，将json发送回去
         // json.dump() -- 将json对象序列化为字符串格式
-        conn->send(response.dump());
+        MessageCodec::send(conn, response.dump());
     }
     else
     {
@@ -245,126 +493,307 @@ void ChatService::reg(const TcpConnectionPtr &conn, json &js, Timestamp time)
         // errno = 1，表示响应出错，可能需要error_message说明错误信息
         response["errno"] = 1;
         // 将json发送回去
-        conn->send(response.dump());
+        MessageCodec::send(conn, response.dump());
     }
 }
 
 
 // 处理注销业务
-void ChatService::loginout(const TcpConnectionPtr &conn, json &js, Timestamp time)
+// 注销的是连接上已经登录的用户，不使用消息中的用户id，防止把其他用户下线
+void ChatService::loginout(const TcpConnectionPtr &conn, const LoginoutRequest &req, Timestamp time)
 {
-    int userid = js["id"].get<int>();
-    // 添加互斥锁，保证线程安全 （而对于数据库中的并发操作不需要考虑，因为mysql server会保证多线程安全）
-    // 互斥锁是在{}结束时，自动解锁，所以这里将两行代码放到{}中，以及时解锁，防止多线程并发程序变为单线程
-    // 使锁的力度尽可能小
+    // 连接上没有绑定用户，说明还没登录或者已经注销，不需要处理
+    Session *session = getSession(conn);
+    if (session->userid < 0)
     {
-        lock_guard<mutex> lock(_connMutex);
-        auto it = _userConnMap.find(userid);
-        if(it != _userConnMap.end())
-        {
-            _userConnMap.erase(it);
-        }
-
+        return;
     }
+    int userid = session->userid;
+    // 连接上不再绑定用户，之后这条连接断开时不需要再处理
+    session->userid = -1;
 
-    // 用户注销，相当于就是下线，在redis中取消订阅通道
-    _redis.unsubscribe(userid);
-
-    // 更新用户的状态信息
-    User user(userid, "", "", "offline");
-    _userModel.updateState(user);
+    // 用户当前的连接就是这条连接时才从在线用户表中删除，防止把用户在其他连接上的登录删掉
+    if (!_userConnMap.erase(userid, conn))
+    {
+        return;
+    }
 
+    // 用户注销，相当于就是下线，在redis中删除该用户所在服务器的记录，并异步更新用户的状态信息
+    // 只有记录的还是本服务器时才删除，和clientCloseException一样
+    _presence.offline(userid);
 }
 
 // 处理客户端异常退出
 void ChatService::clientCloseException(const TcpConnectionPtr &conn)
 {
-    // 通过conn去_userConnMap中查，找到响应的用户id
-    // 1. 将找到的pair从_userConnMap中删除
+    // 登录成功时把用户id记录在了连接上，直接取出来，不需要遍历_userConnMap反查
+    // 1. 将用户的连接从_userConnMap中删除
     // 2. 修改数据库中该用户的状态，从online -> offline
 
+    // 连接上没有绑定用户，说明还没登录或者已经注销，不需要处理
+    const Session *session = peekSession(conn);
+    if (session == nullptr || session->userid < 0)
+    {
+        return;
+    }
+
     // 保存用户id，用来后面修改用户状态信息
-    User user;
-    // 添加互斥锁，保证线程安全 （而对于数据库中的并发操作不需要考虑，因为mysql server会保证多线程安全）
-    // 互斥锁是在{}结束时，自动解锁，所以这里将两行代码放到{}中，以及时解锁，防止多线程并发程序变为单线程
-    // 使锁的力度尽可能小
+    int userid = session->userid;
+    // 用户当前的连接就是这条连接时才删除，防止把用户在其他连接上的新登录删掉
+    if (!_userConnMap.erase(userid, conn))
+    {
+        return;
+    }
+
+    // 用户注销，相当于就是下线，在redis中删除该用户所在服务器的记录，并异步更新用户的状态信息
+    // 只有记录的还是本服务器时才删除，用户可能已经在其他服务器上重新登录了
+    _presence.offline(userid);
+}
+
+// 客户端确认收到离线消息
+// 只删除客户端确认过的消息，推送过程中连接断开，没有确认的消息下次登录还会再推送
+void ChatService::offlineAck(const TcpConnectionPtr &conn, const OfflineAckRequest &req, Timestamp time)
+{
+    // 确认的是连接上已经登录的用户的消息，不使用消息中的用户id，防止删除其他用户的离线消息
+    const Session *session = peekSession(conn);
+    if (session == nullptr || session->userid < 0)
+    {
+        return;
+    }
+    int userid = session->userid;
+    long long cursor = req.cursor;
+
+    _offlineMsgModel.remove(userid, cursor);
+    sendOfflinePage(conn, userid, cursor);
+}
+
+// 推送用户编号大于afterId的一页离线消息
+void ChatService::sendOfflinePage(const TcpConnectionPtr &conn, int userid, long long afterId)
+{
+    string page = offlinePageOf(userid, afterId);
+    if (!page.empty())
+    {
+        MessageCodec::send(conn, page);
+    }
+}
+
+// 查询用户编号大于afterId的一页离线消息
+string ChatService::offlinePageOf(int userid, long long afterId)
+{
+    // 多查一条，用来判断后面还有没有下一页
+    vector<OfflineMsgModel::IdMsg> msgs = _offlineMsgModel.query(userid, afterId, OFFLINE_PAGE_SIZE + 1);
+    if (msgs.empty())
     {
-        lock_guard<mutex> lock(_connMutex);
-        for (auto it = _userConnMap.begin(); it != _userConnMap.end(); ++it)
+        return string();
+    }
+
+    // 一页最多OFFLINE_PAGE_SIZE条，并且总长度不超过OFFLINE_PAGE_BYTES，单条消息超长时这一页只有它一条
+    vector<string> page;
+    size_t bytes = 0;
+    long long lastId = afterId;
+    for (OfflineMsgModel::IdMsg &msg : msgs)
+    {
+        if ((int)page.size() == OFFLINE_PAGE_SIZE ||
+            (!page.empty() && bytes + msg.second.size() > OFFLINE_PAGE_BYTES))
         {
-            if (it->second == conn)
-            {
-                // 保存用户id，用来后面修改用户状态信息
-                user.setId(it->first);
-                // 从_userConnMap中删除用户的链接信息
-                _userConnMap.erase(it);
-                break;
-            }
+            break;
+        }
+        bytes += msg.second.size();
+        lastId = msg.first;
+        page.push_back(std::move(msg.second));
+    }
+
+    json response;
+    response["msgid"] = OFFLINE_MSG;
+    response["offlinemsg"] = page;
+    // 这一页最后一条消息的编号，客户端确认时原样带回
+    // 和消息中的序号seq不是一回事：编号只用于离线消息的分页确认，序号是每个用户的消息顺序
+    response["cursor"] = lastId;
+    response["more"] = page.size() < msgs.size();
+    return response.dump();
+}
+
+// 增量同步
+// 客户端带上已经连续收到的最大序号，从收件箱中取回之后的消息，一次最多SYNC_PAGE_SIZE条
+// 收件箱只保留最近的消息，更早的消息在用户离线期间已经存为离线消息，登录时会推送
+void ChatService::syncMsg(const TcpConnectionPtr &conn, const SyncRequest &req, Timestamp time)
+{
+    const Session *session = peekSession(conn);
+    if (session == nullptr || session->userid < 0)
+    {
+        return;
+    }
+    int userid = session->userid;
+    long long afterSeq = req.seq;
+
+    // 多查一条，用来判断后面还有没有
+    vector<pair<long long, string>> items = _inbox.query(userid, afterSeq, SYNC_PAGE_SIZE + 1);
+    bool more = items.size() > (size_t)SYNC_PAGE_SIZE;
+    if (more)
+    {
+        items.pop_back();
+    }
+    // 引用的群消息已经过期的跳过，序号照样推进，客户端不会一直停在这里
+    vector<string> msgs;
+    msgs.reserve(items.size());
+    for (auto &item : items)
+    {
+        if (!item.second.empty())
+        {
+            msgs.push_back(std::move(item.second));
         }
-    } // {}结束自动解锁
+    }
+
+    json response;
+    response["msgid"] = SYNC_MSG_ACK;
+    response["msgs"] = msgs;
+    // 这次返回的最后一条消息的序号，客户端还有更多消息时从这里继续同步
+    response["seq"] = items.empty() ? afterSeq : items.back().first;
+    response["more"] = more;
+    MessageCodec::send(conn, response.dump());
+}
+
+// 协商这条连接上聊天消息的格式
+// 只能在登录之前协商，登录之后连接已经放入在线用户表，其他线程转发消息时会读取协议格式
+void ChatService::protocol(const TcpConnectionPtr &conn, const ProtocolRequest &req, Timestamp time)
+{
+    Session *session = getSession(conn);
+    if (!session->protocolFixed)
+    {
+        session->binary = req.binary;
+    }
+
+    json response;
+    response["msgid"] = PROTOCOL_MSG_ACK;
+    // 回复实际使用的格式，登录之后的协商请求不会改变格式
+    response["binary"] = session->binary;
+    MessageCodec::send(conn, response.dump());
+}
+
+// 处理二进制格式的聊天消息
+// 只解析固定头就能路由，不需要像json消息那样先构造整个json对象
+void ChatService::handleBinary(const TcpConnectionPtr &conn, const string &body, Timestamp time)
+{
+    // 只有协商了二进制协议的连接才能发送二进制消息，客户端发送时序号必须是0
+    const Session *session = peekSession(conn);
+    BinaryHeader header;
+    if (session == nullptr || !session->binary || !BinaryProto::decodeHeader(body, header) || header.seq != 0)
+    {
+        LOG_ERROR << "invalid binary message from " << conn->name();
+        return;
+    }
+
+    ChatPayload payload(body);
+    // 收件箱和离线消息都要用到json格式，这里顺便检查了payload的格式
+    if (payload.jsonText().empty())
+    {
+        LOG_ERROR << "invalid binary chat payload from " << conn->name();
+        return;
+    }
+
+    switch (header.opcode)
+    {
+    case ONE_CHAT_MSG:
+        routeOneChat(header.target, payload);
+        break;
+    case GROUP_CHAT_MSG:
+        routeGroupChat(header.id, header.target, payload);
+        break;
+    default:
+        LOG_ERROR << "binary msgid: " << static_cast<int>(header.opcode) << " can not find handler!";
+        break;
+    }
+}
 
-    // 用户注销，相当于就是下线，在redis中取消订阅通道
-    _redis.unsubscribe(user.getId());
+// 转发只需要路由字段就能处理的json消息(一对一聊天和群聊)，不构造json对象，消息原文原样转发
+bool ChatService::relay(const TcpConnectionPtr &conn, const string &body, Timestamp time)
+{
+    RouteFields fields;
+    // 序号要写在消息的第一个字节'{'后面，开头有空白的消息走原来的路径
+    // 客户端自己带了seq字段的消息不能原样转发，会和服务器写入的序号重复，交给调用者解析成json，
+    // 请求结构体中去掉这个字段之后再转发，见chatBody
+    if (body.empty() || body[0] != '{' || !RouteScanner::scan(body, fields) || fields.has(RouteFields::SEQ))
+    {
+        return false;
+    }
 
-    // 更新用户的状态信息
-    if (user.getId() != -1) // 防止没有找到
+    if (fields.msgid == ONE_CHAT_MSG && fields.has(RouteFields::MSGID | RouteFields::TOID))
+    {
+        ChatPayload payload(body);
+        routeOneChat(fields.toid, payload);
+        return true;
+    }
+    if (fields.msgid == GROUP_CHAT_MSG && fields.has(RouteFields::MSGID | RouteFields::ID | RouteFields::GROUPID))
     {
-        user.setState("offline");
-        _userModel.updateState(user);
+        ChatPayload payload(body);
+        routeGroupChat(fields.id, fields.groupid, payload);
+        return true;
     }
+    // 创建群组、登录等需要读取其他字段的消息，交给json::parse
+    return false;
 }
 
 // 一对一聊天业务
-void ChatService::onechat(const TcpConnectionPtr &conn, json &js, Timestamp time)
+// 正常的一对一聊天消息已经在relay中原样转发了，这里只处理relay不能确定的消息
+void ChatService::onechat(const TcpConnectionPtr &conn, const OneChatRequest &req, Timestamp time)
 {
-    // 要发送的用户id
-    int toid = js["toid"].get<int>();
+    ChatPayload payload(req.body);
+    routeOneChat(req.toid, payload);
+}
+
+// 一对一聊天消息的转发
+void ChatService::routeOneChat(int toid, ChatPayload &payload)
+{
+    // 收件箱、跨服务器转发和离线消息都使用json格式
+    const string &text = payload.jsonText();
+
+    // 给toid分配一个消息序号，并放入toid的收件箱，不管消息最终是在线还是离线送达，都带上这个序号
+    vector<long long> seqs = _inbox.append({toid}, text);
+    long long seq = seqs.empty() ? 0 : seqs[0];
 
     // 第一种情况，用户id和要发送给的用户toid在同一服务器上登录，可以直接转发
-    // 因为要对_userConnMap进行操作，所以添加互斥锁，保证线程安全
+    TcpConnectionPtr toConn = _userConnMap.find(toid);
+    if (toConn)
     {
-        lock_guard<mutex> lock(_connMutex);
-        auto it = _userConnMap.find(toid);
-        if (it != _userConnMap.end())
-        {
-            // toid在线，转发消息  服务器主动推送消息给toid用户
-            it->second->send(js.dump());
-            return;
-        }
+        // toid在线，转发消息  服务器主动推送消息给toid用户，按toid连接协商的格式发送
+        payload.send(toConn, seq);
+        return;
     }
 
     // 第二种情况，用户id和要发送给的用户toid不在同一服务器上登录
-    // 查询toid是否在线
-    User user = _userModel.query(toid);
-    if(user.getState() == "online")
+    // 查询toid登录在哪台服务器上，查不到说明不在线，优先使用本地缓存，不查询mysql
+    string node = _presence.query(toid);
+    if (!node.empty() && node != _nodeId)
     {
-        // 向redis指定的通道channel发布消息
-        _redis.publish(toid, js.dump());
-        return;
+        // 发布到toid所在服务器的节点通道，信封中带上toid和序号，发布队列已满时存为离线消息
+        if (_redis.publish(nodeChannel(node), makeEnvelope({Recipient(toid, seq)}, text)))
+        {
+            return;
+        }
     }
 
     // 第三种情况，表示toid不在线，存储离线消息
-    _offlineMsgModel.insert(toid, js.dump());
+    _offlineWriter.write(toid, Inbox::withSeq(text, seq));
 }
 
 
 // 添加好友业务
 // msgid 对应添加好友，  id 用户id，  friendid 想添加的好友id
-void ChatService::addFriend(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::addFriend(const TcpConnectionPtr &conn, const AddFriendRequest &req, Timestamp time)
 {
-    int userid = js["id"].get<int>();
-    int friendid = js["friendid"].get<int>();
+    int userid = req.id;
+    int friendid = req.friendid;
 
     // 存储好友信息
     _friendModel.insert(userid, friendid);
 }
 
 // 创建群组业务
-void ChatService::createGroup(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::createGroup(const TcpConnectionPtr &conn, const CreateGroupRequest &req, Timestamp time)
 {
-    int userid = js["id"].get<int>();
-    string name = js["groupname"];
-    string desc = js["groupdesc"];
+    int userid = req.id;
+    string name = req.groupname;
+    string desc = req.groupdesc;
 
     // 存储新创建的群组信息
     Group group(-1, name, desc);
@@ -373,72 +802,226 @@ void ChatService::createGroup(const TcpConnectionPtr &conn, json &js, Timestamp
     {
         // 存储群组创建人信息，存储到groupUser表中
         _groupModel.addGroup(userid, group.getId(), "creator");
+        // 新群组只有创建人一个成员，直接放入缓存
+        _groupCache.putGroup(group.getId(), {userid});
     }
 }
 
 // 加入群组业务
-void ChatService::addGroup(const TcpConnectionPtr &conn, json &js, Timestamp time)
+void ChatService::addGroup(const TcpConnectionPtr &conn, const AddGroupRequest &req, Timestamp time)
 {
-    int userid = js["id"].get<int>();
-    int groupid = js["groupid"].get<int>();
+    int userid = req.id;
+    int groupid = req.groupid;
     // 存储到groupUser表中
     _groupModel.addGroup(userid, groupid, "normal");
+
+    // 更新本地的群组成员缓存，并通知其他服务器删除该群组的缓存
+    _groupCache.addMember(groupid, userid);
+    _redis.publish(GROUP_CACHE_CHANNEL, to_string(groupid));
 }
 
 // 群组聊天业务
-void ChatService::groupChat(const TcpConnectionPtr &conn, json &js, Timestamp time)
+// 和onechat一样，正常的群聊消息已经在relay中原样转发了
+void ChatService::groupChat(const TcpConnectionPtr &conn, const GroupChatRequest &req, Timestamp time)
+{
+    ChatPayload payload(req.body);
+    routeGroupChat(req.id, req.groupid, payload);
+}
+
+// 群聊消息的转发
+void ChatService::routeGroupChat(int userid, int groupid, ChatPayload &payload)
 {
-    int userid = js["id"].get<int>();
-    int groupid = js["groupid"].get<int>();
-    // 查询该群组中除了发消息的用户id之外，其他所有用户的id，方便后续消息转发
-    vector<int> useridVec = _groupModel.queryGroupUsers(userid, groupid);
+    // 从缓存中获取该群组的所有成员id，方便后续消息转发
+    GroupCache::MemberList members = _groupCache.getMembers(groupid);
+
+    // 群消息对每个成员都是一样的，只序列化一次，发给每个成员时再写入该成员的序号
+    const string &text = payload.jsonText();
+
+    // 跳过发消息的用户自己
+    vector<int> recipients;
+    recipients.reserve(members->size());
+    for (int id : *members)
+    {
+        if (id != userid)
+        {
+            recipients.push_back(id);
+        }
+    }
+
+    // 一次redis往返给所有接收者各分配一个消息序号，redis出错时seqOf为空，消息不带序号
+    vector<long long> seqs = _inbox.append(recipients, text);
+    unordered_map<int, long long> seqOf;
+    for (size_t i = 0; i < seqs.size(); ++i)
+    {
+        seqOf[recipients[i]] = seqs[i];
+    }
+    auto recipientOf = [&seqOf](int id) {
+        auto it = seqOf.find(id);
+        return Recipient(id, it != seqOf.end() ? it->second : 0);
+    };
+
+    // 在线用户表里只做一件事：找出哪些成员在本服务器上登录，拿到他们的连接
+    // 查数据库、发布redis、存储离线消息都在之后进行，避免一条大群消息阻塞所有的登录、注销和单聊
+    vector<TcpConnectionPtr> localConns;
+    vector<int> localIds;
+    vector<int> otherIds;
+    _userConnMap.findAll(recipients, localConns, otherIds, &localIds);
+
+    // 第一种情况：用户id和要发送给的用户toid在同一服务器上登录，可以直接转发
+    // 持有连接的智能指针，即使用户在此期间下线，连接对象也不会被释放
+    for (size_t i = 0; i < localConns.size(); ++i)
+    {
+        // 转发群消息，按每个成员连接协商的格式发送，消息中带上自己的序号
+        payload.send(localConns[i], recipientOf(localIds[i]).second);
+    }
+
+    if (otherIds.empty())
+    {
+        return;
+    }
+
+    // 批量查询不在本服务器上的成员登录在哪台服务器上，本地缓存中没有的才查询redis
+    vector<string> nodes = _presence.query(otherIds);
 
-    // 加锁
-    lock_guard<mutex> lock(_connMutex);
-    // 遍历所有用户，在线的直接转发，不在线的存储离线消息
-    for (int id : useridVec)
+    // 按成员所在的服务器分组，发往同一台服务器的成员共用一个信封
+    unordered_map<string, vector<Recipient>> nodeUserMap;
+    vector<Recipient> offlineRecipients;
+    for (size_t i = 0; i < otherIds.size(); ++i)
     {
-        auto it = _userConnMap.find(id);
-        if (it != _userConnMap.end())
+        if (!nodes[i].empty() && nodes[i] != _nodeId)
         {
-            // 第一种情况：用户id和要发送给的用户toid在同一服务器上登录，可以直接转发
-            // 转发群消息
-            it->second->send(js.dump());
+            nodeUserMap[nodes[i]].push_back(recipientOf(otherIds[i]));
         }
         else
         {
-            // 查询toid是否在线
-            User user = _userModel.query(id);
-            if(user.getState() == "online")
-            {
-                // 第二种情况：用户id和要发送给的用户toid不在同一服务器上登录，需要先向redis消息队列发布消息
-                // 向redis指定的通道channel发布消息
-                _redis.publish(id, js.dump());
-            }
-            else
-            {
-                // 第三种情况：用户toid离线
-                // 存储离线群消息
-                _offlineMsgModel.insert(id, js.dump());
-            }
-            
+            // 第三种情况：用户toid离线
+            offlineRecipients.push_back(recipientOf(otherIds[i]));
+        }
+    }
+
+    // 第二种情况：用户id和要发送给的用户toid不在同一服务器上登录，需要先向redis消息队列发布消息
+    // 每台服务器只发布一次，信封中带上该服务器上的全部接收者，由接收的服务器展开后逐个转发
+    // redis的流量只和服务器个数有关，和群成员个数无关
+    for (auto &nodeUsers : nodeUserMap)
+    {
+        if (!_redis.publish(nodeChannel(nodeUsers.first), makeEnvelope(nodeUsers.second, text)))
+        {
+            // 发布队列已满，存为离线消息
+            offlineRecipients.insert(offlineRecipients.end(), nodeUsers.second.begin(), nodeUsers.second.end());
         }
     }
+
+    // 批量存储离线群消息
+    _offlineWriter.write(makeOfflineMsgs(offlineRecipients, text));
 }
 
-// 从redis消息队列中获取订阅的消息
-// int userid --- 即时用户id，也是通道号，string msg --- 上报的消息
-void ChatService::handleRedisSubscribeMessage(int userid, string msg)
+// 把节点通道中收到的消息转发给本服务器上的一个用户
+// 在redis的订阅线程中调用，不能在这里做任何阻塞的操作
+void ChatService::deliverNodeMessage(int userid, const string &msg)
 {
-    // 加锁
-    lock_guard<mutex> lock(_connMutex);
-    auto it = _userConnMap.find(userid);
-    if (it != _userConnMap.end())
+    TcpConnectionPtr conn = _userConnMap.find(userid);
+    if (conn)
     {
-        it->second->send(msg);
+        // 按连接协商的格式编码，交给连接所属的I/O线程发送
+        ChatPayload payload(msg);
+        _dispatcher.deliver(conn, payload.encode(conn, 0), Timestamp::now());
         return;
     }
 
     // 如果在上报转发的过程中，toid用户下线了，则存储该用户的离线消息
-    _offlineMsgModel.insert(userid, msg);
-}
\ No newline at end of file
+    // 离线消息队列满时写入会阻塞，交给离线消息线程池，不阻塞订阅线程接收后续的消息
+    _dispatcher.runOffline([this, userid, msg]() { _offlineWriter.write(userid, msg); });
+}
+
+// 其他服务器上群组成员发生了变化，删除本地的群组成员缓存
+void ChatService::handleGroupCacheInvalidate(string msg)
+{
+    _groupCache.invalidate(atoi(msg.c_str()));
+}
+
+// 从本服务器的节点通道中收到其他服务器转发过来的消息
+// 在redis的订阅线程中调用，只拆信封、查在线用户表，发送和存储离线消息都交给分发器
+void ChatService::handleNodeMessage(string envelope)
+{
+    Timestamp received = Timestamp::now();
+    vector<Recipient> recipients;
+    string msg;
+    if (!parseEnvelope(envelope, recipients, msg))
+    {
+        LOG_ERROR << "invalid node message envelope!";
+        return;
+    }
+
+    if (recipients.size() == 1)
+    {
+        deliverNodeMessage(recipients[0].first, Inbox::withSeq(msg, recipients[0].second));
+        return;
+    }
+
+    // 群消息的信封中带有本服务器上的多个接收者，展开后逐个转发，每个接收者的消息中写入各自的序号
+    // 接收者已经下线的批量存储离线消息
+    unordered_map<int, long long> seqOf;
+    vector<int> userids;
+    userids.reserve(recipients.size());
+    for (const Recipient &recipient : recipients)
+    {
+        seqOf[recipient.first] = recipient.second;
+        userids.push_back(recipient.first);
+    }
+
+    vector<TcpConnectionPtr> conns;
+    vector<int> connIds;
+    vector<int> offlineIds;
+    _userConnMap.findAll(userids, conns, offlineIds, &connIds);
+
+    // 发给二进制连接的消息最多转换一次
+    ChatPayload payload(msg);
+    for (size_t i = 0; i < conns.size(); ++i)
+    {
+        _dispatcher.deliver(conns[i], payload.encode(conns[i], seqOf[connIds[i]]), received);
+    }
+    if (!offlineIds.empty())
+    {
+        vector<Recipient> offlineRecipients;
+        for (int userid : offlineIds)
+        {
+            offlineRecipients.emplace_back(userid, seqOf[userid]);
+        }
+        vector<OfflineMsgWriter::OfflineMsg> offlineMsgs = makeOfflineMsgs(offlineRecipients, msg);
+        _dispatcher.runOffline([this, offlineMsgs]() { _offlineWriter.write(offlineMsgs); });
+    }
+}
+
+// 向redis发布消息失败
+// string channel --- 通道名，string msg --- 发布失败的消息
+void ChatService::handleRedisPublishError(string channel, string msg)
+{
+    if (channel == GROUP_CACHE_CHANNEL)
+    {
+        // 缓存失效通知丢失，其他服务器的缓存会一直保留旧的成员列表，直到被LRU淘汰
+        LOG_ERROR << "publish group cache invalidation failed, groupid: " << msg;
+        return;
+    }
+    if (channel == Presence::CHANNEL)
+    {
+        // 在线状态变化的通知丢失，其他服务器的本地缓存在过期之后会重新查询
+        LOG_ERROR << "publish presence invalidation failed, userid: " << msg;
+        return;
+    }
+
+    // 发给其他服务器上用户的消息没有发出去，存为离线消息，用户下次登录时还能收到
+    vector<Recipient> recipients;
+    string payload;
+    // 在redis的发布线程中调用，存储离线消息同样交给线程池，不阻塞后续消息的发布
+    if (parseEnvelope(msg, recipients, payload))
+    {
+        vector<OfflineMsgWriter::OfflineMsg> offlineMsgs = makeOfflineMsgs(recipients, payload);
+        _dispatcher.runOffline([this, offlineMsgs]() { _offlineWriter.write(offlineMsgs); });
+    }
+}
+
+// 获取跨服务器消息分发的运行状态
+SubscribeDispatcher::Stats ChatService::dispatchStats()
+{
+    return _dispatcher.stats();
+}
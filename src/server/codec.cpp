@@ -0,0 +1,93 @@
+#include "codec.hpp"
+#include "public.hpp"
+#include <muduo/base/Logging.h>
+#include <arpa/inet.h>
+
+MessageCodec::MessageCodec(const FrameCallback &cb)
+    : _frameCallback(cb)
+{
+}
+
+// 一次性取出buffer中所有完整的消息，按顺序上报
+void MessageCodec::onMessage(const TcpConnectionPtr &conn, Buffer *buffer, Timestamp time)
+{
+    // 至少要有一个包头的长度，才能知道消息体有多长
+    while (buffer->readableBytes() >= MSG_HEADER_LEN)
+    {
+        // peekInt32只看不取，并且已经从网络字节序转换成了主机字节序
+        const int32_t len = buffer->peekInt32();
+        if (len < 0 || len > MSG_MAX_LEN)
+        {
+            // 长度非法，说明数据流已经错乱，无法再继续切分，直接断开连接
+            // shutdown只关闭写端，对方还能继续发送，数据会一直堆积在输入缓冲区里，所以强制关闭
+            LOG_ERROR << "invalid message length " << len << " from " << conn->name();
+            conn->forceClose();
+            break;
+        }
+        else if (buffer->readableBytes() >= MSG_HEADER_LEN + static_cast<size_t>(len))
+        {
+            // 一条消息已经完整到达，取走包头和消息体
+            buffer->retrieve(MSG_HEADER_LEN);
+            string message(buffer->peek(), len);
+            buffer->retrieve(len);
+            _frameCallback(conn, message, time);
+        }
+        else
+        {
+            // 半条消息，留在buffer中等待后续数据
+            break;
+        }
+    }
+}
+
+// 给消息加上包头后发送
+void MessageCodec::send(const TcpConnectionPtr &conn, const string &message)
+{
+    Buffer buf;
+    buf.append(message.data(), message.size());
+    // Buffer前面预留了8个字节，prependInt32会转换成网络字节序后写到消息体前面，不需要额外拷贝
+    buf.prependInt32(static_cast<int32_t>(message.size()));
+    conn->send(&buf);
+}
+
+// 发送由head和data两段拼成的一条消息
+void MessageCodec::send(const TcpConnectionPtr &conn, const string &head, const char *data, size_t len)
+{
+    Buffer buf;
+    buf.ensureWritableBytes(head.size() + len);
+    buf.append(head.data(), head.size());
+    buf.append(data, len);
+    buf.prependInt32(static_cast<int32_t>(head.size() + len));
+    conn->send(&buf);
+}
+
+// 发送已经写在buf中的消息体
+void MessageCodec::send(const TcpConnectionPtr &conn, Buffer *buf)
+{
+    buf->prependInt32(static_cast<int32_t>(buf->readableBytes()));
+    conn->send(buf);
+}
+
+// 给消息加上包头，编码成可以共享的消息帧
+MessageCodec::FramePtr MessageCodec::encode(const string &message)
+{
+    return encode(string(), message.data(), message.size());
+}
+
+// 把head和data两段拼成一条消息，编码成可以共享的消息帧
+MessageCodec::FramePtr MessageCodec::encode(const string &head, const char *data, size_t len)
+{
+    uint32_t header = htonl(static_cast<uint32_t>(head.size() + len));
+    string frame;
+    frame.reserve(MSG_HEADER_LEN + head.size() + len);
+    frame.append(reinterpret_cast<const char *>(&header), MSG_HEADER_LEN);
+    frame.append(head);
+    frame.append(data, len);
+    return make_shared<const string>(std::move(frame));
+}
+
+// 发送已经编码好的消息帧
+void MessageCodec::send(const TcpConnectionPtr &conn, const FramePtr &frame)
+{
+    conn->send(frame->data(), static_cast<int>(frame->size()));
+}
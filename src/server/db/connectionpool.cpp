@@ -0,0 +1,171 @@
+#include "connectionpool.hpp"
+#include <muduo/base/Logging.h>
+#include <vector>
+
+// 连接池配置信息
+static int initSize = 4;             // 初始连接数
+static int maxSize = 32;             // 最大连接数
+static int maxIdleTime = 60 * 1000;  // 连接最大空闲时间(毫秒)
+static int connectionTimeout = 1000; // 获取连接的最大等待时间(毫秒)
+static int pingIdleTime = 5 * 1000;  // 空闲超过该时间的连接，复用前先ping
+
+// 获取连接池单例对象的接口函数
+ConnectionPool *ConnectionPool::instance()
+{
+    // 局部静态变量的初始化是线程安全的
+    static ConnectionPool pool;
+    return &pool;
+}
+
+// 创建初始连接，并启动回收空闲连接的线程
+ConnectionPool::ConnectionPool()
+    : _initSize(initSize), _maxSize(maxSize), _maxIdleTime(maxIdleTime),
+      _connectionTimeout(connectionTimeout), _pingIdleTime(pingIdleTime),
+      _connectionCnt(0), _isClosed(false)
+{
+    for (int i = 0; i < _initSize; ++i)
+    {
+        MySQL *conn = new MySQL();
+        if (!conn->connect())
+        {
+            // 数据库暂时连不上，剩下的连接在使用时再按需创建
+            delete conn;
+            break;
+        }
+        conn->refreshAliveTime();
+        _connectionQue.push_back(conn);
+        ++_connectionCnt;
+    }
+
+    _scannerThread = thread(&ConnectionPool::scannerConnectionTask, this);
+}
+
+// 关闭连接池，释放所有空闲连接
+ConnectionPool::~ConnectionPool()
+{
+    {
+        lock_guard<mutex> lock(_queueMutex);
+        _isClosed = true;
+    }
+    _cv.notify_all();
+    _scannerCv.notify_one();
+    _scannerThread.join();
+
+    for (MySQL *conn : _connectionQue)
+    {
+        delete conn;
+    }
+    _connectionQue.clear();
+}
+
+// 从连接池中获取一个可用连接
+shared_ptr<MySQL> ConnectionPool::getConnection()
+{
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(_connectionTimeout);
+
+    unique_lock<mutex> lock(_queueMutex);
+    for (;;)
+    {
+        // 1. 有空闲连接，直接复用最近归还的那一个
+        if (!_connectionQue.empty())
+        {
+            MySQL *conn = _connectionQue.back();
+            _connectionQue.pop_back();
+
+            // ping是一次网络往返，不在锁里做
+            lock.unlock();
+            if (conn->getIdleTime() < _pingIdleTime || conn->ping())
+            {
+                return wrapConnection(conn);
+            }
+
+            // 连接已经失效(比如被mysql server超时断开)，丢弃后重新获取
+            LOG_INFO << "drop dead mysql connection";
+            delete conn;
+            lock.lock();
+            --_connectionCnt;
+            continue;
+        }
+
+        // 2. 没有空闲连接，但还没到上限，新建一个连接
+        if (_connectionCnt < _maxSize)
+        {
+            // 先占住名额再解锁建立连接，建立连接比较慢，不能阻塞其他线程归还和获取连接
+            ++_connectionCnt;
+            lock.unlock();
+
+            MySQL *conn = new MySQL();
+            if (conn->connect())
+            {
+                return wrapConnection(conn);
+            }
+
+            // 数据库连不上，直接返回失败，不再等待
+            delete conn;
+            lock.lock();
+            --_connectionCnt;
+            _cv.notify_one();
+            return nullptr;
+        }
+
+        // 3. 连接数已经到上限，等待其他线程归还连接，最多等到deadline
+        if (_cv.wait_until(lock, deadline) == cv_status::timeout &&
+            _connectionQue.empty() && _connectionCnt >= _maxSize)
+        {
+            LOG_ERROR << "get mysql connection timeout!";
+            return nullptr;
+        }
+    }
+}
+
+// 把连接包装成归还式的智能指针
+shared_ptr<MySQL> ConnectionPool::wrapConnection(MySQL *conn)
+{
+    // 自定义删除器：智能指针析构时，把连接归还到连接池，而不是关闭连接
+    return shared_ptr<MySQL>(conn, [this](MySQL *p) {
+        unique_lock<mutex> lock(_queueMutex);
+        if (_isClosed)
+        {
+            // 连接池已经关闭，直接释放连接
+            lock.unlock();
+            delete p;
+            return;
+        }
+        p->refreshAliveTime();
+        _connectionQue.push_back(p);
+        lock.unlock();
+        _cv.notify_one();
+    });
+}
+
+// 运行在独立线程中，定期回收空闲时间超过_maxIdleTime的多余连接
+void ConnectionPool::scannerConnectionTask()
+{
+    unique_lock<mutex> lock(_queueMutex);
+    while (!_isClosed)
+    {
+        _scannerCv.wait_for(lock, chrono::milliseconds(_maxIdleTime / 2));
+        if (_isClosed)
+        {
+            break;
+        }
+
+        // 队列头部是空闲最久的连接，只回收超过初始连接数的部分
+        vector<MySQL *> idleConns;
+        while (_connectionCnt > _initSize && !_connectionQue.empty() &&
+               _connectionQue.front()->getIdleTime() >= _maxIdleTime)
+        {
+            idleConns.push_back(_connectionQue.front());
+            _connectionQue.pop_front();
+            --_connectionCnt;
+        }
+
+        // 关闭连接会给mysql server发送QUIT，不在锁里做
+        lock.unlock();
+        for (MySQL *conn : idleConns)
+        {
+            delete conn;
+        }
+        lock.lock();
+    }
+}
@@ -13,10 +13,13 @@ MySQL::MySQL()
 {
     // 这里不是连接初始化，只是开辟了一块存储连接数据的资源空间。
     _conn = mysql_init(nullptr);
+    _aliveTime = chrono::steady_clock::now();
 }
 // 释放数据库连接资源
 MySQL::~MySQL()
 {
+    // 预处理语句依赖连接，必须在关闭连接之前释放
+    _stmtCache.clear();
     // 将构造函数中开辟的空间释放掉了
     if (_conn != nullptr)
         mysql_close(_conn);
@@ -74,4 +77,42 @@ MYSQL_RES *MySQL::query(string sql)
 MYSQL* MySQL::getConnection()
 {
     return _conn;
-}
\ No newline at end of file
+}
+
+// 获取sql对应的预处理语句
+Statement *MySQL::prepare(const string &sql)
+{
+    auto it = _stmtCache.find(sql);
+    if (it != _stmtCache.end())
+    {
+        return it->second.get();
+    }
+
+    unique_ptr<Statement> stmt(new Statement(_conn, sql));
+    if (!stmt->prepare())
+    {
+        return nullptr;
+    }
+    Statement *p = stmt.get();
+    _stmtCache.insert({sql, std::move(stmt)});
+    return p;
+}
+
+// 检查连接是否还活着
+bool MySQL::ping()
+{
+    // mysql_ping返回0表示连接正常，否则连接已经断开(例如被mysql server的wait_timeout回收)
+    return mysql_ping(_conn) == 0;
+}
+
+// 刷新连接进入空闲状态的起始时间
+void MySQL::refreshAliveTime()
+{
+    _aliveTime = chrono::steady_clock::now();
+}
+
+// 获取连接已经空闲的时长(毫秒)
+long MySQL::getIdleTime() const
+{
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - _aliveTime).count();
+}
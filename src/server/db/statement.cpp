@@ -0,0 +1,190 @@
+#include "statement.hpp"
+#include <muduo/base/Logging.h>
+#include <cstdlib>
+#include <cstring>
+
+// 结果列缓冲区的初始大小，超出时按实际长度扩容
+static const unsigned long kInitResultBufferSize = 256;
+
+Statement::Statement(MYSQL *conn, const string &sql)
+    : _stmt(mysql_stmt_init(conn)), _sql(sql)
+{
+}
+
+Statement::~Statement()
+{
+    if (_stmt != nullptr)
+        mysql_stmt_close(_stmt);
+}
+
+// 预处理sql语句
+bool Statement::prepare()
+{
+    if (_stmt == nullptr || mysql_stmt_prepare(_stmt, _sql.c_str(), _sql.size()))
+    {
+        LOG_INFO << __FILE__ << ":" << __LINE__ << ":"
+                 << _sql << "预处理失败!" << (_stmt != nullptr ? mysql_stmt_error(_stmt) : "");
+        return false;
+    }
+
+    // 按参数个数分配参数绑定需要的空间
+    size_t paramCount = mysql_stmt_param_count(_stmt);
+    _params.assign(paramCount, MYSQL_BIND());
+    _intParams.assign(paramCount, 0);
+    _longParams.assign(paramCount, 0);
+    _strParams.assign(paramCount, string());
+    _paramLengths.assign(paramCount, 0);
+
+    // 按结果列数分配结果绑定需要的空间
+    size_t fieldCount = mysql_stmt_field_count(_stmt);
+    _results.assign(fieldCount, MYSQL_BIND());
+    _resultBuffers.assign(fieldCount, string(kInitResultBufferSize, '\0'));
+    _resultLengths.assign(fieldCount, 0);
+    _resultNulls.reset(new MysqlBool[fieldCount]());
+    for (size_t i = 0; i < fieldCount; ++i)
+    {
+        MYSQL_BIND &bind = _results[i];
+        bind.buffer_type = MYSQL_TYPE_STRING;
+        bind.buffer = &_resultBuffers[i][0];
+        bind.buffer_length = _resultBuffers[i].size();
+        bind.length = &_resultLengths[i];
+        bind.is_null = &_resultNulls[i];
+    }
+    return true;
+}
+
+// 绑定int参数
+void Statement::bind(int idx, int value)
+{
+    _intParams[idx] = value;
+
+    MYSQL_BIND &bind = _params[idx];
+    memset(&bind, 0, sizeof(bind));
+    bind.buffer_type = MYSQL_TYPE_LONG;
+    bind.buffer = &_intParams[idx];
+}
+
+// 绑定64位整数参数
+void Statement::bind(int idx, long long value)
+{
+    _longParams[idx] = value;
+
+    MYSQL_BIND &bind = _params[idx];
+    memset(&bind, 0, sizeof(bind));
+    bind.buffer_type = MYSQL_TYPE_LONGLONG;
+    bind.buffer = &_longParams[idx];
+}
+
+// 绑定字符串参数
+void Statement::bind(int idx, const string &value)
+{
+    _strParams[idx] = value;
+    _paramLengths[idx] = value.size();
+
+    MYSQL_BIND &bind = _params[idx];
+    memset(&bind, 0, sizeof(bind));
+    bind.buffer_type = MYSQL_TYPE_STRING;
+    bind.buffer = const_cast<char *>(_strParams[idx].data());
+    bind.buffer_length = _strParams[idx].size();
+    bind.length = &_paramLengths[idx];
+}
+
+// 执行语句
+bool Statement::execute()
+{
+    // 丢弃上一次执行没有读完的结果集
+    mysql_stmt_free_result(_stmt);
+
+    if ((!_params.empty() && mysql_stmt_bind_param(_stmt, _params.data())) ||
+        mysql_stmt_execute(_stmt))
+    {
+        LOG_INFO << __FILE__ << ":" << __LINE__ << ":"
+                 << _sql << "执行失败!" << mysql_stmt_error(_stmt);
+        return false;
+    }
+
+    if (!_results.empty())
+    {
+        // 把结果集缓存到客户端，调用方可以只读一部分行，不影响这条连接执行下一条语句
+        if (mysql_stmt_bind_result(_stmt, _results.data()) || mysql_stmt_store_result(_stmt))
+        {
+            LOG_INFO << __FILE__ << ":" << __LINE__ << ":"
+                     << _sql << "获取结果失败!" << mysql_stmt_error(_stmt);
+            return false;
+        }
+    }
+    return true;
+}
+
+// 取下一行结果
+bool Statement::fetch()
+{
+    int ret = mysql_stmt_fetch(_stmt);
+    if (ret == MYSQL_DATA_TRUNCATED)
+    {
+        // 有列的数据比缓冲区长，把缓冲区扩容到实际长度后，重新读取这一列
+        bool rebind = false;
+        for (size_t i = 0; i < _results.size(); ++i)
+        {
+            if (_resultLengths[i] <= _resultBuffers[i].size())
+            {
+                continue;
+            }
+            _resultBuffers[i].resize(_resultLengths[i]);
+            _results[i].buffer = &_resultBuffers[i][0];
+            _results[i].buffer_length = _resultBuffers[i].size();
+            mysql_stmt_fetch_column(_stmt, &_results[i], i, 0);
+            rebind = true;
+        }
+        // 缓冲区地址变了，后续的行要用新的缓冲区接收
+        if (rebind)
+        {
+            mysql_stmt_bind_result(_stmt, _results.data());
+        }
+        return true;
+    }
+    return ret == 0;
+}
+
+// 读取当前行第col列的int值
+int Statement::getInt(int col) const
+{
+    if (_resultNulls[col])
+    {
+        return 0;
+    }
+    return atoi(getString(col).c_str());
+}
+
+// 读取当前行第col列的64位整数值
+long long Statement::getLongLong(int col) const
+{
+    if (_resultNulls[col])
+    {
+        return 0;
+    }
+    return atoll(getString(col).c_str());
+}
+
+// 读取当前行第col列的字符串值
+string Statement::getString(int col) const
+{
+    if (_resultNulls[col])
+    {
+        return string();
+    }
+    unsigned long len = _resultLengths[col] < _resultBuffers[col].size() ? _resultLengths[col] : _resultBuffers[col].size();
+    return string(_resultBuffers[col].data(), len);
+}
+
+// 上一次执行insert语句生成的自增id
+int Statement::insertId()
+{
+    return mysql_stmt_insert_id(_stmt);
+}
+
+// 上一次执行影响的行数
+int Statement::affectedRows()
+{
+    return mysql_stmt_affected_rows(_stmt);
+}
@@ -0,0 +1,80 @@
+#include "dispatcher.hpp"
+#include <muduo/net/EventLoop.h>
+#include <unistd.h>
+
+SubscribeDispatcher::SubscribeDispatcher(int threadNum, int maxQueueSize)
+    : _offlinePool("OfflinePool"), _stopped(false), _loopPending(0), _delivered(0), _lagSumUs(0), _lagMaxUs(0)
+{
+    _offlinePool.setMaxQueueSize(maxQueueSize);
+    _offlinePool.start(threadNum);
+}
+
+SubscribeDispatcher::~SubscribeDispatcher()
+{
+    stop();
+}
+
+// 等线程池中排队的任务执行完，再停止线程池
+void SubscribeDispatcher::stop()
+{
+    if (_stopped.exchange(true))
+    {
+        return;
+    }
+    // muduo的线程池停止时会丢弃还在排队的任务，离线消息不能丢，先等队列取空
+    // 正在执行的任务在stop中join线程时执行完
+    while (_offlinePool.queueSize() > 0)
+    {
+        usleep(1000);
+    }
+    _offlinePool.stop();
+}
+
+// 把消息帧投递到连接所属的EventLoop中发送
+void SubscribeDispatcher::deliver(const TcpConnectionPtr &conn, const MessageCodec::FramePtr &frame, Timestamp received)
+{
+    ++_loopPending;
+    // 在其他线程中直接调用TcpConnection::send，muduo会把消息拷贝一份再投递到I/O线程
+    // 这里投递的是共享的消息帧，在I/O线程中发送时才拷贝进连接的输出缓冲区
+    conn->getLoop()->queueInLoop([this, conn, frame, received]() {
+        MessageCodec::send(conn, frame);
+        --_loopPending;
+        recordLag(received);
+    });
+}
+
+// 在离线消息线程池中执行task
+void SubscribeDispatcher::runOffline(function<void()> task)
+{
+    if (_stopped)
+    {
+        task();
+        return;
+    }
+    _offlinePool.run(std::move(task));
+}
+
+// 获取运行状态，并重新开始统计延迟
+SubscribeDispatcher::Stats SubscribeDispatcher::stats()
+{
+    Stats result;
+    result.loopPending = _loopPending.load();
+    result.offlinePending = _offlinePool.queueSize();
+    result.delivered = _delivered.exchange(0);
+    long lagSum = _lagSumUs.exchange(0);
+    result.avgLagUs = result.delivered > 0 ? lagSum / result.delivered : 0;
+    result.maxLagUs = _lagMaxUs.exchange(0);
+    return result;
+}
+
+// 消息在EventLoop中发送后，记录延迟
+void SubscribeDispatcher::recordLag(Timestamp received)
+{
+    long lag = static_cast<long>(Timestamp::now().microSecondsSinceEpoch() - received.microSecondsSinceEpoch());
+    ++_delivered;
+    _lagSumUs += lag;
+    long max = _lagMaxUs.load();
+    while (lag > max && !_lagMaxUs.compare_exchange_weak(max, lag))
+    {
+    }
+}
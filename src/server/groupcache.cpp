@@ -0,0 +1,133 @@
+#include "groupcache.hpp"
+#include <algorithm>
+
+GroupCache::GroupCache(const Loader &loader, size_t maxMembers)
+    : _loader(loader), _maxMembers(maxMembers), _memberCount(0)
+{
+}
+
+// 获取群组的所有成员，不在缓存中则从数据库加载
+GroupCache::MemberList GroupCache::getMembers(int groupid)
+{
+    unsigned long generation;
+    {
+        lock_guard<mutex> lock(_mutex);
+        auto it = _groupMap.find(groupid);
+        if (it != _groupMap.end())
+        {
+            // 命中，移动到LRU链表头部
+            _lruList.splice(_lruList.begin(), _lruList, it->second.lruIt);
+            return it->second.members;
+        }
+        Loading &loading = _loading[groupid];
+        ++loading.loaders;
+        generation = loading.generation;
+    }
+
+    // 查数据库比较慢，不在锁里做
+    vector<int> ids;
+    bool loaded = _loader(groupid, ids);
+    sort(ids.begin(), ids.end());
+    MemberList members = make_shared<const vector<int>>(std::move(ids));
+
+    lock_guard<mutex> lock(_mutex);
+    auto it = _loading.find(groupid);
+    // 加载失败(例如mysql连接池超时)的空列表不能缓存，否则这个群的消息会一直发不出去，直到被淘汰
+    // 加载期间该群组没有发生过变化，加载的结果才是可信的
+    if (loaded && it->second.generation == generation)
+    {
+        putLocked(groupid, members);
+    }
+    if (--it->second.loaders == 0)
+    {
+        _loading.erase(it);
+    }
+    return members;
+}
+
+// 用户加入了群组
+void GroupCache::addMember(int groupid, int userid)
+{
+    lock_guard<mutex> lock(_mutex);
+    bumpLocked(groupid);
+    auto it = _groupMap.find(groupid);
+    if (it == _groupMap.end())
+    {
+        return;
+    }
+
+    const vector<int> &old = *it->second.members;
+    auto pos = lower_bound(old.begin(), old.end(), userid);
+    if (pos != old.end() && *pos == userid)
+    {
+        return;
+    }
+
+    // 拷贝一份新的列表替换旧列表，正在使用旧列表的线程不受影响
+    vector<int> ids;
+    ids.reserve(old.size() + 1);
+    ids.insert(ids.end(), old.begin(), pos);
+    ids.push_back(userid);
+    ids.insert(ids.end(), pos, old.end());
+    putLocked(groupid, make_shared<const vector<int>>(std::move(ids)));
+}
+
+// 新建了群组，直接以已知的成员列表放入缓存
+void GroupCache::putGroup(int groupid, vector<int> members)
+{
+    sort(members.begin(), members.end());
+    lock_guard<mutex> lock(_mutex);
+    bumpLocked(groupid);
+    putLocked(groupid, make_shared<const vector<int>>(std::move(members)));
+}
+
+// 删除本地缓存
+void GroupCache::invalidate(int groupid)
+{
+    lock_guard<mutex> lock(_mutex);
+    bumpLocked(groupid);
+    auto it = _groupMap.find(groupid);
+    if (it != _groupMap.end())
+    {
+        _memberCount -= it->second.members->size();
+        _lruList.erase(it->second.lruIt);
+        _groupMap.erase(it);
+    }
+}
+
+// 群组成员发生了变化，作废正在进行的加载
+void GroupCache::bumpLocked(int groupid)
+{
+    auto it = _loading.find(groupid);
+    if (it != _loading.end())
+    {
+        ++it->second.generation;
+    }
+}
+
+// 放入或替换一个群组的成员列表，并淘汰超出上限的部分
+void GroupCache::putLocked(int groupid, const MemberList &members)
+{
+    auto it = _groupMap.find(groupid);
+    if (it != _groupMap.end())
+    {
+        _memberCount -= it->second.members->size();
+        it->second.members = members;
+        _lruList.splice(_lruList.begin(), _lruList, it->second.lruIt);
+    }
+    else
+    {
+        _lruList.push_front(groupid);
+        _groupMap.insert({groupid, Entry{members, _lruList.begin()}});
+    }
+    _memberCount += members->size();
+
+    // 从尾部淘汰最久没用到的群组，刚放入的群组至少保留下来
+    while (_memberCount > _maxMembers && _lruList.size() > 1)
+    {
+        auto victim = _groupMap.find(_lruList.back());
+        _memberCount -= victim->second.members->size();
+        _groupMap.erase(victim);
+        _lruList.pop_back();
+    }
+}
@@ -0,0 +1,200 @@
+#include "inbox.hpp"
+#include <cstdlib>
+#include <cstring>
+
+// 记录每个用户当前最大序号的redis哈希表，字段是用户id
+static const string SEQ_KEY = "chat:seq";
+// 收件箱最多保留的消息条数
+static const int INBOX_MAX_SIZE = 1000;
+// 收件箱的过期时间，7天没有新消息就删除
+static const int INBOX_TTL_SECONDS = 7 * 24 * 3600;
+// 序号字段的前缀，withSeq和lua脚本中的写法要保持一致
+static const char SEQ_PREFIX[] = "{\"seq\":";
+// 分配共享消息编号的计数器
+static const string MSG_ID_KEY = "chat:msgid";
+// 每次从redis取一段编号，本服务器在本地逐个使用，用完再取，不需要每条消息都多一次redis往返
+static const long long MSG_ID_BLOCK = 1000;
+// 收件箱中引用共享消息的成员以它开头，后面是消息编号；直接存放的消息以'{'开头
+static const char REF_PREFIX = '#';
+
+// 只有一个接收者时，分配序号并把带序号的消息直接放入收件箱的lua脚本
+// KEYS[1]是SEQ_KEY，之后是接收者的收件箱key
+// ARGV[1]是去掉开头'{'的消息，ARGV[2]是收件箱最大条数，ARGV[3]是过期时间，之后是接收者的用户id，和收件箱key一一对应
+static const string APPEND_SCRIPT =
+    "local body, max, ttl = ARGV[1], tonumber(ARGV[2]), tonumber(ARGV[3]) "
+    "local seqs = {} "
+    "for i = 2, #KEYS do "
+    "  local seq = redis.call('hincrby', KEYS[1], ARGV[i + 2], 1) "
+    "  redis.call('zadd', KEYS[i], seq, '{\"seq\":' .. seq .. ',' .. body) "
+    "  redis.call('zremrangebyrank', KEYS[i], 0, -max - 1) "
+    "  redis.call('expire', KEYS[i], ttl) "
+    "  seqs[#seqs + 1] = seq "
+    "end "
+    "return seqs";
+
+// 多个接收者(群聊)时，消息只存一份，收件箱中只放消息的引用，所有接收者在redis server上一次执行完
+// 原来每个接收者的收件箱都存一份完整的消息，500人的群每条消息要写500份
+// KEYS[1]是SEQ_KEY，KEYS[2]是共享消息的key，之后是每个接收者的收件箱key
+// ARGV[1]是完整的消息，ARGV[2]是收件箱最大条数，ARGV[3]是过期时间，ARGV[4]是收件箱中的引用，
+// 之后是接收者的用户id，和收件箱key一一对应
+static const string APPEND_SHARED_SCRIPT =
+    "local body, max, ttl, ref = ARGV[1], tonumber(ARGV[2]), tonumber(ARGV[3]), ARGV[4] "
+    "redis.call('set', KEYS[2], body, 'EX', ttl) "
+    "local seqs = {} "
+    "for i = 3, #KEYS do "
+    "  local seq = redis.call('hincrby', KEYS[1], ARGV[i + 2], 1) "
+    "  redis.call('zadd', KEYS[i], seq, ref) "
+    "  redis.call('zremrangebyrank', KEYS[i], 0, -max - 1) "
+    "  redis.call('expire', KEYS[i], ttl) "
+    "  seqs[#seqs + 1] = seq "
+    "end "
+    "return seqs";
+
+// 共享消息的key
+static string messageKey(const string &msgid)
+{
+    return "chat:msg:" + msgid;
+}
+
+// 用户的收件箱key
+static string inboxKey(int userid)
+{
+    return "chat:inbox:" + to_string(userid);
+}
+
+Inbox::Inbox(Redis &redis)
+    : _redis(redis), _nextId(0), _idEnd(0)
+{
+}
+
+// 分配一个集群中唯一的共享消息编号，出错返回0
+long long Inbox::nextMessageId()
+{
+    lock_guard<mutex> lock(_idMutex);
+    if (_nextId == _idEnd)
+    {
+        long long end = _redis.incrby(MSG_ID_KEY, MSG_ID_BLOCK);
+        if (end <= 0)
+        {
+            return 0;
+        }
+        _nextId = end - MSG_ID_BLOCK;
+        _idEnd = end;
+    }
+    return ++_nextId;
+}
+
+// 给每个接收者分配一个序号，并把带序号的消息放入收件箱
+vector<long long> Inbox::append(const vector<int> &userids, const string &payload)
+{
+    // 只有json对象才能加上序号字段
+    if (userids.empty() || payload.size() < 3 || payload[0] != '{')
+    {
+        return vector<long long>();
+    }
+
+    // 多个接收者时消息只存一份，分配不到编号时退回每个收件箱各存一份
+    long long msgid = userids.size() > 1 ? nextMessageId() : 0;
+
+    vector<string> keys;
+    keys.reserve(userids.size() + 2);
+    keys.push_back(SEQ_KEY);
+    vector<string> args;
+    args.reserve(userids.size() + 4);
+    if (msgid != 0)
+    {
+        string id = to_string(msgid);
+        keys.push_back(messageKey(id));
+        args.push_back(payload);
+        args.push_back(to_string(INBOX_MAX_SIZE));
+        args.push_back(to_string(INBOX_TTL_SECONDS));
+        args.push_back(REF_PREFIX + id);
+    }
+    else
+    {
+        args.push_back(payload.substr(1));
+        args.push_back(to_string(INBOX_MAX_SIZE));
+        args.push_back(to_string(INBOX_TTL_SECONDS));
+    }
+    for (int userid : userids)
+    {
+        keys.push_back(inboxKey(userid));
+        args.push_back(to_string(userid));
+    }
+
+    vector<long long> seqs = _redis.eval_integers(msgid != 0 ? APPEND_SHARED_SCRIPT : APPEND_SCRIPT, keys, args);
+    if (seqs.size() != userids.size())
+    {
+        seqs.clear();
+    }
+    return seqs;
+}
+
+// 获取用户收件箱中序号大于afterSeq的消息
+vector<pair<long long, string>> Inbox::query(int userid, long long afterSeq, int count)
+{
+    vector<pair<string, long long>> members =
+        _redis.zrangebyscore_withscores(inboxKey(userid), "(" + to_string(afterSeq), "+inf", count);
+
+    // 引用共享消息的成员，一次取回所有被引用的消息
+    vector<string> refKeys;
+    for (const auto &member : members)
+    {
+        if (!member.first.empty() && member.first[0] == REF_PREFIX)
+        {
+            refKeys.push_back(messageKey(member.first.substr(1)));
+        }
+    }
+    vector<string> bodies = _redis.mget(refKeys);
+
+    vector<pair<long long, string>> msgs;
+    msgs.reserve(members.size());
+    size_t ref = 0;
+    for (auto &member : members)
+    {
+        if (!member.first.empty() && member.first[0] == REF_PREFIX)
+        {
+            // 共享消息已经过期时是空串
+            const string &body = bodies[ref++];
+            msgs.emplace_back(member.second, body.empty() ? string() : withSeq(body, member.second));
+        }
+        else
+        {
+            msgs.emplace_back(member.second, std::move(member.first));
+        }
+    }
+    return msgs;
+}
+
+// 用户当前的最大序号
+long long Inbox::currentSeq(int userid)
+{
+    return atoll(_redis.hget(SEQ_KEY, to_string(userid)).c_str());
+}
+
+// 在json对象消息的最前面加上序号字段
+string Inbox::withSeq(const string &payload, long long seq)
+{
+    string result;
+    size_t pos = seqHead(payload, seq, result);
+    result.append(payload, pos, string::npos);
+    return result;
+}
+
+// 生成带序号的消息开头，返回payload中接在后面的部分的起始位置
+size_t Inbox::seqHead(const string &payload, long long seq, string &head)
+{
+    head.clear();
+    if (seq == 0 || payload.size() < 2 || payload[0] != '{')
+    {
+        return 0;
+    }
+
+    head = SEQ_PREFIX + to_string(seq);
+    // 空对象"{}"后面没有其他字段，不需要逗号
+    if (payload[1] != '}')
+    {
+        head += ',';
+    }
+    return 1;
+}
@@ -0,0 +1,125 @@
+#include "jsonwriter.hpp"
+#include <charconv>
+
+// 从p开始的合法UTF-8字符的字节数，不合法(截断、过长编码、代理区、超过U+10FFFF)返回0
+static size_t utf8Length(const unsigned char *p, const unsigned char *end)
+{
+    unsigned char c = p[0];
+    size_t n;
+    if (c >= 0xC2 && c <= 0xDF)
+    {
+        n = 2;
+    }
+    else if (c >= 0xE0 && c <= 0xEF)
+    {
+        n = 3;
+    }
+    else if (c >= 0xF0 && c <= 0xF4)
+    {
+        n = 4;
+    }
+    else
+    {
+        return 0;
+    }
+    if (static_cast<size_t>(end - p) < n)
+    {
+        return 0;
+    }
+    for (size_t i = 1; i < n; ++i)
+    {
+        if ((p[i] & 0xC0) != 0x80)
+        {
+            return 0;
+        }
+    }
+    // 第二个字节的范围还受第一个字节限制
+    if ((c == 0xE0 && p[1] < 0xA0) || (c == 0xED && p[1] > 0x9F) ||
+        (c == 0xF0 && p[1] < 0x90) || (c == 0xF4 && p[1] > 0x8F))
+    {
+        return 0;
+    }
+    return n;
+}
+
+void JsonWriter::value(long long v)
+{
+    separator();
+    char buf[24];
+    char *end = to_chars(buf, buf + sizeof(buf), v).ptr;
+    _buf.append(buf, end - buf);
+    _needComma = true;
+}
+
+// 写入带引号、转义后的字符串
+// 不需要转义的字节攒成一段一起写入，只在需要转义的地方打断
+void JsonWriter::writeString(const char *data, size_t len)
+{
+    static const char HEX[] = "0123456789abcdef";
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+    const unsigned char *end = p + len;
+    // 还没有写入的一段普通字节的起点
+    const unsigned char *run = p;
+
+    _buf.append("\"", 1);
+    while (p < end)
+    {
+        unsigned char c = *p;
+        if (c >= 0x20 && c != '"' && c != '\\' && c < 0x80)
+        {
+            ++p;
+            continue;
+        }
+        if (c >= 0x80)
+        {
+            size_t n = utf8Length(p, end);
+            if (n > 0)
+            {
+                p += n;
+                continue;
+            }
+        }
+
+        _buf.append(run, p - run);
+        switch (c)
+        {
+        case '"':
+            _buf.append("\\\"", 2);
+            break;
+        case '\\':
+            _buf.append("\\\\", 2);
+            break;
+        case '\b':
+            _buf.append("\\b", 2);
+            break;
+        case '\f':
+            _buf.append("\\f", 2);
+            break;
+        case '\n':
+            _buf.append("\\n", 2);
+            break;
+        case '\r':
+            _buf.append("\\r", 2);
+            break;
+        case '\t':
+            _buf.append("\\t", 2);
+            break;
+        default:
+            if (c < 0x20)
+            {
+                char escaped[] = {'\\', 'u', '0', '0', HEX[c >> 4], HEX[c & 0xF]};
+                _buf.append(escaped, sizeof(escaped));
+            }
+            else
+            {
+                // 不合法的UTF-8字节，替换成U+FFFD
+                _buf.append("\xEF\xBF\xBD", 3);
+            }
+            break;
+        }
+        ++p;
+        run = p;
+    }
+    _buf.append(run, p - run);
+    _buf.append("\"", 1);
+}
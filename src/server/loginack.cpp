@@ -0,0 +1,115 @@
+#include "loginack.hpp"
+#include "jsonwriter.hpp"
+#include "public.hpp"
+
+// 写入数组中的一个元素
+// structured时直接写入对象；否则先把对象写入scratch，再把它作为一个字符串写入
+template <typename Fn>
+static void writeElement(JsonWriter &writer, bool structured, Buffer &scratch, Fn fn)
+{
+    if (structured)
+    {
+        fn(writer);
+        return;
+    }
+    JsonWriter inner(scratch);
+    fn(inner);
+    writer.value(scratch.peek(), scratch.readableBytes());
+    scratch.retrieveAll();
+}
+
+// 好友
+static void writeFriend(JsonWriter &writer, User &user)
+{
+    writer.beginObject();
+    writer.key("id");
+    writer.value(user.getId());
+    writer.key("name");
+    writer.value(user.getName());
+    writer.key("state");
+    writer.value(user.getState());
+    writer.endObject();
+}
+
+// 群成员，比好友多一个角色
+static void writeMember(JsonWriter &writer, GroupUser &user)
+{
+    writer.beginObject();
+    writer.key("id");
+    writer.value(user.getId());
+    writer.key("name");
+    writer.value(user.getName());
+    writer.key("state");
+    writer.value(user.getState());
+    writer.key("role");
+    writer.value(user.getRole());
+    writer.endObject();
+}
+
+// 群组和它的成员，memberScratch用于兼容格式中成员的字符串
+static void writeGroup(JsonWriter &writer, Group &group, bool structured, Buffer &memberScratch)
+{
+    writer.beginObject();
+    writer.key("id");
+    writer.value(group.getId());
+    writer.key("groupname");
+    writer.value(group.getName());
+    writer.key("groupdesc");
+    writer.value(group.getDesc());
+    writer.key("users");
+    writer.beginArray();
+    for (GroupUser &user : group.getUsers())
+    {
+        writeElement(writer, structured, memberScratch, [&](JsonWriter &w) { writeMember(w, user); });
+    }
+    writer.endArray();
+    writer.endObject();
+}
+
+// 把登录成功的响应写入buf
+void LoginAck::write(Buffer &buf, User &user, long long seq, vector<User> &friends, vector<Group> &groups,
+                     bool structured)
+{
+    // 兼容格式中元素的字符串先写在这里，结构化格式用不到
+    Buffer scratch;
+    Buffer memberScratch;
+
+    JsonWriter writer(buf);
+    writer.beginObject();
+    writer.key("msgid");
+    writer.value(LOGIN_MSG_ACK);
+    // errno = 0，表示响应成功，没有出错
+    writer.key("errno");
+    writer.value(0);
+    writer.key("id");
+    writer.value(user.getId());
+    writer.key("name");
+    writer.value(user.getName());
+    // 用户当前的最大消息序号，客户端以此为起点判断之后的消息有没有缺失
+    writer.key("seq");
+    writer.value(seq);
+
+    if (!friends.empty())
+    {
+        writer.key("friends");
+        writer.beginArray();
+        for (User &f : friends)
+        {
+            writeElement(writer, structured, scratch, [&](JsonWriter &w) { writeFriend(w, f); });
+        }
+        writer.endArray();
+    }
+
+    if (!groups.empty())
+    {
+        writer.key("groups");
+        writer.beginArray();
+        for (Group &group : groups)
+        {
+            writeElement(writer, structured, scratch,
+                         [&](JsonWriter &w) { writeGroup(w, group, structured, memberScratch); });
+        }
+        writer.endArray();
+    }
+    writer.endObject();
+}
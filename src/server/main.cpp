@@ -1,5 +1,6 @@
 #include "chatserver.hpp"
 #include "chatservice.hpp"
+#include <muduo/base/Logging.h>
 #include <iostream>
 #include <signal.h>
 using namespace std;
@@ -28,10 +29,25 @@ int main(int argc, char **argv){
     // 准备捕捉或屏蔽的信号由参数signum给出，接收到指定信号时将要调用的函数有handler给出
     signal(SIGINT, resetHandler);
 
+    // 以ip:port作为本服务器在集群中的节点id，订阅本服务器的节点通道
+    ChatService::instance()->initNode(string(ip) + ":" + to_string(port));
+
     EventLoop loop;
     InetAddress addr(ip, port); // 固定要连接的IP地址和端口号
     ChatServer server(&loop, addr, "ChatServer");
 
+    // 定期打印跨服务器消息分发的队列积压和延迟，方便观察订阅线程是否跟得上
+    // 以及业务线程池中积压的任务数，方便观察业务线程是否跟得上
+    loop.runEvery(10.0, [&server]() {
+        SubscribeDispatcher::Stats stats = ChatService::instance()->dispatchStats();
+        LOG_INFO << "dispatch loopPending=" << stats.loopPending
+                 << " offlinePending=" << stats.offlinePending
+                 << " delivered=" << stats.delivered
+                 << " avgLagUs=" << stats.avgLagUs
+                 << " maxLagUs=" << stats.maxLagUs
+                 << " workerPending=" << server.pendingTasks();
+    });
+
     server.start();
     loop.loop(); // epoll_wait以阻塞方式等待新用户连接，已连接用户的读写事件等
 
@@ -1,22 +1,19 @@
 #include "groupmodel.hpp"
-#include "db.h"
+#include "connectionpool.hpp"
+#include <unordered_map>
 
 // 创建群组
 bool GroupModel::createGroup(Group &group)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "insert into allgroup(groupname, groupdesc) values('%s', '%s')",
-            group.getName().c_str(), group.getDesc().c_str());
-
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
     {
-        if (mysql.update(sql))
+        // 1.获取预处理语句，参数用?占位，执行时按类型绑定
+        Statement *stmt = mysql->prepare("insert into allgroup(groupname, groupdesc) values(?, ?)");
+        if (stmt != nullptr && stmt->execute(group.getName(), group.getDesc()))
         {
-            // uint64_t mysql_insert_id(MYSQL* mysql)
-            // 返回给定的 connection 中上一步 INSERT 查询中产生的 AUTO_INCREMENT 的 ID 号。
-            group.setId(mysql_insert_id(mysql.getConnection()));
+            // 返回上一步 INSERT 语句中产生的 AUTO_INCREMENT 的 ID 号。
+            group.setId(stmt->insertId());
             return true;
         }
     }
@@ -27,15 +24,14 @@ bool GroupModel::createGroup(Group &group)
 // 加入群组
 void GroupModel::addGroup(int userid, int groupid, string role)
 {
-    // 1.组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "insert into groupuser values(%d, %d, '%s')",
-            groupid, userid, role.c_str());
-
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
     {
-        mysql.update(sql);
+        Statement *stmt = mysql->prepare("insert into groupuser values(?, ?, ?)");
+        if (stmt != nullptr)
+        {
+            stmt->execute(groupid, userid, role);
+        }
     }
 }
 
@@ -43,60 +39,49 @@ void GroupModel::addGroup(int userid, int groupid, string role)
 vector<Group> GroupModel::queryGroups(int userid)
 {
     /*
-    1. 先根据userid在groupuser表中查询出该用户所属的群组信息
-    2. 在根据群组信息，查询属于该群组的所有用户的userid，并且和user表进行多表联合查询，查出用户的详细信息
+    一条联合查询同时查出userid所在的所有群组，以及这些群组的所有成员：
+    b - userid所在群组的关系，a - 群组信息，d - 这些群组的所有成员关系，c - 成员的用户信息
+    每一行是(群组, 成员)，在内存中按群组id归并到同一个Group里
+    原来是先查群组，再对每个群组各查一次成员，用户加入多少个群组，登录时就要多多少次数据库往返
     */
-    char sql[1024] = {0};
-    sprintf(sql, "select a.id,a.groupname,a.groupdesc from allgroup a inner join \
-         groupuser b on a.id = b.groupid where b.userid=%d",
-            userid);
-
     vector<Group> groupVec;
 
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql == nullptr)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
-        {
-            MYSQL_ROW row;
-            // 查出userid所有的群组信息
-            // mysql_fetch_row --- 每一次mysql_fetch_row()都获得当前行数据库，并赋值给数组row，然后自动滑向下一行；
-            // 在取出最后一行后，函数将返回false，循环结束。
-            while ((row = mysql_fetch_row(res)) != nullptr)
-            {
-                Group group;
-                group.setId(atoi(row[0]));
-                group.setName(row[1]);
-                group.setDesc(row[2]);
-                groupVec.push_back(group);
-            }
-            mysql_free_result(res);
-        }
+        return groupVec;
     }
 
-    // 查询群组的用户信息
-    for (Group &group : groupVec)
+    Statement *stmt = mysql->prepare("select a.id,a.groupname,a.groupdesc,c.id,c.name,c.state,d.grouprole "
+                                     "from groupuser b "
+                                     "inner join allgroup a on a.id = b.groupid "
+                                     "inner join groupuser d on d.groupid = b.groupid "
+                                     "inner join user c on c.id = d.userid "
+                                     "where b.userid = ?");
+    if (stmt == nullptr || !stmt->execute(userid))
     {
-        sprintf(sql, "select a.id,a.name,a.state,b.grouprole from user a \
-            inner join groupuser b on b.userid = a.id where b.groupid=%d",
-                group.getId());
+        return groupVec;
+    }
 
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+    // 群组id -> 在groupVec中的下标
+    unordered_map<int, size_t> groupIndex;
+    int groupid, id;
+    string groupname, groupdesc, name, state, role;
+    while (stmt->fetch(groupid, groupname, groupdesc, id, name, state, role))
+    {
+        auto it = groupIndex.find(groupid);
+        if (it == groupIndex.end())
         {
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
-            {
-                GroupUser user;
-                user.setId(atoi(row[0]));
-                user.setName(row[1]);
-                user.setState(row[2]);
-                user.setRole(row[3]);
-                group.getUsers().push_back(user);
-            }
-            mysql_free_result(res);
+            it = groupIndex.insert({groupid, groupVec.size()}).first;
+            groupVec.emplace_back(groupid, groupname, groupdesc);
         }
+
+        GroupUser user;
+        user.setId(id);
+        user.setName(name);
+        user.setState(state);
+        user.setRole(role);
+        groupVec[it->second].getUsers().push_back(user);
     }
     return groupVec;
 }
@@ -104,23 +89,41 @@ vector<Group> GroupModel::queryGroups(int userid)
 // 根据指定的groupid查询群组用户id列表，除userid自己，主要用户群聊业务给群组其它成员群发消息
 vector<int> GroupModel::queryGroupUsers(int userid, int groupid)
 {
-    char sql[1024] = {0};
-    sprintf(sql, "select userid from groupuser where groupid = %d and userid != %d", groupid, userid);
-
     vector<int> idVec;
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        if (res != nullptr)
+        Statement *stmt = mysql->prepare("select userid from groupuser where groupid = ? and userid != ?");
+        if (stmt != nullptr && stmt->execute(groupid, userid))
         {
-            MYSQL_ROW row;
-            while ((row = mysql_fetch_row(res)) != nullptr)
+            int id;
+            while (stmt->fetch(id))
             {
-                idVec.push_back(atoi(row[0]));
+                idVec.push_back(id);
             }
-            mysql_free_result(res);
         }
     }
     return idVec;
-}
\ No newline at end of file
+}
+
+// 根据指定的groupid查询群组所有成员的id列表
+bool GroupModel::queryGroupMembers(int groupid, vector<int> &idVec)
+{
+    idVec.clear();
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql == nullptr)
+    {
+        return false;
+    }
+    Statement *stmt = mysql->prepare("select userid from groupuser where groupid = ?");
+    if (stmt == nullptr || !stmt->execute(groupid))
+    {
+        return false;
+    }
+    int id;
+    while (stmt->fetch(id))
+    {
+        idVec.push_back(id);
+    }
+    return true;
+}
@@ -1,63 +1,96 @@
 #include "offlinemessagemodel.hpp"
-#include <db.h>
+#include "connectionpool.hpp"
+#include <algorithm>
 
 // 存储用户的离线消息
-void OfflineMsgModel::insert(int userid, string msg)
+void OfflineMsgModel::insert(int userid, const string &msg)
 {
-    // 1 组装sql语句
-    // sql里面的其实就是要执行的sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "insert into offlinemessage values('%d', '%s')", userid, msg.c_str());
-
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
     {
-        mysql.update(sql);
+        // 消息内容作为参数绑定，不再受sql缓冲区长度的限制，也不需要转义
+        Statement *stmt = mysql->prepare("insert into offlinemessage(userid, message) values(?, ?)");
+        if (stmt != nullptr)
+        {
+            stmt->execute(userid, msg);
+        }
     }
 }
 
-// 删除用户的离线消息
-void OfflineMsgModel::remove(int userid)
+// 批量写入多条离线消息
+size_t OfflineMsgModel::insert(const vector<OfflineMsg> &msgs)
 {
-    // 1 组装sql语句
-    // sql里面的其实就是要执行的sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "delete from offlinemessage where userid=%d", userid);
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql == nullptr)
+    {
+        return 0;
+    }
 
-    MySQL mysql;
-    if (mysql.connect())
+    // 每次最多写BATCH_SIZE行，语句按行数预处理缓存，同一条连接上最多缓存BATCH_SIZE条
+    const size_t BATCH_SIZE = 64;
+    size_t written = 0;
+    while (written < msgs.size())
     {
-        mysql.update(sql);
+        size_t count = min(BATCH_SIZE, msgs.size() - written);
+        string sql = "insert into offlinemessage(userid, message) values(?, ?)";
+        for (size_t i = 1; i < count; ++i)
+        {
+            sql += ",(?, ?)";
+        }
+
+        Statement *stmt = mysql->prepare(sql);
+        if (stmt == nullptr)
+        {
+            break;
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            stmt->bind(2 * i, msgs[written + i].first);
+            stmt->bind(2 * i + 1, *msgs[written + i].second);
+        }
+        if (!stmt->execute())
+        {
+            break;
+        }
+        written += count;
     }
+    return written;
 }
 
-// 查询用户的离线消息
-vector<string> OfflineMsgModel::query(int userid)
+// 删除用户编号不大于id的离线消息
+void OfflineMsgModel::remove(int userid, long long id)
 {
-    // 1 组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "select message from offlinemessage where userid = %d", userid);
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
+    {
+        Statement *stmt = mysql->prepare("delete from offlinemessage where userid = ? and id <= ?");
+        if (stmt != nullptr)
+        {
+            stmt->execute(userid, id);
+        }
+    }
+}
 
-    vector<string> vec;
-    MySQL mysql;
-    if (mysql.connect())
+// 按编号从小到大查询用户编号大于afterId的离线消息，最多limit条
+vector<OfflineMsgModel::IdMsg> OfflineMsgModel::query(int userid, long long afterId, int limit)
+{
+    vector<IdMsg> vec;
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        // 如果res不为空，代表查成功
-        if (res != nullptr)
+        Statement *stmt = mysql->prepare("select id, message from offlinemessage "
+                                         "where userid = ? and id > ? order by id limit ?");
+        // 执行成功，代表查成功
+        if (stmt != nullptr && stmt->execute(userid, afterId, limit))
         {
-            // 把userid用户的所有离线消息放入vec中返回
-            MYSQL_ROW row;
-            // 进行查询，找到则放入vec
-            while ((row = mysql_fetch_row(res)) != nullptr)
+            long long id;
+            string msg;
+            while (stmt->fetch(id, msg))
             {
-                vec.emplace_back(row[0]);
+                vec.emplace_back(id, msg);
             }
-
-            mysql_free_result(res);
-            return vec;
         }
     }
     // 如果连接不成功，直接返回一个空的vec
     return vec;
-}
\ No newline at end of file
+}
@@ -1,25 +1,22 @@
 #include "usermodel.hpp"
-#include "db.h"
+#include "connectionpool.hpp"
 #include <iostream>
+#include <algorithm>
 using namespace std;
 
 // User表的增加方法
 bool UserModel::insert(User &user)
 {
-    // 1 组装sql语句
-    // sql里面的其实就是要执行的sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "insert into user(name, password, state) values('%s', '%s', '%s')",
-            user.getName().c_str(), user.getPwd().c_str(), user.getState().c_str());
-
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
     {
-        // 将sql更新到mysql中
-        if (mysql.update(sql))
+        // 1 获取预处理语句，参数用?占位，执行时按类型绑定
+        Statement *stmt = mysql->prepare("insert into user(name, password, state) values(?, ?, ?)");
+        // 将数据更新到mysql中
+        if (stmt != nullptr && stmt->execute(user.getName(), user.getPwd(), user.getState()))
         {
             // 获取插入成功的用户数据生成的主键id
-            user.setId(mysql_insert_id(mysql.getConnection()));
+            user.setId(stmt->insertId());
             // 注册成功
             return true;
         }
@@ -31,30 +28,19 @@ bool UserModel::insert(User &user)
 // 根据用户id号码查询用户信息
 User UserModel::query(int id)
 {
-    // 1 组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "select * from user where id = %d", id);
-
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
     {
-        MYSQL_RES *res = mysql.query(sql);
-        // 如果res不为空，代表查成功
-        if (res != nullptr)
+        Statement *stmt = mysql->prepare("select id, name, password, state from user where id = ?");
+        // 执行成功，代表查成功
+        if (stmt != nullptr && stmt->execute(id))
         {
-            // 查到之后，查到的一行的信息用row保存
-            MYSQL_ROW row = mysql_fetch_row(res);
-            if (row != nullptr)
+            // 查到之后，把这一行的各列依次读出来
+            int userid;
+            string name, pwd, state;
+            if (stmt->fetch(userid, name, pwd, state))
             {
-                User user;
-                user.setId(atoi(row[0]));
-                user.setName(row[1]);
-                user.setPwd(row[2]);
-                user.setState(row[3]);
-
-                // 将上面开辟的res指针释放掉
-                mysql_free_result(res);
-                return user;
+                return User(userid, name, pwd, state);
             }
         }
     }
@@ -66,15 +52,12 @@ User UserModel::query(int id)
 // 更新用户的状态信息
 bool UserModel::updateState(User user)
 {
-    // 1 组装sql语句
-    char sql[1024] = {0};
-    sprintf(sql, "update user set state = '%s' where id = %d", user.getState().c_str(), user.getId());
-
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
     {
-        // 将sql更新到mysql中
-        if (mysql.update(sql))
+        Statement *stmt = mysql->prepare("update user set state = ? where id = ?");
+        // 将数据更新到mysql中
+        if (stmt != nullptr && stmt->execute(user.getState(), user.getId()))
         {
             return true;
         }
@@ -83,16 +66,60 @@ bool UserModel::updateState(User user)
     return false;
 }
 
+// 把多个用户的状态信息更新为同一个state
+bool UserModel::updateState(const vector<int> &ids, const string &state)
+{
+    if (ids.empty())
+    {
+        return true;
+    }
+
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql == nullptr)
+    {
+        return false;
+    }
+
+    // 和批量插入离线消息一样，每条语句最多带BATCH_SIZE个id，语句按id个数预处理缓存
+    const size_t BATCH_SIZE = 64;
+    bool ok = true;
+    for (size_t begin = 0; begin < ids.size(); begin += BATCH_SIZE)
+    {
+        size_t count = min(BATCH_SIZE, ids.size() - begin);
+        string sql = "update user set state = ? where id in (?";
+        for (size_t i = 1; i < count; ++i)
+        {
+            sql += ", ?";
+        }
+        sql += ")";
+
+        Statement *stmt = mysql->prepare(sql);
+        if (stmt == nullptr)
+        {
+            ok = false;
+            continue;
+        }
+        stmt->bind(0, state);
+        for (size_t i = 0; i < count; ++i)
+        {
+            stmt->bind(i + 1, ids[begin + i]);
+        }
+        ok = stmt->execute() && ok;
+    }
+    return ok;
+}
+
 // 重置用户的状态信息
 void UserModel::resetState()
 {
-    // 1 将所有状态为online的用户状态修改为offline
-    char sql[1024] = "update user set state = 'offline' where state = 'online'";
-
-    MySQL mysql;
-    if (mysql.connect())
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
     {
-        // 将sql更新到mysql中
-        mysql.update(sql);
+        // 1 将所有状态为online的用户状态修改为offline
+        Statement *stmt = mysql->prepare("update user set state = 'offline' where state = 'online'");
+        if (stmt != nullptr)
+        {
+            stmt->execute();
+        }
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,166 @@
+#include "offlinemsgwriter.hpp"
+#include <muduo/base/Logging.h>
+#include <algorithm>
+
+// 退出时写入失败的重试次数
+static const int STOP_RETRY_TIMES = 3;
+
+OfflineMsgWriter::OfflineMsgWriter(OfflineMsgModel &model, size_t flushRows,
+                                   chrono::milliseconds flushInterval, size_t maxPendingRows)
+    : _model(model), _flushRows(flushRows), _flushInterval(flushInterval),
+      _maxPendingRows(maxPendingRows), _pushedRows(0), _writtenRows(0),
+      _flushWaiters(0), _stop(false)
+{
+    _thread = thread(&OfflineMsgWriter::writerTask, this);
+}
+
+OfflineMsgWriter::~OfflineMsgWriter()
+{
+    stop();
+}
+
+// 存储用户的离线消息
+void OfflineMsgWriter::write(int userid, const string &msg)
+{
+    vector<OfflineMsg> msgs;
+    msgs.emplace_back(userid, make_shared<const string>(msg));
+    push(msgs);
+}
+
+// 存储多条离线消息
+void OfflineMsgWriter::write(vector<OfflineMsg> msgs)
+{
+    if (!msgs.empty())
+    {
+        push(msgs);
+    }
+}
+
+// 把消息放入队列
+void OfflineMsgWriter::push(vector<OfflineMsg> &msgs)
+{
+    {
+        unique_lock<mutex> lock(_mutex);
+        if (!_stop)
+        {
+            // 队列满了说明mysql跟不上或者不可用，等待后台线程写入，而不是丢弃消息
+            _doneCv.wait(lock, [&]() { return _stop || _pending.size() < _maxPendingRows; });
+        }
+        if (!_stop)
+        {
+            _pending.insert(_pending.end(), make_move_iterator(msgs.begin()), make_move_iterator(msgs.end()));
+            _pushedRows += msgs.size();
+            if (_pending.size() >= _flushRows)
+            {
+                _writerCv.notify_one();
+            }
+            return;
+        }
+    }
+
+    // 后台线程已经停止，直接同步写入
+    _model.insert(msgs);
+}
+
+// 等待调用之前放入队列的消息全部写入mysql
+bool OfflineMsgWriter::flush(chrono::milliseconds timeout)
+{
+    unique_lock<mutex> lock(_mutex);
+    uint64_t target = _pushedRows;
+    if (_writtenRows >= target)
+    {
+        return true;
+    }
+
+    ++_flushWaiters;
+    _writerCv.notify_one();
+    bool done = _doneCv.wait_for(lock, timeout, [&]() { return _writtenRows >= target; });
+    --_flushWaiters;
+    return done;
+}
+
+// 写完队列中的消息后停止后台线程
+void OfflineMsgWriter::stop()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (_stop)
+        {
+            return;
+        }
+        _stop = true;
+    }
+    _writerCv.notify_one();
+    _doneCv.notify_all();
+    _thread.join();
+}
+
+// 队列中等待写入的消息数
+size_t OfflineMsgWriter::pendingRows()
+{
+    lock_guard<mutex> lock(_mutex);
+    return _pending.size();
+}
+
+// 后台写入线程
+void OfflineMsgWriter::writerTask()
+{
+    vector<OfflineMsg> batch;
+    int stopRetry = 0;
+    for (;;)
+    {
+        {
+            unique_lock<mutex> lock(_mutex);
+            // 攒够flushRows条、有flush在等待、或者要退出时立刻写入，否则最多等待flushInterval
+            _writerCv.wait_for(lock, _flushInterval, [&]() {
+                return _stop || _flushWaiters > 0 || _pending.size() >= _flushRows;
+            });
+            if (_pending.empty())
+            {
+                if (_stop)
+                {
+                    break;
+                }
+                continue;
+            }
+            if (_stop && stopRetry >= STOP_RETRY_TIMES)
+            {
+                LOG_ERROR << "offline message writer stopped, " << _pending.size() << " messages lost!";
+                break;
+            }
+
+            // 一次最多取flushRows条，保证一次写入的耗时有上限
+            size_t count = min(_pending.size(), _flushRows);
+            batch.assign(make_move_iterator(_pending.begin()), make_move_iterator(_pending.begin() + count));
+            _pending.erase(_pending.begin(), _pending.begin() + count);
+        }
+
+        // 写入mysql时不持有锁，工作线程可以继续放入消息
+        size_t written = _model.insert(batch);
+
+        {
+            lock_guard<mutex> lock(_mutex);
+            if (written < batch.size())
+            {
+                // 没有写入的消息按原来的顺序放回队列头部，下个周期重试
+                LOG_ERROR << "write offline messages failed, " << batch.size() - written << " messages will retry";
+                _pending.insert(_pending.begin(), make_move_iterator(batch.begin() + written),
+                                make_move_iterator(batch.end()));
+                if (_stop)
+                {
+                    ++stopRetry;
+                }
+            }
+            _writtenRows += written;
+        }
+        _doneCv.notify_all();
+        batch.clear();
+
+        if (written == 0)
+        {
+            // mysql不可用，等一个周期再重试，避免空转
+            this_thread::sleep_for(_flushInterval);
+        }
+    }
+    _doneCv.notify_all();
+}
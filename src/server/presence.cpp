@@ -0,0 +1,332 @@
+#include "presence.hpp"
+#include <muduo/base/Logging.h>
+#include <cstdlib>
+
+const string Presence::CHANNEL = "presence";
+
+// 记录用户登录在哪台服务器上的redis哈希表，字段是用户id，值是服务器的节点id
+static const string USER_NODE_KEY = "chat:usernode";
+
+// 心跳key的过期时间和续期间隔，连续错过两次续期才会被其他服务器当作宕机
+static const int NODE_TTL_SECONDS = 30;
+static const chrono::seconds HEARTBEAT_INTERVAL(10);
+// 节点存活状态在本地缓存的时间
+static const chrono::seconds NODE_CHECK_INTERVAL(3);
+// 用户所在节点在本地缓存的时间，正常情况下由广播删除，这里只是广播丢失时的兜底
+static const chrono::seconds CACHE_TTL(10);
+// 本地缓存的最大用户数
+static const size_t MAX_CACHE_SIZE = 100000;
+// state批量写入mysql的间隔
+static const chrono::milliseconds FLUSH_INTERVAL(100);
+
+// 服务器节点的心跳key
+static string nodeKey(const string &nodeid)
+{
+    return "presence:node:" + nodeid;
+}
+
+Presence::Presence(Redis &redis)
+    : _redis(redis), _stop(false)
+{
+}
+
+Presence::~Presence()
+{
+    stop();
+}
+
+// 设置本服务器的节点id，启动心跳和state写入线程
+void Presence::start(const string &nodeid)
+{
+    _nodeId = nodeid;
+    // 本服务器刚启动，还没有用户登录，哈希表中指向本节点的记录都是上次异常退出时留下的
+    // 重启很快时心跳key还没过期，这些用户会一直被当作在线，登录时被拒绝，所以先清理掉
+    purgeOwnUsers();
+    // 先写一次心跳，用户登录之后其他服务器马上就能查到本服务器存活
+    _redis.setex(nodeKey(_nodeId), NODE_TTL_SECONDS, "1");
+    _redis.subscribe(CHANNEL, [this](string msg) { invalidate(atoi(msg.c_str())); });
+    _thread = thread(&Presence::backgroundTask, this);
+}
+
+// 停止后台线程，写入剩余的state，删除本服务器的心跳key
+void Presence::stop()
+{
+    if (!_thread.joinable())
+    {
+        return;
+    }
+    {
+        lock_guard<mutex> lock(_stateMutex);
+        _stop = true;
+    }
+    _stateCv.notify_one();
+    _thread.join();
+    // 本服务器上的用户都下线了，清理哈希表中指向本节点的记录
+    purgeOwnUsers();
+    _redis.del(nodeKey(_nodeId));
+}
+
+// 删除哈希表中登录在本服务器上的所有用户
+void Presence::purgeOwnUsers()
+{
+    long long n = _redis.hdel_by_value(USER_NODE_KEY, _nodeId);
+    if (n > 0)
+    {
+        LOG_INFO << "purge " << n << " users of node " << _nodeId;
+    }
+    else if (n < 0)
+    {
+        LOG_ERROR << "purge users of node " << _nodeId << " failed!";
+    }
+}
+
+// 用户在本服务器上登录
+void Presence::online(int userid)
+{
+    string field = to_string(userid);
+    _redis.hset(USER_NODE_KEY, field, _nodeId);
+    // 通知所有服务器删除该用户的本地缓存
+    _redis.publish(CHANNEL, field);
+    pushState(userid, "online");
+}
+
+// 用户从本服务器上下线
+void Presence::offline(int userid)
+{
+    string field = to_string(userid);
+    // 只有记录的还是本服务器时才删除，用户可能已经在其他服务器上重新登录了
+    // 这种情况下也不能把mysql中的state改成offline
+    if (_redis.hdel_if_equal(USER_NODE_KEY, field, _nodeId))
+    {
+        _redis.publish(CHANNEL, field);
+        pushState(userid, "offline");
+    }
+}
+
+// 查询用户登录所在的节点id，离线返回空串
+string Presence::query(int userid, bool cached)
+{
+    string nodeid;
+    bool hit = false;
+    if (cached)
+    {
+        lock_guard<mutex> lock(_cacheMutex);
+        auto it = _cache.find(userid);
+        if (it != _cache.end() && it->second.expire > Clock::now())
+        {
+            nodeid = it->second.nodeid;
+            hit = true;
+        }
+    }
+
+    if (!hit)
+    {
+        unsigned long generation;
+        {
+            lock_guard<mutex> lock(_cacheMutex);
+            generation = beginLoadLocked(userid);
+        }
+        nodeid = _redis.hget(USER_NODE_KEY, to_string(userid));
+        lock_guard<mutex> lock(_cacheMutex);
+        endLoadLocked(userid, generation, nodeid);
+    }
+
+    // 用户记录的节点已经宕机，当作离线
+    return nodeAlive(nodeid) ? nodeid : string();
+}
+
+// 批量查询，结果和userids一一对应
+vector<string> Presence::query(const vector<int> &userids)
+{
+    vector<string> nodes(userids.size());
+    // 本地缓存中没有的用户，在userids中的下标，以及开始查询时的版本号
+    vector<size_t> missIndex;
+    vector<unsigned long> missGeneration;
+    {
+        lock_guard<mutex> lock(_cacheMutex);
+        Clock::time_point now = Clock::now();
+        for (size_t i = 0; i < userids.size(); ++i)
+        {
+            auto it = _cache.find(userids[i]);
+            if (it != _cache.end() && it->second.expire > now)
+            {
+                nodes[i] = it->second.nodeid;
+            }
+            else
+            {
+                missIndex.push_back(i);
+                missGeneration.push_back(beginLoadLocked(userids[i]));
+            }
+        }
+    }
+
+    // 缓存中没有的用户一次性从redis中查询
+    if (!missIndex.empty())
+    {
+        vector<string> fields;
+        fields.reserve(missIndex.size());
+        for (size_t i : missIndex)
+        {
+            fields.push_back(to_string(userids[i]));
+        }
+        vector<string> values = _redis.hmget(USER_NODE_KEY, fields);
+        lock_guard<mutex> lock(_cacheMutex);
+        for (size_t k = 0; k < missIndex.size(); ++k)
+        {
+            nodes[missIndex[k]] = values[k];
+            endLoadLocked(userids[missIndex[k]], missGeneration[k], values[k]);
+        }
+    }
+
+    for (string &nodeid : nodes)
+    {
+        if (!nodeAlive(nodeid))
+        {
+            nodeid.clear();
+        }
+    }
+    return nodes;
+}
+
+// 其他服务器广播了用户的上线、下线，删除本地缓存
+void Presence::invalidate(int userid)
+{
+    lock_guard<mutex> lock(_cacheMutex);
+    _cache.erase(userid);
+    // 正在进行的查询可能读到的是变化之前的节点，作废它的结果
+    auto it = _loading.find(userid);
+    if (it != _loading.end())
+    {
+        ++it->second.generation;
+    }
+}
+
+// 节点是否存活
+bool Presence::nodeAlive(const string &nodeid)
+{
+    if (nodeid.empty())
+    {
+        return false;
+    }
+    // 本服务器当然存活；指向本服务器的记录在启动时已经清理过，之后只有登录在本服务器上的用户才会写入
+    if (nodeid == _nodeId)
+    {
+        return true;
+    }
+
+    {
+        lock_guard<mutex> lock(_cacheMutex);
+        auto it = _nodes.find(nodeid);
+        if (it != _nodes.end() && Clock::now() - it->second.checkTime < NODE_CHECK_INTERVAL)
+        {
+            return it->second.alive;
+        }
+    }
+
+    // 集群中服务器的个数很少，每台服务器每隔NODE_CHECK_INTERVAL最多查询一次
+    bool alive = _redis.exists(nodeKey(nodeid));
+    lock_guard<mutex> lock(_cacheMutex);
+    _nodes[nodeid] = NodeEntry{alive, Clock::now()};
+    return alive;
+}
+
+// 开始从redis查询用户所在节点
+unsigned long Presence::beginLoadLocked(int userid)
+{
+    Loading &loading = _loading[userid];
+    ++loading.loaders;
+    return loading.generation;
+}
+
+// 查询结束，查询期间没有收到该用户的失效广播时才放入本地缓存
+void Presence::endLoadLocked(int userid, unsigned long generation, const string &nodeid)
+{
+    auto it = _loading.find(userid);
+    if (it->second.generation == generation)
+    {
+        putCacheLocked(userid, nodeid);
+    }
+    if (--it->second.loaders == 0)
+    {
+        _loading.erase(it);
+    }
+}
+
+// 放入本地缓存
+void Presence::putCacheLocked(int userid, const string &nodeid)
+{
+    Clock::time_point now = Clock::now();
+    if (_cache.size() >= MAX_CACHE_SIZE && _cache.find(userid) == _cache.end())
+    {
+        // 缓存满了先删除过期的，还是满的就全部清空，缓存只是为了减少redis查询，清空不影响正确性
+        for (auto it = _cache.begin(); it != _cache.end();)
+        {
+            it = it->second.expire <= now ? _cache.erase(it) : ++it;
+        }
+        if (_cache.size() >= MAX_CACHE_SIZE)
+        {
+            _cache.clear();
+        }
+    }
+    _cache[userid] = CacheEntry{nodeid, now + CACHE_TTL};
+}
+
+// state写入队列，同一用户只保留最后一次的state
+void Presence::pushState(int userid, const string &state)
+{
+    lock_guard<mutex> lock(_stateMutex);
+    _pendingState[userid] = state;
+}
+
+// 心跳和state写入线程
+void Presence::backgroundTask()
+{
+    Clock::time_point lastHeartbeat = Clock::now();
+    unordered_map<int, string> pending;
+    for (;;)
+    {
+        bool stop;
+        {
+            // 每隔FLUSH_INTERVAL取走一次队列，间隔内的变化合并成一批写入
+            unique_lock<mutex> lock(_stateMutex);
+            _stateCv.wait_for(lock, FLUSH_INTERVAL, [&]() { return _stop; });
+            stop = _stop;
+            pending.swap(_pendingState);
+        }
+
+        flushState(pending);
+        if (stop)
+        {
+            break; // 退出前已经把剩余的state写完
+        }
+
+        if (Clock::now() - lastHeartbeat >= HEARTBEAT_INTERVAL)
+        {
+            _redis.setex(nodeKey(_nodeId), NODE_TTL_SECONDS, "1");
+            lastHeartbeat = Clock::now();
+        }
+    }
+}
+
+// 把state写入队列中的内容批量写入mysql
+void Presence::flushState(unordered_map<int, string> &pending)
+{
+    if (pending.empty())
+    {
+        return;
+    }
+
+    vector<int> onlineIds;
+    vector<int> offlineIds;
+    for (auto &item : pending)
+    {
+        (item.second == "online" ? onlineIds : offlineIds).push_back(item.first);
+    }
+    pending.clear();
+
+    // 写入失败只记录日志，在线状态以redis为准，mysql中的state只用于好友、群成员列表的展示
+    if (!_userModel.updateState(onlineIds, "online") || !_userModel.updateState(offlineIds, "offline"))
+    {
+        LOG_ERROR << "write-behind user state failed!";
+    }
+}
@@ -1,14 +1,25 @@
 #include "redis.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 using namespace std;
 
+// 发布队列的最大长度，redis长时间不可用时防止队列无限增长
+static const size_t MAX_PUBLISH_QUEUE_SIZE = 100000;
+// 普通命令连接池中的连接数，业务线程、AsyncIo的redis线程同时执行命令时各用各的连接
+static const int COMMAND_CONNECTIONS = 8;
+
 Redis::Redis()
-    : _publish_context(nullptr), _subcribe_context(nullptr) // 将两个上下文指针制空
+    : _publish_context(nullptr), _subcribe_context(nullptr), // 将上下文指针制空
+      _publish_stop(false)
 {
 }
 
 Redis::~Redis()
 {
+    stop_publish();
+
     if (_publish_context != nullptr)
     {
         redisFree(_publish_context);
@@ -18,6 +29,11 @@ Redis::~Redis()
     {
         redisFree(_subcribe_context);
     }
+
+    for (redisContext *context : _command_contexts)
+    {
+        redisFree(context);
+    }
 }
 
 bool Redis::connect()
@@ -38,53 +54,91 @@ bool Redis::connect()
         return false;
     }
 
+    // 负责普通命令的上下文连接池
+    for (int i = 0; i < COMMAND_CONNECTIONS; ++i)
+    {
+        redisContext *context = redisConnect("127.0.0.1", 6379);
+        if (nullptr == context)
+        {
+            cerr << "connect redis failed!" << endl;
+            return false;
+        }
+        lock_guard<mutex> lock(_command_mutex);
+        _command_contexts.push_back(context);
+        _idle_contexts.push_back(context);
+    }
+
     // 在单独的线程中，监听通道上的事件，有消息给业务层进行上报
     thread t([&]() {
         observer_channel_message();
     });
     t.detach();
 
+    // 在单独的线程中，批量发送发布队列中的消息
+    _publish_thread = thread(&Redis::publish_channel_message, this);
+
     cout << "connect redis-server success!" << endl;
 
     return true;
 }
 
-// 向redis指定的通道channel发布消息
-// int channel --- 通道号, string message --- 消息
-bool Redis::publish(int channel, string message)
-{
-    // redisCommand -- 相当于向命令行输入一串命令
-    // 返回值是动态生成的结构体，用完之后需要手动释放
-    // redisCommand本身做的事情是：先调用redisAppendCommand，把要发送的命令缓存到本地
-    // 然后调用redisBufferWrite，将命令发送到redis server上
-    // 然后调用redisGetReply，阻塞等待redis server响应消息
-    // 因为publish命令，一执行就会直接响应，不会阻塞，所以这里可以直接使用redisCommand
-    redisReply *reply = (redisReply *)redisCommand(_publish_context, "PUBLISH %d %s", channel, message.c_str());
-    if (nullptr == reply)
+// 在独立线程中接收订阅通道中的消息
+void Redis::observer_channel_message()
+{
+    redisReply *reply = nullptr;
+    while (REDIS_OK == redisGetReply(this->_subcribe_context, (void **)&reply))
     {
-        cerr << "publish command failed!" << endl;
-        return false;
+        // 订阅收到的消息是一个带三元素的数组
+        // 其中第三个元素reply->element[2]就是message，reply->element[1]就是通道名
+        // 满足if条件，表示通道上确实有消息发生了
+        if (reply != nullptr && reply->element!=nullptr && reply->element[2] != nullptr && reply->element[2]->str != nullptr)
+        {
+            string channel(reply->element[1]->str, reply->element[1]->len);
+            string message(reply->element[2]->str, reply->element[2]->len);
+
+            // 交给该通道注册的回调处理
+            function<void(string)> handler;
+            {
+                lock_guard<mutex> lock(_handler_mutex);
+                auto it = _channel_handlers.find(channel);
+                if (it != _channel_handlers.end())
+                {
+                    handler = it->second;
+                }
+            }
+
+            if (handler)
+            {
+                handler(message);
+            }
+        }
+
+        freeReplyObject(reply);
     }
-    // 手动释放
-    freeReplyObject(reply);
-    return true;
+
+    cerr << ">>>>>>>>>>>>> observer_channel_message quit <<<<<<<<<<<<<" << endl;
+}
+
+// 向redis指定的通道channel发布消息
+bool Redis::publish(const string &channel, const string &message)
+{
+    return push_publish_item(channel, message);
 }
 
-// 向redis指定的通道subscribe订阅消息
-bool Redis::subscribe(int channel)
+// 订阅通道，并注册该通道消息的回调
+bool Redis::subscribe(const string &channel, function<void(string)> fn)
 {
-    // 因为subscribe命令，一执行就会阻塞等待消息，所以这里不可以直接使用redisCommand
-    // 所以分步执行redisCommand中的一些命令redisAppendCommand、redisBufferWrite，不再执行redisGetReply
+    // 先注册回调再订阅，保证订阅成功后收到的第一条消息就能找到回调
+    {
+        lock_guard<mutex> lock(_handler_mutex);
+        _channel_handlers[channel] = fn;
+    }
 
-    // SUBSCRIBE命令本身会造成线程阻塞等待通道里面发生消息，这里只做订阅通道，不接收通道消息
-    // 通道消息的接收专门在observer_channel_message函数中的独立线程中进行
-    // 只负责发送命令，不阻塞接收redis server响应消息，否则和notifyMsg线程抢占响应资源
-    if (REDIS_ERR == redisAppendCommand(this->_subcribe_context, "SUBSCRIBE %d", channel))
+    if (REDIS_ERR == redisAppendCommand(this->_subcribe_context, "SUBSCRIBE %s", channel.c_str()))
     {
         cerr << "subscribe command failed!" << endl;
         return false;
     }
-    // redisBufferWrite可以循环发送缓冲区，直到缓冲区数据发送完毕（done被置为1）
     int done = 0;
     while (!done)
     {
@@ -94,58 +148,608 @@ bool Redis::subscribe(int channel)
             return false;
         }
     }
-    // redisGetReply
-
     return true;
 }
 
-// 向redis指定的通道unsubscribe取消订阅消息
-bool Redis::unsubscribe(int channel)
+// 设置哈希表key中字段field的值
+bool Redis::hset(const string &key, const string &field, const string &value)
+{
+    CommandConnection conn(*this);
+    redisReply *reply = (redisReply *)redisCommand(conn.context(), "HSET %b %b %b",
+                                                   key.data(), key.size(), field.data(), field.size(),
+                                                   value.data(), value.size());
+    if (nullptr == reply)
+    {
+        cerr << "hset command failed!" << endl;
+        return false;
+    }
+    bool ok = reply->type != REDIS_REPLY_ERROR;
+    freeReplyObject(reply);
+    return ok;
+}
+
+// 只有哈希表key中字段field的值等于value时才删除该字段
+bool Redis::hdel_if_equal(const string &key, const string &field, const string &value)
 {
-    // 与subscribe一样，一执行就会阻塞等待消息，所以这里不可以直接使用redisCommand
-    // 所以分步执行redisCommand中的一些命令redisAppendCommand、redisBufferWrite，不再执行redisGetReply
+    // 用lua脚本把判断和删除放在redis server上一次执行完，中间不会插入其他客户端的命令
+    static const char *script =
+        "if redis.call('hget', KEYS[1], ARGV[1]) == ARGV[2] then "
+        "return redis.call('hdel', KEYS[1], ARGV[1]) end return 0";
 
-    if (REDIS_ERR == redisAppendCommand(this->_subcribe_context, "UNSUBSCRIBE %d", channel))
+    CommandConnection conn(*this);
+    redisReply *reply = (redisReply *)redisCommand(conn.context(), "EVAL %s 1 %b %b %b", script,
+                                                   key.data(), key.size(), field.data(), field.size(),
+                                                   value.data(), value.size());
+    if (nullptr == reply)
     {
-        cerr << "unsubscribe command failed!" << endl;
+        cerr << "hdel command failed!" << endl;
         return false;
     }
-    // redisBufferWrite可以循环发送缓冲区，直到缓冲区数据发送完毕（done被置为1）
-    int done = 0;
-    while (!done)
+    bool ok = reply->type == REDIS_REPLY_INTEGER && reply->integer == 1;
+    freeReplyObject(reply);
+    return ok;
+}
+
+// 删除哈希表key中所有值等于value的字段
+long long Redis::hdel_by_value(const string &key, const string &value)
+{
+    // 每次执行脚本扫描一批字段，返回{下一批的游标, 这一批删除的字段数}，游标为"0"时扫描结束
+    // 不用HGETALL一次取出整个哈希表，避免哈希表很大时长时间阻塞redis server
+    static const char *script =
+        "local r = redis.call('hscan', KEYS[1], ARGV[1], 'COUNT', 1000) "
+        "local n = 0 "
+        "for i = 1, #r[2], 2 do "
+        "if r[2][i + 1] == ARGV[2] then n = n + redis.call('hdel', KEYS[1], r[2][i]) end end "
+        "return {r[1], n}";
+
+    long long deleted = 0;
+    string cursor = "0";
+    CommandConnection conn(*this);
+    do
     {
-        if (REDIS_ERR == redisBufferWrite(this->_subcribe_context, &done))
+        redisReply *reply = (redisReply *)redisCommand(conn.context(), "EVAL %s 1 %b %b %b", script,
+                                                       key.data(), key.size(), cursor.data(), cursor.size(),
+                                                       value.data(), value.size());
+        if (nullptr == reply)
+        {
+            cerr << "hdel command failed!" << endl;
+            return -1;
+        }
+        bool ok = reply->type == REDIS_REPLY_ARRAY && reply->elements == 2 &&
+                  reply->element[0]->type == REDIS_REPLY_STRING && reply->element[1]->type == REDIS_REPLY_INTEGER;
+        if (ok)
+        {
+            cursor.assign(reply->element[0]->str, reply->element[0]->len);
+            deleted += reply->element[1]->integer;
+        }
+        freeReplyObject(reply);
+        if (!ok)
+        {
+            cerr << "hdel command failed!" << endl;
+            return -1;
+        }
+    } while (cursor != "0");
+    return deleted;
+}
+
+// 获取哈希表key中字段field的值
+string Redis::hget(const string &key, const string &field)
+{
+    string value;
+    CommandConnection conn(*this);
+    redisReply *reply = (redisReply *)redisCommand(conn.context(), "HGET %b %b",
+                                                   key.data(), key.size(), field.data(), field.size());
+    if (nullptr == reply)
+    {
+        cerr << "hget command failed!" << endl;
+        return value;
+    }
+    if (reply->type == REDIS_REPLY_STRING)
+    {
+        value.assign(reply->str, reply->len);
+    }
+    freeReplyObject(reply);
+    return value;
+}
+
+// 批量获取哈希表key中多个字段的值
+vector<string> Redis::hmget(const string &key, const vector<string> &fields)
+{
+    vector<string> values(fields.size());
+    if (fields.empty())
+    {
+        return values;
+    }
+
+    // 参数个数不固定，用redisCommandArgv按参数数组发送
+    vector<const char *> argv;
+    vector<size_t> argvlen;
+    argv.push_back("HMGET");
+    argvlen.push_back(5);
+    argv.push_back(key.data());
+    argvlen.push_back(key.size());
+    for (const string &field : fields)
+    {
+        argv.push_back(field.data());
+        argvlen.push_back(field.size());
+    }
+
+    CommandConnection conn(*this);
+    redisReply *reply = (redisReply *)redisCommandArgv(conn.context(), argv.size(), argv.data(), argvlen.data());
+    if (nullptr == reply)
+    {
+        cerr << "hmget command failed!" << endl;
+        return values;
+    }
+    if (reply->type == REDIS_REPLY_ARRAY)
+    {
+        for (size_t i = 0; i < reply->elements && i < values.size(); ++i)
+        {
+            if (reply->element[i]->type == REDIS_REPLY_STRING)
+            {
+                values[i].assign(reply->element[i]->str, reply->element[i]->len);
+            }
+        }
+    }
+    freeReplyObject(reply);
+    return values;
+}
+
+// 设置key的值，并在seconds秒后过期
+bool Redis::setex(const string &key, int seconds, const string &value)
+{
+    CommandConnection conn(*this);
+    redisReply *reply = (redisReply *)redisCommand(conn.context(), "SETEX %b %d %b",
+                                                   key.data(), key.size(), seconds,
+                                                   value.data(), value.size());
+    if (nullptr == reply)
+    {
+        cerr << "setex command failed!" << endl;
+        return false;
+    }
+    bool ok = reply->type != REDIS_REPLY_ERROR;
+    freeReplyObject(reply);
+    return ok;
+}
+
+// 删除key
+bool Redis::del(const string &key)
+{
+    CommandConnection conn(*this);
+    redisReply *reply = (redisReply *)redisCommand(conn.context(), "DEL %b", key.data(), key.size());
+    if (nullptr == reply)
+    {
+        cerr << "del command failed!" << endl;
+        return false;
+    }
+    bool ok = reply->type != REDIS_REPLY_ERROR;
+    freeReplyObject(reply);
+    return ok;
+}
+
+// 判断key是否存在
+bool Redis::exists(const string &key)
+{
+    CommandConnection conn(*this);
+    redisReply *reply = (redisReply *)redisCommand(conn.context(), "EXISTS %b", key.data(), key.size());
+    if (nullptr == reply)
+    {
+        cerr << "exists command failed!" << endl;
+        return false;
+    }
+    bool ok = reply->type == REDIS_REPLY_INTEGER && reply->integer > 0;
+    freeReplyObject(reply);
+    return ok;
+}
+
+// 把key的值加上increment
+long long Redis::incrby(const string &key, long long increment)
+{
+    CommandConnection conn(*this);
+    redisReply *reply = (redisReply *)redisCommand(conn.context(), "INCRBY %b %lld", key.data(), key.size(), increment);
+    if (nullptr == reply)
+    {
+        cerr << "incrby command failed!" << endl;
+        return 0;
+    }
+    long long value = reply->type == REDIS_REPLY_INTEGER ? reply->integer : 0;
+    freeReplyObject(reply);
+    return value;
+}
+
+// 批量获取多个key的值
+vector<string> Redis::mget(const vector<string> &keys)
+{
+    vector<string> values(keys.size());
+    if (keys.empty())
+    {
+        return values;
+    }
+
+    vector<const char *> argv;
+    vector<size_t> argvlen;
+    argv.push_back("MGET");
+    argvlen.push_back(4);
+    for (const string &key : keys)
+    {
+        argv.push_back(key.data());
+        argvlen.push_back(key.size());
+    }
+
+    CommandConnection conn(*this);
+    redisReply *reply = (redisReply *)redisCommandArgv(conn.context(), argv.size(), argv.data(), argvlen.data());
+    if (nullptr == reply)
+    {
+        cerr << "mget command failed!" << endl;
+        return values;
+    }
+    if (reply->type == REDIS_REPLY_ARRAY)
+    {
+        for (size_t i = 0; i < reply->elements && i < values.size(); ++i)
         {
-            cerr << "unsubscribe command failed!" << endl;
+            if (reply->element[i]->type == REDIS_REPLY_STRING)
+            {
+                values[i].assign(reply->element[i]->str, reply->element[i]->len);
+            }
+        }
+    }
+    freeReplyObject(reply);
+    return values;
+}
+
+// 按分数从小到大获取有序集合中分数在[min, max]之间的成员
+vector<string> Redis::zrangebyscore(const string &key, const string &min, const string &max, int count)
+{
+    vector<string> members;
+    CommandConnection conn(*this);
+    redisReply *reply = (redisReply *)redisCommand(conn.context(), "ZRANGEBYSCORE %b %b %b LIMIT 0 %d",
+                                                   key.data(), key.size(), min.data(), min.size(),
+                                                   max.data(), max.size(), count);
+    if (nullptr == reply)
+    {
+        cerr << "zrangebyscore command failed!" << endl;
+        return members;
+    }
+    if (reply->type == REDIS_REPLY_ARRAY)
+    {
+        for (size_t i = 0; i < reply->elements; ++i)
+        {
+            members.emplace_back(reply->element[i]->str, reply->element[i]->len);
+        }
+    }
+    freeReplyObject(reply);
+    return members;
+}
+
+// 按分数从小到大获取有序集合中分数在[min, max]之间的成员和分数
+vector<pair<string, long long>> Redis::zrangebyscore_withscores(const string &key, const string &min,
+                                                                const string &max, int count)
+{
+    vector<pair<string, long long>> members;
+    CommandConnection conn(*this);
+    redisReply *reply = (redisReply *)redisCommand(conn.context(), "ZRANGEBYSCORE %b %b %b WITHSCORES LIMIT 0 %d",
+                                                   key.data(), key.size(), min.data(), min.size(),
+                                                   max.data(), max.size(), count);
+    if (nullptr == reply)
+    {
+        cerr << "zrangebyscore command failed!" << endl;
+        return members;
+    }
+    // 回复是成员、分数交替排列的数组，分数是字符串
+    if (reply->type == REDIS_REPLY_ARRAY)
+    {
+        for (size_t i = 0; i + 1 < reply->elements; i += 2)
+        {
+            members.emplace_back(string(reply->element[i]->str, reply->element[i]->len),
+                                 atoll(reply->element[i + 1]->str));
+        }
+    }
+    freeReplyObject(reply);
+    return members;
+}
+
+// 在连接context上加载lua脚本，返回脚本的sha1，出错返回空串
+// 脚本缓存在redis server上，所有连接共用，任意一个连接加载一次即可
+string Redis::load_script(redisContext *context, const string &script)
+{
+    string sha;
+    redisReply *reply = (redisReply *)redisCommand(context, "SCRIPT LOAD %b", script.data(), script.size());
+    if (nullptr == reply)
+    {
+        cerr << "script load command failed!" << endl;
+        return sha;
+    }
+    if (reply->type == REDIS_REPLY_STRING)
+    {
+        sha.assign(reply->str, reply->len);
+        lock_guard<mutex> lock(_script_mutex);
+        _script_sha[script] = sha;
+    }
+    else if (reply->type == REDIS_REPLY_ERROR)
+    {
+        cerr << "script load command failed: " << string(reply->str, reply->len) << endl;
+    }
+    freeReplyObject(reply);
+    return sha;
+}
+
+// 执行返回整数数组的lua脚本
+vector<long long> Redis::eval_integers(const string &script, const vector<string> &keys, const vector<string> &args)
+{
+    vector<long long> values;
+
+    // EVALSHA sha numkeys key1 key2 ... arg1 arg2 ...，sha在下面取得之后填入
+    string numkeys = to_string(keys.size());
+    vector<const char *> argv;
+    vector<size_t> argvlen;
+    argv.reserve(keys.size() + args.size() + 3);
+    argvlen.reserve(keys.size() + args.size() + 3);
+    argv.push_back("EVALSHA");
+    argvlen.push_back(7);
+    argv.push_back(nullptr);
+    argvlen.push_back(0);
+    argv.push_back(numkeys.data());
+    argvlen.push_back(numkeys.size());
+    for (const string &key : keys)
+    {
+        argv.push_back(key.data());
+        argvlen.push_back(key.size());
+    }
+    for (const string &arg : args)
+    {
+        argv.push_back(arg.data());
+        argvlen.push_back(arg.size());
+    }
+
+    // 脚本只在第一次执行时发送给redis server，之后只发送sha1
+    string sha;
+    {
+        lock_guard<mutex> lock(_script_mutex);
+        auto it = _script_sha.find(script);
+        if (it != _script_sha.end())
+        {
+            sha = it->second;
+        }
+    }
+    CommandConnection conn(*this);
+    if (sha.empty())
+    {
+        sha = load_script(conn.context(), script);
+    }
+    redisReply *reply = nullptr;
+    // redis server重启或者执行了SCRIPT FLUSH之后，脚本缓存被清空，返回NOSCRIPT错误，重新加载一次再执行
+    for (int attempt = 0; attempt < 2 && !sha.empty(); ++attempt)
+    {
+        argv[1] = sha.data();
+        argvlen[1] = sha.size();
+        reply = (redisReply *)redisCommandArgv(conn.context(), argv.size(), argv.data(), argvlen.data());
+        if (attempt == 0 && reply != nullptr && reply->type == REDIS_REPLY_ERROR &&
+            strncmp(reply->str, "NOSCRIPT", 8) == 0)
+        {
+            freeReplyObject(reply);
+            reply = nullptr;
+            sha = load_script(conn.context(), script);
+            continue;
+        }
+        break;
+    }
+    if (nullptr == reply)
+    {
+        cerr << "eval command failed!" << endl;
+        return values;
+    }
+    if (reply->type == REDIS_REPLY_ARRAY)
+    {
+        for (size_t i = 0; i < reply->elements; ++i)
+        {
+            values.push_back(reply->element[i]->integer);
+        }
+    }
+    else if (reply->type == REDIS_REPLY_ERROR)
+    {
+        cerr << "eval command failed: " << string(reply->str, reply->len) << endl;
+    }
+    freeReplyObject(reply);
+    return values;
+}
+
+// 从连接池中借出一个普通命令连接，没有空闲连接时等待
+redisContext *Redis::acquire_command_context()
+{
+    unique_lock<mutex> lock(_command_mutex);
+    if (_command_contexts.empty())
+    {
+        return nullptr; // 还没有连接redis server
+    }
+    _command_cv.wait(lock, [&]() { return !_idle_contexts.empty(); });
+    redisContext *context = _idle_contexts.back();
+    _idle_contexts.pop_back();
+    return context;
+}
+
+// 归还借出的连接
+// hiredis的同步连接出错(命令返回NULL)之后，这个连接上的命令都会直接失败，和发布连接一样重新连接
+void Redis::release_command_context(redisContext *context)
+{
+    if (context == nullptr)
+    {
+        return;
+    }
+    if (context->err)
+    {
+        context = reconnect_command_context(context);
+    }
+    {
+        lock_guard<mutex> lock(_command_mutex);
+        _idle_contexts.push_back(context);
+    }
+    _command_cv.notify_one();
+}
+
+// 重新建立出错的普通命令连接，连接借出期间只有当前线程使用，释放旧连接不需要加锁
+redisContext *Redis::reconnect_command_context(redisContext *context)
+{
+    redisContext *fresh = redisConnect("127.0.0.1", 6379);
+    if (nullptr == fresh)
+    {
+        cerr << "reconnect redis failed!" << endl;
+        return context;
+    }
+    if (fresh->err)
+    {
+        cerr << "reconnect redis failed!" << endl;
+    }
+
+    // 连接池中记录的是所有连接，析构时释放，这里换成新的连接
+    {
+        lock_guard<mutex> lock(_command_mutex);
+        replace(_command_contexts.begin(), _command_contexts.end(), context, fresh);
+    }
+    redisFree(context);
+    return fresh;
+}
+
+// 初始化发布失败的回调对象
+void Redis::init_publish_error_handler(function<void(string, string)> fn)
+{
+    this->_publish_error_handler = fn;
+}
+
+// 发布队列中等待发送的消息数
+size_t Redis::publish_queue_size()
+{
+    lock_guard<mutex> lock(_publish_mutex);
+    return _publish_queue.size();
+}
+
+// 把消息放入发布队列
+bool Redis::push_publish_item(string channel, const string &message)
+{
+    {
+        lock_guard<mutex> lock(_publish_mutex);
+        if (_publish_stop)
+        {
+            cerr << "publish thread is stopped!" << endl;
             return false;
         }
+        if (_publish_queue.size() >= MAX_PUBLISH_QUEUE_SIZE)
+        {
+            cerr << "publish queue is full!" << endl;
+            return false;
+        }
+        _publish_queue.push_back(PublishItem{std::move(channel), message});
     }
+    _publish_cv.notify_one();
     return true;
 }
 
-// 在独立线程中接收订阅通道中的消息
-void Redis::observer_channel_message()
+// 让发布线程把队列中剩下的消息发完再退出，可以重复调用
+void Redis::stop_publish()
 {
-    redisReply *reply = nullptr;
-    while (REDIS_OK == redisGetReply(this->_subcribe_context, (void **)&reply))
+    if (!_publish_thread.joinable())
     {
-        // 订阅收到的消息是一个带三元素的数组
-        // 其中第三个元素reply->element[2]就是message，reply->element[1]就是通道号
-        // 满足if条件，表示通道上确实有消息发生了
-        if (reply != nullptr && reply->element!=nullptr && reply->element[2] != nullptr && reply->element[2]->str != nullptr)
+        return;
+    }
+    {
+        lock_guard<mutex> lock(_publish_mutex);
+        _publish_stop = true;
+    }
+    _publish_cv.notify_one();
+    _publish_thread.join();
+}
+
+// 在独立线程中批量发送发布队列中的消息
+void Redis::publish_channel_message()
+{
+    vector<PublishItem> batch;
+    for (;;)
+    {
+        // 一次性取走队列中所有的消息，工作线程只在放入时短暂持有锁
         {
-            // 调用回调操作，给业务层上报通道上发生的消息
-            _notify_message_handler(atoi(reply->element[1]->str) , reply->element[2]->str);
+            unique_lock<mutex> lock(_publish_mutex);
+            _publish_cv.wait(lock, [&]() { return _publish_stop || !_publish_queue.empty(); });
+            if (_publish_queue.empty())
+            {
+                break; // _publish_stop，并且队列已经发完
+            }
+            batch.swap(_publish_queue);
         }
 
-        freeReplyObject(reply);
+        if ((_publish_context == nullptr || _publish_context->err) && !reconnect_publish_context())
+        {
+            for (const PublishItem &item : batch)
+            {
+                notify_publish_error(item);
+            }
+            batch.clear();
+            continue;
+        }
+
+        // pipeline：先把这一批PUBLISH命令全部追加到hiredis的输出缓冲区，
+        // 第一次redisGetReply时一次性写给redis server，再依次读取每条命令的响应
+        size_t appended = 0;
+        for (const PublishItem &item : batch)
+        {
+            if (REDIS_ERR == redisAppendCommand(_publish_context, "PUBLISH %b %b",
+                                                item.channel.data(), item.channel.size(),
+                                                item.message.data(), item.message.size()))
+            {
+                break;
+            }
+            ++appended;
+        }
+
+        size_t replied = 0;
+        for (; replied < appended; ++replied)
+        {
+            redisReply *reply = nullptr;
+            if (REDIS_OK != redisGetReply(_publish_context, (void **)&reply) || reply == nullptr)
+            {
+                break;
+            }
+            // PUBLISH返回收到消息的订阅者个数，0表示没有服务器订阅这个通道(例如目标服务器已经宕机)，消息丢失
+            if (reply->type == REDIS_REPLY_ERROR || (reply->type == REDIS_REPLY_INTEGER && reply->integer == 0))
+            {
+                notify_publish_error(batch[replied]);
+            }
+            freeReplyObject(reply);
+        }
+
+        // 连接出错，没有拿到响应的消息不确定是否发布成功，都按失败上报，并重建连接
+        if (replied < batch.size())
+        {
+            cerr << "publish command failed!" << endl;
+            for (size_t i = replied; i < batch.size(); ++i)
+            {
+                notify_publish_error(batch[i]);
+            }
+            reconnect_publish_context();
+        }
+        batch.clear();
     }
+}
 
-    cerr << ">>>>>>>>>>>>> observer_channel_message quit <<<<<<<<<<<<<" << endl;
+// 发布失败，上报给业务层
+void Redis::notify_publish_error(const PublishItem &item)
+{
+    if (_publish_error_handler)
+    {
+        _publish_error_handler(item.channel, item.message);
+    }
 }
 
-// 初始化向业务层上报通道消息的回调对象
-void Redis::init_notify_handler(function<void(int,string)> fn)
+// 重新建立发布上下文的连接
+bool Redis::reconnect_publish_context()
 {
-    this->_notify_message_handler = fn;
-}
\ No newline at end of file
+    if (_publish_context != nullptr)
+    {
+        redisFree(_publish_context);
+    }
+    _publish_context = redisConnect("127.0.0.1", 6379);
+    if (nullptr == _publish_context || _publish_context->err)
+    {
+        cerr << "reconnect redis failed!" << endl;
+        return false;
+    }
+    return true;
+}
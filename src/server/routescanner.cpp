@@ -0,0 +1,658 @@
+#include "routescanner.hpp"
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#include <immintrin.h>
+#define ROUTESCANNER_X86 1
+#endif
+
+// 从p开始找第一个需要逐字节处理的字符串字节：引号、反斜杠、控制字符或者非ASCII字节，没有则返回end
+// 聊天消息的大部分字节都在msg字段的字符串里，而且绝大多数是普通字符，用SIMD一次检查16或32个字节
+using SpecialFinder = const char *(*)(const char *p, const char *end);
+
+static const char *findSpecialScalar(const char *p, const char *end)
+{
+    while (p < end)
+    {
+        unsigned char c = static_cast<unsigned char>(*p);
+        if (c == '"' || c == '\\' || c < 0x20 || c >= 0x80)
+        {
+            return p;
+        }
+        ++p;
+    }
+    return end;
+}
+
+#ifdef ROUTESCANNER_X86
+// 按有符号字节比较，c < 0x20同时找出了控制字符和非ASCII字节(最高位是1，是负数)
+static const char *findSpecialSse2(const char *p, const char *end)
+{
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i space = _mm_set1_epi8(0x20);
+    while (end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                                       _mm_cmplt_epi8(v, space));
+        int mask = _mm_movemask_epi8(special);
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+    return findSpecialScalar(p, end);
+}
+
+// 和findSpecialSse2一样，一次检查32个字节，只在支持AVX2的CPU上使用
+__attribute__((target("avx2")))
+static const char *findSpecialAvx2(const char *p, const char *end)
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i space = _mm256_set1_epi8(0x20);
+    while (end - p >= 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i special = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, backslash)),
+                                          _mm256_cmpgt_epi8(space, v));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(special));
+        if (mask != 0)
+        {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return findSpecialSse2(p, end);
+}
+#endif
+
+// 运行时按CPU支持的指令集选择实现
+static RouteScanner::Isa bestIsa()
+{
+#ifdef ROUTESCANNER_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? RouteScanner::AVX2 : RouteScanner::SSE2;
+#else
+    return RouteScanner::SCALAR;
+#endif
+}
+
+static SpecialFinder finderOf(RouteScanner::Isa isa)
+{
+    switch (isa)
+    {
+#ifdef ROUTESCANNER_X86
+    case RouteScanner::AVX2:
+        return findSpecialAvx2;
+    case RouteScanner::SSE2:
+        return findSpecialSse2;
+#endif
+    default:
+        return findSpecialScalar;
+    }
+}
+
+static RouteScanner::Isa g_isa = bestIsa();
+static SpecialFinder g_findSpecial = finderOf(g_isa);
+
+// 跳过json的空白字符
+static void skipSpace(const char *&p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+    {
+        ++p;
+    }
+}
+
+// 读取4位十六进制数
+static bool readHex4(const char *&p, const char *end, unsigned &value)
+{
+    if (end - p < 4)
+    {
+        return false;
+    }
+    value = 0;
+    for (int i = 0; i < 4; ++i, ++p)
+    {
+        char c = *p;
+        value <<= 4;
+        if (c >= '0' && c <= '9')
+        {
+            value |= c - '0';
+        }
+        else if (c >= 'a' && c <= 'f')
+        {
+            value |= c - 'a' + 10;
+        }
+        else if (c >= 'A' && c <= 'F')
+        {
+            value |= c - 'A' + 10;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 校验一个UTF-8多字节字符，p指向首字节，规则和json::parse一致：不允许过长编码、代理区和超过U+10FFFF的码点
+static bool skipUtf8(const char *&p, const char *end)
+{
+    const unsigned char *s = reinterpret_cast<const unsigned char *>(p);
+    const long left = end - p;
+    unsigned char c = s[0];
+    int len;
+    unsigned char lo = 0x80, hi = 0xBF; // 第二个字节的范围
+    if (c >= 0xC2 && c <= 0xDF)
+    {
+        len = 2;
+    }
+    else if (c >= 0xE0 && c <= 0xEF)
+    {
+        len = 3;
+        if (c == 0xE0)
+        {
+            lo = 0xA0;
+        }
+        else if (c == 0xED)
+        {
+            hi = 0x9F;
+        }
+    }
+    else if (c >= 0xF0 && c <= 0xF4)
+    {
+        len = 4;
+        if (c == 0xF0)
+        {
+            lo = 0x90;
+        }
+        else if (c == 0xF4)
+        {
+            hi = 0x8F;
+        }
+    }
+    else
+    {
+        return false;
+    }
+    if (left < len || s[1] < lo || s[1] > hi)
+    {
+        return false;
+    }
+    for (int i = 2; i < len; ++i)
+    {
+        if (s[i] < 0x80 || s[i] > 0xBF)
+        {
+            return false;
+        }
+    }
+    p += len;
+    return true;
+}
+
+// 跳过一个字符串，p指向开头的引号，escaped返回字符串中是否有转义字符
+// key和keyLen返回引号之间的原文
+static bool skipString(const char *&p, const char *end, const char *&key, size_t &keyLen, bool &escaped)
+{
+    ++p; // 跳过开头的引号
+    key = p;
+    escaped = false;
+    while (p < end)
+    {
+        // 普通字符整块跳过，停在需要逐字节处理的字节上
+        p = g_findSpecial(p, end);
+        if (p == end)
+        {
+            return false;
+        }
+        unsigned char c = static_cast<unsigned char>(*p);
+        if (c == '"')
+        {
+            keyLen = p - key;
+            ++p;
+            return true;
+        }
+        if (c < 0x20)
+        {
+            // 控制字符必须转义
+            return false;
+        }
+        if (c == '\\')
+        {
+            escaped = true;
+            if (++p == end)
+            {
+                return false;
+            }
+            switch (*p++)
+            {
+            case '"': case '\\': case '/': case 'b': case 'f': case 'n': case 'r': case 't':
+                break;
+            case 'u':
+            {
+                unsigned code;
+                if (!readHex4(p, end, code))
+                {
+                    return false;
+                }
+                if (code >= 0xDC00 && code <= 0xDFFF)
+                {
+                    // 单独的低代理
+                    return false;
+                }
+                if (code >= 0xD800 && code <= 0xDBFF)
+                {
+                    // 高代理后面必须紧跟一个低代理
+                    unsigned low;
+                    if (end - p < 2 || p[0] != '\\' || p[1] != 'u')
+                    {
+                        return false;
+                    }
+                    p += 2;
+                    if (!readHex4(p, end, low) || low < 0xDC00 || low > 0xDFFF)
+                    {
+                        return false;
+                    }
+                }
+                break;
+            }
+            default:
+                return false;
+            }
+            continue;
+        }
+        // 剩下的只有非ASCII字节，连续的多字节字符在这里一起校验，不再回到SIMD查找
+        do
+        {
+            if (!skipUtf8(p, end))
+            {
+                return false;
+            }
+        } while (p < end && static_cast<unsigned char>(*p) >= 0x80);
+    }
+    return false;
+}
+
+// 跳过一个数字，isInt和value返回是不是int范围内的整数以及它的值
+static bool skipNumber(const char *&p, const char *end, bool &isInt, int &value)
+{
+    const char *start = p;
+    bool negative = false;
+    if (*p == '-')
+    {
+        negative = true;
+        if (++p == end)
+        {
+            return false;
+        }
+    }
+
+    // 整数部分：0或者不以0开头的数字串
+    long long number = 0;
+    isInt = true;
+    if (*p == '0')
+    {
+        ++p;
+    }
+    else if (*p >= '1' && *p <= '9')
+    {
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            if (number <= INT_MAX)
+            {
+                number = number * 10 + (*p - '0');
+            }
+            ++p;
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    // 小数部分和指数部分，有这两部分的数字不当作整数
+    if (p < end && *p == '.')
+    {
+        isInt = false;
+        ++p;
+        if (p == end || *p < '0' || *p > '9')
+        {
+            return false;
+        }
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            ++p;
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        isInt = false;
+        ++p;
+        if (p < end && (*p == '+' || *p == '-'))
+        {
+            ++p;
+        }
+        if (p == end || *p < '0' || *p > '9')
+        {
+            return false;
+        }
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            ++p;
+        }
+    }
+
+    if (negative)
+    {
+        number = -number;
+    }
+    if (number < INT_MIN || number > INT_MAX)
+    {
+        isInt = false;
+    }
+    // json::parse把超出double范围的数字当作错误，前面已经按json语法校验过，strtod只会读到p为止
+    if (!isInt && std::isinf(strtod(start, nullptr)))
+    {
+        return false;
+    }
+    value = static_cast<int>(number);
+    return true;
+}
+
+// 跳过一个字面量true、false或null
+static bool skipLiteral(const char *&p, const char *end, const char *literal)
+{
+    size_t len = strlen(literal);
+    if (static_cast<size_t>(end - p) < len || memcmp(p, literal, len) != 0)
+    {
+        return false;
+    }
+    p += len;
+    return true;
+}
+
+static bool skipValue(const char *&p, const char *end, int depth);
+
+// 跳过一个数组，p指向'['
+static bool skipArray(const char *&p, const char *end, int depth)
+{
+    ++p;
+    skipSpace(p, end);
+    if (p < end && *p == ']')
+    {
+        ++p;
+        return true;
+    }
+    for (;;)
+    {
+        if (!skipValue(p, end, depth))
+        {
+            return false;
+        }
+        skipSpace(p, end);
+        if (p == end)
+        {
+            return false;
+        }
+        if (*p == ']')
+        {
+            ++p;
+            return true;
+        }
+        if (*p++ != ',')
+        {
+            return false;
+        }
+        skipSpace(p, end);
+    }
+}
+
+// 跳过一个对象，p指向'{'
+static bool skipObject(const char *&p, const char *end, int depth)
+{
+    ++p;
+    skipSpace(p, end);
+    if (p < end && *p == '}')
+    {
+        ++p;
+        return true;
+    }
+    for (;;)
+    {
+        const char *key;
+        size_t keyLen;
+        bool escaped;
+        if (p == end || *p != '"' || !skipString(p, end, key, keyLen, escaped))
+        {
+            return false;
+        }
+        skipSpace(p, end);
+        if (p == end || *p++ != ':')
+        {
+            return false;
+        }
+        skipSpace(p, end);
+        if (!skipValue(p, end, depth))
+        {
+            return false;
+        }
+        skipSpace(p, end);
+        if (p == end)
+        {
+            return false;
+        }
+        if (*p == '}')
+        {
+            ++p;
+            return true;
+        }
+        if (*p++ != ',')
+        {
+            return false;
+        }
+        skipSpace(p, end);
+    }
+}
+
+// 跳过任意一个json值，depth是这个值所在的层数
+static bool skipValue(const char *&p, const char *end, int depth)
+{
+    if (p == end)
+    {
+        return false;
+    }
+    switch (*p)
+    {
+    case '"':
+    {
+        const char *s;
+        size_t len;
+        bool escaped;
+        return skipString(p, end, s, len, escaped);
+    }
+    case '{':
+        return depth < RouteScanner::MAX_DEPTH && skipObject(p, end, depth + 1);
+    case '[':
+        return depth < RouteScanner::MAX_DEPTH && skipArray(p, end, depth + 1);
+    case 't':
+        return skipLiteral(p, end, "true");
+    case 'f':
+        return skipLiteral(p, end, "false");
+    case 'n':
+        return skipLiteral(p, end, "null");
+    default:
+    {
+        bool isInt;
+        int value;
+        return (*p == '-' || (*p >= '0' && *p <= '9')) && skipNumber(p, end, isInt, value);
+    }
+    }
+}
+
+// 字段名对应的路由字段，不是路由字段返回0
+static unsigned routeField(const char *key, size_t len)
+{
+    switch (len)
+    {
+    case 2:
+        return memcmp(key, "id", 2) == 0 ? RouteFields::ID : 0;
+    case 3:
+        return memcmp(key, "seq", 3) == 0 ? RouteFields::SEQ : 0;
+    case 4:
+        return memcmp(key, "toid", 4) == 0 ? RouteFields::TOID : 0;
+    case 5:
+        return memcmp(key, "msgid", 5) == 0 ? RouteFields::MSGID : 0;
+    case 7:
+        return memcmp(key, "groupid", 7) == 0 ? RouteFields::GROUPID : 0;
+    default:
+        return 0;
+    }
+}
+
+// 当前使用的指令集
+RouteScanner::Isa RouteScanner::isa()
+{
+    return g_isa;
+}
+
+// 指定使用的指令集
+bool RouteScanner::setIsa(Isa isa)
+{
+    if (isa > bestIsa())
+    {
+        return false;
+    }
+    g_isa = isa;
+    g_findSpecial = finderOf(isa);
+    return true;
+}
+
+// 校验text是合法的json对象，并读取顶层的路由字段
+bool RouteScanner::scan(const string &text, RouteFields &fields)
+{
+    const char *p = text.data();
+    const char *end = p + text.size();
+    fields = RouteFields();
+    // 出现过的路由字段，包括值不是整数的
+    unsigned seen = 0;
+
+    skipSpace(p, end);
+    if (p == end || *p != '{')
+    {
+        return false;
+    }
+    ++p;
+    skipSpace(p, end);
+    bool first = true;
+    while (p < end && *p != '}')
+    {
+        if (!first)
+        {
+            if (*p++ != ',')
+            {
+                return false;
+            }
+            skipSpace(p, end);
+        }
+        first = false;
+
+        const char *key;
+        size_t keyLen;
+        bool escaped;
+        if (p == end || *p != '"' || !skipString(p, end, key, keyLen, escaped))
+        {
+            return false;
+        }
+        // 带转义的字段名可能和路由字段名等价，交给json::parse处理
+        if (escaped)
+        {
+            return false;
+        }
+        skipSpace(p, end);
+        if (p == end || *p++ != ':')
+        {
+            return false;
+        }
+        skipSpace(p, end);
+        if (p == end)
+        {
+            return false;
+        }
+
+        unsigned field = routeField(key, keyLen);
+        if (field == 0)
+        {
+            if (!skipValue(p, end, 1))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            // 重复的路由字段，json::parse取最后一个，这里不去猜
+            if (seen & field)
+            {
+                return false;
+            }
+            seen |= field;
+
+            bool isInt = false;
+            int value = 0;
+            if (*p == '-' || (*p >= '0' && *p <= '9'))
+            {
+                if (!skipNumber(p, end, isInt, value))
+                {
+                    return false;
+                }
+            }
+            else if (!skipValue(p, end, 1))
+            {
+                return false;
+            }
+
+            if (isInt)
+            {
+                fields.present |= field;
+                switch (field)
+                {
+                case RouteFields::MSGID:
+                    fields.msgid = value;
+                    break;
+                case RouteFields::ID:
+                    fields.id = value;
+                    break;
+                case RouteFields::TOID:
+                    fields.toid = value;
+                    break;
+                case RouteFields::GROUPID:
+                    fields.groupid = value;
+                    break;
+                default:
+                    break;
+                }
+            }
+            else if (field == RouteFields::SEQ)
+            {
+                // 不管值是什么，只要有seq字段就记下来
+                fields.present |= field;
+            }
+        }
+        skipSpace(p, end);
+    }
+    if (p == end)
+    {
+        return false;
+    }
+    ++p; // 跳过'}'
+
+    // 对象后面只能有空白
+    skipSpace(p, end);
+    return p == end;
+}
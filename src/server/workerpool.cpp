@@ -0,0 +1,199 @@
+#include "workerpool.hpp"
+
+// 一个串行队列一次最多连续执行的任务数，执行完还有任务就排到就绪队列末尾，避免一个连接占住线程
+static const int MAX_BATCH_TASKS = 16;
+
+// 当前线程所在的线程池和正在执行的串行队列，供suspendCurrent使用
+static thread_local WorkerPool *t_currentPool = nullptr;
+static thread_local const WorkerPool::SerialQueuePtr *t_currentQueue = nullptr;
+
+WorkerPool::WorkerPool(int threadNum, size_t maxQueueTasks)
+    : _threadNum(threadNum), _maxQueueTasks(maxQueueTasks), _stop(false), _pendingTasks(0)
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+    stop();
+}
+
+// 启动工作线程
+void WorkerPool::start()
+{
+    for (int i = 0; i < _threadNum; ++i)
+    {
+        _threads.emplace_back(&WorkerPool::workerTask, this);
+    }
+}
+
+// 停止工作线程
+void WorkerPool::stop()
+{
+    {
+        lock_guard<mutex> lock(_mutex);
+        if (_stop)
+        {
+            return;
+        }
+        _stop = true;
+    }
+    _cv.notify_all();
+    for (thread &t : _threads)
+    {
+        t.join();
+    }
+}
+
+// 创建一个串行队列
+WorkerPool::SerialQueuePtr WorkerPool::createQueue()
+{
+    return make_shared<SerialQueue>();
+}
+
+// 把任务提交到串行队列
+bool WorkerPool::submit(const SerialQueuePtr &queue, Task task, bool force)
+{
+    bool schedule = false;
+    {
+        lock_guard<mutex> lock(queue->_mutex);
+        if (!force && queue->_tasks.size() >= _maxQueueTasks)
+        {
+            return false;
+        }
+        queue->_tasks.push_back(std::move(task));
+        // 队列原来是空闲的，需要放入就绪队列；否则正在执行它的线程会接着执行新任务
+        if (!queue->_scheduled)
+        {
+            queue->_scheduled = true;
+            schedule = true;
+        }
+    }
+    ++_pendingTasks;
+
+    if (schedule)
+    {
+        {
+            lock_guard<mutex> lock(_mutex);
+            _ready.push_back(queue);
+        }
+        _cv.notify_one();
+    }
+    return true;
+}
+
+// 提交一个不需要和其他任务保持顺序的任务
+bool WorkerPool::submit(Task task)
+{
+    return submit(createQueue(), std::move(task), true);
+}
+
+// 暂停当前线程正在执行的串行队列
+function<void()> WorkerPool::suspendCurrent()
+{
+    if (t_currentQueue == nullptr)
+    {
+        return function<void()>();
+    }
+    WorkerPool *pool = t_currentPool;
+    SerialQueuePtr queue = *t_currentQueue;
+    {
+        lock_guard<mutex> lock(queue->_mutex);
+        queue->_suspended = true;
+    }
+    return [pool, queue]() { pool->resume(queue); };
+}
+
+// 恢复被暂停的串行队列
+void WorkerPool::resume(const SerialQueuePtr &queue)
+{
+    {
+        lock_guard<mutex> lock(queue->_mutex);
+        queue->_suspended = false;
+        // 执行它的线程还没有发现暂停(例如协程没有挂起就执行完了)，那个线程会接着执行后面的任务
+        if (!queue->_parked)
+        {
+            return;
+        }
+        queue->_parked = false;
+        if (queue->_tasks.empty())
+        {
+            queue->_scheduled = false;
+            return;
+        }
+    }
+
+    {
+        lock_guard<mutex> lock(_mutex);
+        _ready.push_back(queue);
+    }
+    _cv.notify_one();
+}
+
+// 所有串行队列中还没有执行完的任务数
+long WorkerPool::pendingTasks() const
+{
+    return _pendingTasks.load();
+}
+
+// 工作线程：取出一个就绪的串行队列，按顺序执行它的任务
+void WorkerPool::workerTask()
+{
+    for (;;)
+    {
+        SerialQueuePtr queue;
+        {
+            unique_lock<mutex> lock(_mutex);
+            _cv.wait(lock, [this]() { return _stop || !_ready.empty(); });
+            if (_stop)
+            {
+                return;
+            }
+            queue = std::move(_ready.front());
+            _ready.pop_front();
+        }
+
+        // 执行任务时不持有任何锁，任务中可以继续向这个队列提交任务
+        // 只有确认队列空了才清除_scheduled，保证同一个队列不会同时被两个线程执行
+        // 队列被暂停时放下它，_scheduled保持为true，由resume重新放入就绪队列
+        bool more = false;
+        t_currentPool = this;
+        t_currentQueue = &queue;
+        for (int executed = 0;; ++executed)
+        {
+            Task task;
+            {
+                lock_guard<mutex> lock(queue->_mutex);
+                if (queue->_suspended)
+                {
+                    queue->_parked = true;
+                    break;
+                }
+                if (queue->_tasks.empty())
+                {
+                    queue->_scheduled = false;
+                    break;
+                }
+                if (executed == MAX_BATCH_TASKS)
+                {
+                    more = true;
+                    break;
+                }
+                task = std::move(queue->_tasks.front());
+                queue->_tasks.pop_front();
+            }
+            task();
+            --_pendingTasks;
+        }
+        t_currentQueue = nullptr;
+
+        // 这一批执行完还有任务，排到就绪队列末尾，让其他连接的任务先执行
+        if (more)
+        {
+            {
+                lock_guard<mutex> lock(_mutex);
+                _ready.push_back(queue);
+            }
+            _cv.notify_one();
+        }
+    }
+}
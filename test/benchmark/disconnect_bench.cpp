@@ -0,0 +1,91 @@
+/*
+大量连接同时断开的测试
+网络抖动时可能一次断开上万条连接，每条连接断开都要找到对应的用户并从在线用户表中删除
+对比：
+1. 原来的做法：在一把锁下遍历整个在线用户表，找到值等于该连接的用户，每次断开O(在线用户数)
+2. 现在的做法：登录时把用户id记录在连接上，断开时直接按用户id删除，每次断开O(1)
+同时检查两种做法删除的结果是否一致
+
+用法：./disconnect_bench [在线用户数] [同时断开的连接数]
+*/
+#include "connectionregistry.hpp"
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// 模拟的连接，context就是TcpConnection::setContext记录的用户id
+struct FakeConnection
+{
+    int context;
+};
+using FakeConnPtr = shared_ptr<FakeConnection>;
+
+int main(int argc, char **argv)
+{
+    int users = argc > 1 ? atoi(argv[1]) : 100000;
+    int drops = argc > 2 ? atoi(argv[2]) : 10000;
+
+    vector<FakeConnPtr> conns;
+    unordered_map<int, FakeConnPtr> userConnMap;
+    mutex connMutex;
+    BasicConnectionRegistry<FakeConnPtr> registry;
+    for (int userid = 0; userid < users; ++userid)
+    {
+        FakeConnPtr conn = make_shared<FakeConnection>();
+        conn->context = userid;
+        conns.push_back(conn);
+        userConnMap.insert({userid, conn});
+        registry.insertIfAbsent(userid, conn);
+    }
+
+    // 断开间隔均匀分布的drops条连接
+    int step = users / drops > 0 ? users / drops : 1;
+
+    // 1. 遍历反查
+    auto begin = chrono::steady_clock::now();
+    int scanDropped = 0;
+    for (int i = 0; i < users && scanDropped < drops; i += step)
+    {
+        lock_guard<mutex> lock(connMutex);
+        for (auto it = userConnMap.begin(); it != userConnMap.end(); ++it)
+        {
+            if (it->second == conns[i])
+            {
+                userConnMap.erase(it);
+                ++scanDropped;
+                break;
+            }
+        }
+    }
+    auto scanEnd = chrono::steady_clock::now();
+
+    // 2. 从连接上取出用户id直接删除
+    int directDropped = 0;
+    for (int i = 0; i < users && directDropped < drops; i += step)
+    {
+        const FakeConnPtr &conn = conns[i];
+        if (registry.erase(conn->context, conn))
+        {
+            ++directDropped;
+        }
+    }
+    auto directEnd = chrono::steady_clock::now();
+
+    // 两种做法删除的用户必须完全一致
+    assert(scanDropped == directDropped);
+    for (int userid = 0; userid < users; ++userid)
+    {
+        assert((userConnMap.count(userid) > 0) == (registry.find(userid) != nullptr));
+    }
+
+    cout << "online " << users << ", dropped " << directDropped << endl;
+    cout << "scan:   " << chrono::duration_cast<chrono::milliseconds>(scanEnd - begin).count() << " ms" << endl;
+    cout << "direct: " << chrono::duration_cast<chrono::microseconds>(directEnd - scanEnd).count() << " us" << endl;
+    return 0;
+}
@@ -0,0 +1,141 @@
+/*
+消息分发性能测试
+对比每条消息从msgid找到业务方法并调用的耗时：
+1. map + std::function：unordered_map<int, MsgHandler>查找两次，按值返回std::function的副本再调用，
+   找不到时构造一个新的lambda，即改用MsgDispatch之前ChatService::getHandler的做法
+2. MsgDispatch：编译期生成的分发表，数组下标加一次函数调用，json转换成请求结构体后调用业务方法
+分别测试三种情况：
+- dispatch：业务方法什么都不做，只看分发本身的开销
+- fields：业务方法读取id和friendid两个字段(旧方式在业务方法中读json，新方式在请求结构体中读)
+- unknown：msgid没有对应的业务方法
+
+用法：./dispatch_bench [每种情况的调用次数]
+*/
+#include "msgdispatch.hpp"
+#include "request.hpp"
+#include "public.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <unordered_map>
+using namespace std;
+using namespace placeholders;
+
+// 旧方式的业务方法类型
+using MsgHandler = function<void(const TcpConnectionPtr &, json &, Timestamp)>;
+
+// 不读取任何字段的请求
+struct EmptyRequest
+{
+    explicit EmptyRequest(const json &) {}
+};
+
+// 模拟ChatService，两种分发方式调用同样的业务
+class BenchService
+{
+public:
+    BenchService() : _sum(0), _unknown(0)
+    {
+        _msgHandlerMap.insert({LOGINOUT_MSG, std::bind(&BenchService::oldEmpty, this, _1, _2, _3)});
+        _msgHandlerMap.insert({ADD_FRIEND_MSG, std::bind(&BenchService::oldAddFriend, this, _1, _2, _3)});
+    }
+
+    // 旧方式：和原来的ChatService::getHandler一样
+    MsgHandler getHandler(int msgid)
+    {
+        auto it = _msgHandlerMap.find(msgid);
+        if (it == _msgHandlerMap.end())
+        {
+            return [=](const TcpConnectionPtr &, json &, Timestamp) {
+                _unknown += msgid != 0;
+            };
+        }
+        return _msgHandlerMap[msgid];
+    }
+
+    // 新方式
+    void dispatch(int msgid, const TcpConnectionPtr &conn, json &js, Timestamp time)
+    {
+        using Dispatch = MsgDispatch<BenchService>;
+        static constexpr Dispatch::Route routes[] = {
+            {0, nullptr},
+            {LOGIN_MSG, nullptr},
+            {LOGIN_MSG_ACK, nullptr},
+            {LOGINOUT_MSG, &Dispatch::invoke<EmptyRequest, &BenchService::empty>},
+            {REG_MSG, nullptr},
+            {REG_MSG_ACK, nullptr},
+            {ONE_CHAT_MSG, nullptr},
+            {ADD_FRIEND_MSG, &Dispatch::invoke<AddFriendRequest, &BenchService::addFriend>},
+        };
+        static_assert(Dispatch::dense(routes), "routes must be indexed by msgid");
+        if (!Dispatch::dispatch(routes, *this, msgid, conn, js, time))
+        {
+            _unknown += msgid != 0;
+        }
+    }
+
+    void empty(const TcpConnectionPtr &, const EmptyRequest &, Timestamp) { ++_sum; }
+    void addFriend(const TcpConnectionPtr &, const AddFriendRequest &req, Timestamp) { _sum += req.id + req.friendid; }
+    void oldEmpty(const TcpConnectionPtr &, json &, Timestamp) { ++_sum; }
+    void oldAddFriend(const TcpConnectionPtr &, json &js, Timestamp)
+    {
+        _sum += js["id"].get<int>() + js["friendid"].get<int>();
+    }
+
+    long sum() const { return _sum; }
+    long unknown() const { return _unknown; }
+
+private:
+    unordered_map<int, MsgHandler> _msgHandlerMap;
+    long _sum;
+    long _unknown;
+};
+
+// 返回每次分发的平均耗时(ns)
+template <typename Fn>
+static double measure(long iterations, Fn fn)
+{
+    auto begin = chrono::steady_clock::now();
+    for (long i = 0; i < iterations; ++i)
+    {
+        fn();
+    }
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double, nano>(end - begin).count() / iterations;
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = argc > 1 ? atol(argv[1]) : 10000000;
+    BenchService service;
+    TcpConnectionPtr conn;
+    Timestamp time;
+
+    json emptyMsg = {{"msgid", LOGINOUT_MSG}, {"id", 1}};
+    json friendMsg = {{"msgid", ADD_FRIEND_MSG}, {"id", 1}, {"friendid", 2}};
+    json unknownMsg = {{"msgid", 99}};
+    struct Case
+    {
+        const char *name;
+        json *js;
+    } cases[] = {{"dispatch", &emptyMsg}, {"fields", &friendMsg}, {"unknown", &unknownMsg}};
+
+    cout << "case\tmap+function(ns)\tMsgDispatch(ns)\tspeedup" << endl;
+    for (Case &c : cases)
+    {
+        json &js = *c.js;
+        int msgid = js["msgid"].get<int>();
+        double oldCost = measure(iterations, [&]() {
+            MsgHandler handler = service.getHandler(msgid);
+            handler(conn, js, time);
+        });
+        double newCost = measure(iterations, [&]() { service.dispatch(msgid, conn, js, time); });
+        cout << c.name << "\t" << oldCost << "\t" << newCost << "\t" << oldCost / newCost << endl;
+    }
+
+    // 使用计算结果，防止被优化掉
+    cout << "checksum " << service.sum() << " " << service.unknown() << endl;
+    return 0;
+}
@@ -0,0 +1,164 @@
+/*
+群聊转发的锁竞争测试
+模拟ChatService中_connMutex的两种用法：
+1. 整个群成员循环都持有锁，循环里对不在本机的成员查数据库、发布redis、存储离线消息
+2. 锁里只拍下本机成员的连接快照，数据库和redis操作放到锁外批量执行
+群聊线程不停地转发大群消息，同时测量"登录"线程拿到_connMutex并修改在线用户表的耗时
+
+数据库和redis用固定的休眠模拟，不需要任何外部服务
+用法：./fanout_contention_bench [群成员数] [单次数据库往返(微秒)] [测试时长(秒)]
+*/
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// 模拟的连接对象
+struct FakeConnection
+{
+    atomic<long> bytes{0};
+    void send(size_t len) { bytes += len; }
+};
+using FakeConnectionPtr = shared_ptr<FakeConnection>;
+
+static unordered_map<int, FakeConnectionPtr> g_userConnMap;
+static mutex g_connMutex;
+static int g_dbLatencyUs = 200;
+
+// 模拟一次数据库或redis往返
+static void roundTrip()
+{
+    this_thread::sleep_for(chrono::microseconds(g_dbLatencyUs));
+}
+
+// 方式1：整个循环都持有锁，不在本机的成员每人一次往返
+static void fanoutUnderLock(const vector<int> &members)
+{
+    lock_guard<mutex> lock(g_connMutex);
+    for (int id : members)
+    {
+        auto it = g_userConnMap.find(id);
+        if (it != g_userConnMap.end())
+        {
+            it->second->send(128);
+        }
+        else
+        {
+            roundTrip(); // 查询用户状态
+            roundTrip(); // 发布redis或者存储离线消息
+        }
+    }
+}
+
+// 方式2：锁里只拍快照，锁外批量处理
+static void fanoutSnapshot(const vector<int> &members)
+{
+    vector<FakeConnectionPtr> localConns;
+    vector<int> otherIds;
+    {
+        lock_guard<mutex> lock(g_connMutex);
+        for (int id : members)
+        {
+            auto it = g_userConnMap.find(id);
+            if (it != g_userConnMap.end())
+            {
+                localConns.push_back(it->second);
+            }
+            else
+            {
+                otherIds.push_back(id);
+            }
+        }
+    }
+    for (const FakeConnectionPtr &conn : localConns)
+    {
+        conn->send(128);
+    }
+    // 批量查询状态和批量写离线消息，每64个id一次往返
+    for (size_t i = 0; i < otherIds.size(); i += 64)
+    {
+        roundTrip();
+        roundTrip();
+    }
+}
+
+template <typename Fanout>
+static void run(const char *name, Fanout fanout, const vector<int> &members, int seconds)
+{
+    atomic<bool> stop{false};
+    atomic<long> groupMsgs{0};
+
+    // 两个线程不停地转发群消息
+    vector<thread> groupThreads;
+    for (int i = 0; i < 2; ++i)
+    {
+        groupThreads.emplace_back([&]() {
+            while (!stop)
+            {
+                fanout(members);
+                ++groupMsgs;
+            }
+        });
+    }
+
+    // 一个线程模拟登录和注销，记录每次拿锁修改在线用户表的耗时
+    vector<long> latencies;
+    thread loginThread([&]() {
+        int id = 1000000;
+        while (!stop)
+        {
+            auto begin = chrono::steady_clock::now();
+            {
+                lock_guard<mutex> lock(g_connMutex);
+                g_userConnMap[id] = make_shared<FakeConnection>();
+                g_userConnMap.erase(id);
+            }
+            auto end = chrono::steady_clock::now();
+            latencies.push_back(chrono::duration_cast<chrono::microseconds>(end - begin).count());
+            ++id;
+            this_thread::sleep_for(chrono::microseconds(100));
+        }
+    });
+
+    this_thread::sleep_for(chrono::seconds(seconds));
+    stop = true;
+    for (thread &t : groupThreads)
+    {
+        t.join();
+    }
+    loginThread.join();
+
+    sort(latencies.begin(), latencies.end());
+    auto pct = [&](double p) { return latencies.empty() ? 0 : latencies[(size_t)(p * (latencies.size() - 1))]; };
+    cout << name << "\tgroup msgs/s " << groupMsgs / seconds
+         << "\tlogin lock wait p50 " << pct(0.5) << "us p99 " << pct(0.99) << "us max " << pct(1.0) << "us" << endl;
+}
+
+int main(int argc, char **argv)
+{
+    int memberCount = argc > 1 ? atoi(argv[1]) : 500;
+    g_dbLatencyUs = argc > 2 ? atoi(argv[2]) : 200;
+    int seconds = argc > 3 ? atoi(argv[3]) : 3;
+
+    // 一半成员在本机在线，一半不在本机
+    vector<int> members;
+    for (int i = 0; i < memberCount; ++i)
+    {
+        members.push_back(i);
+        if (i % 2 == 0)
+        {
+            g_userConnMap[i] = make_shared<FakeConnection>();
+        }
+    }
+
+    cout << "members " << memberCount << ", db round trip " << g_dbLatencyUs << "us" << endl;
+    run("under-lock", fanoutUnderLock, members, seconds);
+    run("snapshot", fanoutSnapshot, members, seconds);
+    return 0;
+}
@@ -0,0 +1,139 @@
+/*
+GroupModel::queryGroups 性能测试
+登录时要查询用户所在的所有群组以及群组成员，这里对比：
+1. 逐群查询：先查群组，再对每个群组各查一次成员，共 1 + N 次数据库往返
+2. 联合查询：GroupModel::queryGroups，一次数据库往返
+
+用法：./groupquery_bench [每个群的成员数] [重复次数]
+会在chat库中临时创建测试用户和群组，测试结束后删除
+*/
+#include "groupmodel.hpp"
+#include "usermodel.hpp"
+#include "connectionpool.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// 逐群查询的实现，即优化之前的GroupModel::queryGroups
+static vector<Group> queryGroupsOneByOne(int userid)
+{
+    vector<Group> groupVec;
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql == nullptr)
+    {
+        return groupVec;
+    }
+
+    Statement *stmt = mysql->prepare("select a.id,a.groupname,a.groupdesc from allgroup a inner join "
+                                     "groupuser b on a.id = b.groupid where b.userid = ?");
+    if (stmt != nullptr && stmt->execute(userid))
+    {
+        int id;
+        string name, desc;
+        while (stmt->fetch(id, name, desc))
+        {
+            groupVec.emplace_back(id, name, desc);
+        }
+    }
+
+    stmt = mysql->prepare("select a.id,a.name,a.state,b.grouprole from user a "
+                          "inner join groupuser b on b.userid = a.id where b.groupid = ?");
+    for (Group &group : groupVec)
+    {
+        if (stmt == nullptr || !stmt->execute(group.getId()))
+        {
+            continue;
+        }
+        int id;
+        string name, state, role;
+        while (stmt->fetch(id, name, state, role))
+        {
+            GroupUser user;
+            user.setId(id);
+            user.setName(name);
+            user.setState(state);
+            user.setRole(role);
+            group.getUsers().push_back(user);
+        }
+    }
+    return groupVec;
+}
+
+// 执行fn若干次，返回平均耗时(微秒)
+template <typename Fn>
+static double measure(int rounds, Fn fn)
+{
+    auto begin = chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i)
+    {
+        fn();
+    }
+    auto end = chrono::steady_clock::now();
+    return chrono::duration_cast<chrono::microseconds>(end - begin).count() / (double)rounds;
+}
+
+int main(int argc, char **argv)
+{
+    int members = argc > 1 ? atoi(argv[1]) : 10;
+    int rounds = argc > 2 ? atoi(argv[2]) : 20;
+
+    UserModel userModel;
+    GroupModel groupModel;
+
+    // 准备测试用户，第一个用户是要登录的用户，其余用户作为群成员
+    vector<int> userids;
+    for (int i = 0; i < members; ++i)
+    {
+        User user(-1, "bench_user_" + to_string(i), "123456");
+        if (!userModel.insert(user))
+        {
+            cerr << "insert bench user failed, is mysql chat database ready?" << endl;
+            return -1;
+        }
+        userids.push_back(user.getId());
+    }
+
+    cout << "groups\tmembers\tone-by-one(us)\tjoined(us)" << endl;
+    vector<int> groupids;
+    for (int groups : {1, 10, 50, 100, 200})
+    {
+        // 补足群组数量，每个群都包含全部测试用户
+        while ((int)groupids.size() < groups)
+        {
+            Group group(-1, "bench_group_" + to_string(groupids.size()), "benchmark");
+            if (!groupModel.createGroup(group))
+            {
+                cerr << "create bench group failed!" << endl;
+                return -1;
+            }
+            for (int userid : userids)
+            {
+                groupModel.addGroup(userid, group.getId(), "normal");
+            }
+            groupids.push_back(group.getId());
+        }
+
+        double oneByOne = measure(rounds, [&]() { queryGroupsOneByOne(userids[0]); });
+        double joined = measure(rounds, [&]() { groupModel.queryGroups(userids[0]); });
+        cout << groups << "\t" << members << "\t" << oneByOne << "\t" << joined << endl;
+    }
+
+    // 清理测试数据
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql != nullptr)
+    {
+        for (int groupid : groupids)
+        {
+            mysql->update("delete from groupuser where groupid = " + to_string(groupid));
+            mysql->update("delete from allgroup where id = " + to_string(groupid));
+        }
+        for (int userid : userids)
+        {
+            mysql->update("delete from user where id = " + to_string(userid));
+        }
+    }
+    return 0;
+}
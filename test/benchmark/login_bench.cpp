@@ -0,0 +1,188 @@
+/*
+登录查询并行化性能测试
+登录要查询用户信息、在线状态、最大消息序号、好友、群组、离线消息，并记录在线状态，这里对比两种写法的登录耗时：
+1. sequential：每个查询依次co_await，即改用whenAll之前ChatService::login的做法，耗时是所有查询的总和
+2. whenAll：和ChatService::login一样分三步，查询用户和在线状态、读取最大序号并记录在线状态、其余查询，
+   每一步中互不依赖的查询同时进行，耗时接近每一步中最慢的查询
+查询用sleep模拟，耗时见下面的常量(ms)，mysql、redis的线程数和ChatService一致
+分别测试同时只有一个登录，和同时有很多登录(线程池成为瓶颈，看并行化之后吞吐量有没有下降)
+不依赖外部服务
+
+用法：./login_bench [每种情况的登录次数] [同时进行的登录数]
+*/
+#include "asyncio.hpp"
+#include "task.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+using namespace std;
+
+using Clock = chrono::steady_clock;
+
+// 模拟的查询耗时(ms)
+static const int USER_QUERY_MS = 2;
+static const int PRESENCE_QUERY_MS = 1;
+static const int PRESENCE_ONLINE_MS = 1;
+static const int CURRENT_SEQ_MS = 1;
+static const int FRIEND_QUERY_MS = 3;
+static const int GROUP_QUERY_MS = 5;
+static const int OFFLINE_QUERY_MS = 3;
+
+// 和ChatService一致
+static const int ASYNC_DB_THREADS = 32;
+static const int ASYNC_REDIS_THREADS = 4;
+
+static AsyncIo g_async(ASYNC_DB_THREADS, ASYNC_REDIS_THREADS);
+
+// 模拟一次查询
+static int query(int ms)
+{
+    this_thread::sleep_for(chrono::milliseconds(ms));
+    return ms;
+}
+
+// 查询依次进行
+static Task<int> loginSequential(EventLoop *loop)
+{
+    int sum = co_await g_async.db(loop, []() { return query(USER_QUERY_MS); });
+    sum += co_await g_async.redis(loop, []() { return query(PRESENCE_QUERY_MS); });
+    sum += co_await g_async.redis(loop, []() { return query(PRESENCE_ONLINE_MS); });
+    sum += co_await g_async.redis(loop, []() { return query(CURRENT_SEQ_MS); });
+    sum += co_await g_async.db(loop, []() { return query(FRIEND_QUERY_MS); });
+    sum += co_await g_async.db(loop, []() { return query(GROUP_QUERY_MS); });
+    sum += co_await g_async.db(loop, []() { return query(OFFLINE_QUERY_MS); });
+    co_return sum;
+}
+
+// 和ChatService::login一样分三步，读取最大序号之后记录在线状态，记录在线状态要在查询离线消息之前完成
+static Task<int> loginWhenAll(EventLoop *loop)
+{
+    auto [user, presence] = co_await whenAll(
+        g_async.db(loop, []() { return query(USER_QUERY_MS); }),
+        g_async.redis(loop, []() { return query(PRESENCE_QUERY_MS); }));
+    int seqOnline = co_await g_async.redis(loop, []() { return query(CURRENT_SEQ_MS) + query(PRESENCE_ONLINE_MS); });
+    auto [friends, groups, offline] = co_await whenAll(
+        g_async.db(loop, []() { return query(FRIEND_QUERY_MS); }),
+        g_async.db(loop, []() { return query(GROUP_QUERY_MS); }),
+        g_async.db(loop, []() { return query(OFFLINE_QUERY_MS); }));
+    co_return user + presence + seqOnline + friends + groups + offline;
+}
+
+// 一次测试：总共logins个登录，同时最多concurrency个，所有协程在loop上执行
+class Runner
+{
+public:
+    Runner(EventLoop *loop, Task<int> (*login)(EventLoop *), int logins, int concurrency)
+        : _loop(loop), _login(login), _logins(logins), _concurrency(concurrency), _started(0), _finished(0)
+    {
+    }
+
+    void run()
+    {
+        _begin = Clock::now();
+        _loop->runInLoop([this]() {
+            for (int i = 0; i < _concurrency && _started < _logins; ++i)
+            {
+                startOne();
+            }
+        });
+        unique_lock<mutex> lock(_mutex);
+        _cv.wait(lock, [this]() { return _finished == _logins; });
+        _end = Clock::now();
+    }
+
+    void report(const char *mode)
+    {
+        sort(_latencies.begin(), _latencies.end());
+        double seconds = chrono::duration<double>(_end - _begin).count();
+        cout << mode << "\t" << _concurrency << "\t" << _latencies[_latencies.size() / 2] / 1000.0 << "\t"
+             << _latencies[_latencies.size() * 99 / 100] / 1000.0 << "\t" << _logins / seconds << endl;
+    }
+
+private:
+    // 在loop上调用
+    void startOne()
+    {
+        ++_started;
+        spawn(one());
+    }
+
+    Task<void> one()
+    {
+        Clock::time_point begin = Clock::now();
+        int sum = co_await _login(_loop);
+        if (sum != USER_QUERY_MS + PRESENCE_QUERY_MS + PRESENCE_ONLINE_MS + CURRENT_SEQ_MS +
+                       FRIEND_QUERY_MS + GROUP_QUERY_MS + OFFLINE_QUERY_MS)
+        {
+            cerr << "unexpected result " << sum << endl;
+            exit(-1);
+        }
+        _latencies.push_back(chrono::duration_cast<chrono::microseconds>(Clock::now() - begin).count());
+        if (_started < _logins)
+        {
+            startOne();
+        }
+        lock_guard<mutex> lock(_mutex);
+        if (++_finished == _logins)
+        {
+            _cv.notify_one();
+        }
+    }
+
+    EventLoop *_loop;
+    Task<int> (*_login)(EventLoop *);
+    const int _logins;
+    const int _concurrency;
+    int _started;
+    int _finished;
+    vector<long> _latencies;
+    Clock::time_point _begin;
+    Clock::time_point _end;
+    mutex _mutex;
+    condition_variable _cv;
+};
+
+int main(int argc, char **argv)
+{
+    int logins = argc > 1 ? atoi(argv[1]) : 500;
+    int concurrency = argc > 2 ? atoi(argv[2]) : 200;
+
+    g_async.start();
+    // EventLoop要在执行loop的线程中创建
+    EventLoop *loop = nullptr;
+    mutex loopMutex;
+    condition_variable loopCv;
+    thread loopThread([&]() {
+        EventLoop threadLoop;
+        {
+            lock_guard<mutex> lock(loopMutex);
+            loop = &threadLoop;
+        }
+        loopCv.notify_one();
+        threadLoop.loop();
+    });
+    {
+        unique_lock<mutex> lock(loopMutex);
+        loopCv.wait(lock, [&]() { return loop != nullptr; });
+    }
+
+    cout << "mode\tconcurrency\tp50(ms)\tp99(ms)\tlogins/s" << endl;
+    for (int c : {1, concurrency})
+    {
+        int n = c == 1 ? max(1, logins / 10) : logins;
+        Runner sequential(loop, loginSequential, n, c);
+        sequential.run();
+        sequential.report("sequential");
+        Runner parallel(loop, loginWhenAll, n, c);
+        parallel.run();
+        parallel.report("whenAll");
+    }
+
+    loop->quit();
+    loopThread.join();
+    g_async.stop();
+    return 0;
+}
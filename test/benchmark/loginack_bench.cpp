@@ -0,0 +1,183 @@
+/*
+登录响应编码性能测试
+对比不同好友数、群组数、群成员数时，生成一条登录成功响应的耗时和消息长度：
+1. nested json：每个好友、群组、群成员构造一个json对象，dump成字符串后放进外层json数组，
+   最后整体再dump一次，即改用LoginAck之前ChatService::login的做法
+2. LoginAck兼容格式：消息内容和原来一样(元素仍然是json字符串)，只是一遍直接写入Buffer
+3. LoginAck结构化格式：元素直接是json对象，不再二次转义
+同时对比客户端解析登录响应的耗时：原来的格式要对每个元素再json::parse一次
+
+用法：./loginack_bench [每种情况的编码次数]
+*/
+#include "loginack.hpp"
+#include "json.hpp"
+#include "public.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+using json = nlohmann::json;
+
+// 一种测试情况
+struct Case
+{
+    const char *name;
+    int friends;
+    int groups;
+    int members;
+};
+
+static vector<User> makeFriends(int n)
+{
+    vector<User> friends;
+    for (int i = 0; i < n; ++i)
+    {
+        friends.emplace_back(100000 + i, "friend" + to_string(i), "", i % 3 ? "offline" : "online");
+    }
+    return friends;
+}
+
+static vector<Group> makeGroups(int n, int members)
+{
+    vector<Group> groups;
+    for (int g = 0; g < n; ++g)
+    {
+        Group group(g + 1, "group" + to_string(g), "a group used for the login benchmark");
+        for (int m = 0; m < members; ++m)
+        {
+            GroupUser user;
+            user.setId(200000 + m);
+            user.setName("member" + to_string(m));
+            user.setState(m % 3 ? "offline" : "online");
+            user.setRole(m == 0 ? "creator" : "normal");
+            group.getUsers().push_back(user);
+        }
+        groups.push_back(group);
+    }
+    return groups;
+}
+
+// 原来的做法
+static string encodeNested(User &user, long long seq, vector<User> &userVec, vector<Group> &groupuserVec)
+{
+    json response;
+    response["msgid"] = LOGIN_MSG_ACK;
+    response["errno"] = 0;
+    response["id"] = user.getId();
+    response["name"] = user.getName();
+    response["seq"] = seq;
+    if (!userVec.empty())
+    {
+        vector<string> vec2;
+        for (User &user : userVec)
+        {
+            json js;
+            js["id"] = user.getId();
+            js["name"] = user.getName();
+            js["state"] = user.getState();
+            vec2.emplace_back(js.dump());
+        }
+        response["friends"] = vec2;
+    }
+    if (!groupuserVec.empty())
+    {
+        vector<string> groupV;
+        for (Group &group : groupuserVec)
+        {
+            json grpjson;
+            grpjson["id"] = group.getId();
+            grpjson["groupname"] = group.getName();
+            grpjson["groupdesc"] = group.getDesc();
+            vector<string> userV;
+            for (GroupUser &user : group.getUsers())
+            {
+                json js;
+                js["id"] = user.getId();
+                js["name"] = user.getName();
+                js["state"] = user.getState();
+                js["role"] = user.getRole();
+                userV.push_back(js.dump());
+            }
+            grpjson["users"] = userV;
+            groupV.push_back(grpjson.dump());
+        }
+        response["groups"] = groupV;
+    }
+    return response.dump();
+}
+
+// 客户端解析：和ChatClient一样，元素是字符串时再解析一次，返回读到的群成员数
+static long decode(const string &message)
+{
+    json response = json::parse(message);
+    long members = 0;
+    for (const json &groupElement : response["groups"])
+    {
+        json group = groupElement.is_string() ? json::parse(groupElement.get<string>()) : groupElement;
+        for (const json &userElement : group["users"])
+        {
+            json user = userElement.is_string() ? json::parse(userElement.get<string>()) : userElement;
+            members += user["id"].get<int>() > 0;
+        }
+    }
+    return members;
+}
+
+// 返回每次调用的平均耗时(us)
+template <typename Fn>
+static double measure(long iterations, Fn fn)
+{
+    auto begin = chrono::steady_clock::now();
+    for (long i = 0; i < iterations; ++i)
+    {
+        fn();
+    }
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double, micro>(end - begin).count() / iterations;
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = argc > 1 ? atol(argv[1]) : 200;
+    const Case cases[] = {
+        {"small", 20, 5, 10},
+        {"medium", 100, 20, 50},
+        {"large", 500, 50, 200},
+    };
+
+    cout << "case\tformat\tbytes\tencode(us)\tspeedup\tclient decode(us)" << endl;
+    for (const Case &c : cases)
+    {
+        User user(1, "bench");
+        vector<User> friends = makeFriends(c.friends);
+        vector<Group> groups = makeGroups(c.groups, c.members);
+        long n = max(1L, iterations * 5 / c.members);
+
+        string nested = encodeNested(user, 42, friends, groups);
+        double base = measure(n, [&]() { nested = encodeNested(user, 42, friends, groups); });
+        double baseDecode = measure(n, [&]() { decode(nested); });
+        cout << c.name << "\tnested json\t" << nested.size() << "\t" << base << "\t1.0\t" << baseDecode << endl;
+
+        for (bool structured : {false, true})
+        {
+            string message;
+            double cost = measure(n, [&]() {
+                Buffer buf;
+                LoginAck::write(buf, user, 42, friends, groups, structured);
+                message.assign(buf.peek(), buf.readableBytes());
+            });
+            if (decode(message) != decode(nested))
+            {
+                cerr << "unexpected result" << endl;
+                return -1;
+            }
+            double decodeCost = measure(n, [&]() { decode(message); });
+            cout << c.name << "\t" << (structured ? "structured" : "compatible") << "\t" << message.size() << "\t"
+                 << cost << "\t" << base / cost << "\t" << decodeCost << endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,132 @@
+/*
+登录时读取最大序号和记录上线的顺序检查
+登录响应中的seq是客户端去重(SeqFilter)的起点。其他服务器上的用户给正在登录的用户发消息时，
+分配序号和查询用户在哪台服务器上是两步，可能落在登录的任意两步之间。这里把一条消息的这两步
+放到登录过程的每一种位置上，检查客户端最终都显示了这条消息，并且只显示一次
+曾经的问题：登录时先记录上线再读取seq，记录上线之后分配的序号在线推送过来，但不超过seq，被客户端按游标丢掉
+现在ChatService::login先读取seq再记录上线，客户端对序号不超过seq的消息单独去重，两种顺序都检查
+
+服务器用一个计数器和在线标记模拟，不依赖外部服务
+用法：./loginseq_check，成功返回0
+*/
+#include "seqfilter.hpp"
+
+#include <iostream>
+#include <vector>
+using namespace std;
+
+// 登录过程中可以插入发送者操作的位置
+enum Point
+{
+    BEFORE_LOGIN,  // 登录之前
+    AFTER_STEP1,   // 登录的第一步之后
+    AFTER_STEP2,   // 登录的第二步之后
+    AFTER_OFFLINE, // 查询离线消息之后
+    AFTER_ACK,     // 登录响应发出之后
+    POINT_COUNT
+};
+
+// 模拟的集群：收件人的序号计数器、是否在线、离线消息、在线推送的消息
+struct Cluster
+{
+    long long seqCounter = 10;
+    bool online = false;
+    vector<long long> offline;
+    vector<long long> live;
+};
+
+// 一次模拟：发送者在allocAt分配序号，在routeAt查询收件人是否在线并转发
+// 返回这条消息是否丢失(没有显示，也不在之后还会推送的离线消息中)或者显示了多次
+static bool lost(bool readSeqFirst, Point allocAt, Point routeAt)
+{
+    Cluster cluster;
+    long long msgSeq = 0;
+    long long loginSeq = 0;
+    vector<long long> offlinePage;
+
+    auto sender = [&](Point at) {
+        if (at == allocAt)
+        {
+            msgSeq = ++cluster.seqCounter;
+        }
+        if (at == routeAt)
+        {
+            (cluster.online ? cluster.live : cluster.offline).push_back(msgSeq);
+        }
+    };
+
+    sender(BEFORE_LOGIN);
+    if (readSeqFirst)
+    {
+        loginSeq = cluster.seqCounter;
+    }
+    else
+    {
+        cluster.online = true;
+    }
+    sender(AFTER_STEP1);
+    if (readSeqFirst)
+    {
+        cluster.online = true;
+    }
+    else
+    {
+        loginSeq = cluster.seqCounter;
+    }
+    sender(AFTER_STEP2);
+    offlinePage = cluster.offline;
+    sender(AFTER_OFFLINE);
+    sender(AFTER_ACK);
+
+    // 客户端：收到登录响应、第一页离线消息，然后是在线推送
+    SeqFilter filter;
+    filter.reset(loginSeq);
+    int shown = 0;
+    for (long long seq : offlinePage)
+    {
+        shown += filter.acceptOffline(seq);
+    }
+    for (long long seq : cluster.live)
+    {
+        shown += filter.accept(seq);
+    }
+    // 已经显示的消息再从增量同步到达一次，不能再显示
+    if (shown == 1)
+    {
+        shown += filter.accept(msgSeq);
+    }
+
+    // 查询离线消息之后才存入的离线消息，客户端确认这一页之后、或者下次登录时推送，不算丢失
+    bool pending = cluster.offline.size() > offlinePage.size();
+    return pending ? shown != 0 : shown != 1;
+}
+
+int main()
+{
+    int failures = 0;
+    for (bool readSeqFirst : {false, true})
+    {
+        int lostCount = 0;
+        for (int alloc = BEFORE_LOGIN; alloc < POINT_COUNT; ++alloc)
+        {
+            for (int route = alloc; route < POINT_COUNT; ++route)
+            {
+                if (lost(readSeqFirst, static_cast<Point>(alloc), static_cast<Point>(route)))
+                {
+                    ++lostCount;
+                    cerr << "FAIL: alloc at " << alloc << ", route at " << route << endl;
+                }
+            }
+        }
+        cout << (readSeqFirst ? "read seq, then online" : "online, then read seq") << ": " << lostCount
+             << " interleavings lose or repeat the message" << endl;
+        failures += lostCount;
+    }
+
+    if (failures != 0)
+    {
+        return 1;
+    }
+    cout << "PASS" << endl;
+    return 0;
+}
@@ -0,0 +1,181 @@
+/*
+离线消息端到端检查
+用户A给离线的用户B发一条消息，B登录之后，检查这条消息出现在离线消息中，并且客户端的序号去重(SeqFilter)会显示它
+离线消息的序号不超过登录响应中的seq，曾经被客户端按游标当作重复消息丢掉，然后确认删除，消息就丢了
+
+需要运行中的ChatServer(以及它依赖的mysql和redis)，每次运行注册两个新用户
+用法：./offline_roundtrip [ip] [port]，成功返回0
+*/
+#include "json.hpp"
+#include "public.hpp"
+#include "seqfilter.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+using namespace std;
+using json = nlohmann::json;
+
+// 连接服务器，读超时3秒，失败返回-1
+static int connectServer(const char *ip, uint16_t port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in server;
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(port);
+    server.sin_addr.s_addr = inet_addr(ip);
+    if (fd == -1 || connect(fd, (sockaddr *)&server, sizeof(server)) == -1)
+    {
+        return -1;
+    }
+    timeval timeout = {3, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    return fd;
+}
+
+// 按"4字节包头+消息体"的帧格式收发，和ChatClient一致
+static bool sendMsg(int fd, const json &js)
+{
+    string body = js.dump();
+    uint32_t header = htonl(static_cast<uint32_t>(body.size()));
+    string frame(reinterpret_cast<const char *>(&header), MSG_HEADER_LEN);
+    frame.append(body);
+    return send(fd, frame.data(), frame.size(), 0) == static_cast<ssize_t>(frame.size());
+}
+
+static bool readn(int fd, char *buf, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = recv(fd, buf, len, 0);
+        if (n <= 0)
+        {
+            return false;
+        }
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+// 接收一条json消息，超时或者连接断开返回false
+static bool recvMsg(int fd, json &js)
+{
+    uint32_t header;
+    if (!readn(fd, reinterpret_cast<char *>(&header), MSG_HEADER_LEN))
+    {
+        return false;
+    }
+    string body(ntohl(header), '\0');
+    if (!readn(fd, &body[0], body.size()))
+    {
+        return false;
+    }
+    js = json::parse(body);
+    return true;
+}
+
+// 接收消息直到收到msgid类型的消息
+static bool recvUntil(int fd, int msgid, json &js)
+{
+    while (recvMsg(fd, js))
+    {
+        if (js.value("msgid", 0) == msgid)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int fail(const string &reason)
+{
+    cerr << "FAIL: " << reason << endl;
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    const char *ip = argc > 1 ? argv[1] : "127.0.0.1";
+    uint16_t port = argc > 2 ? atoi(argv[2]) : 6000;
+
+    int fdA = connectServer(ip, port);
+    int fdB = connectServer(ip, port);
+    if (fdA == -1 || fdB == -1)
+    {
+        return fail("can not connect to server");
+    }
+
+    // 注册两个新用户
+    string suffix = to_string(chrono::steady_clock::now().time_since_epoch().count() % 1000000);
+    int ids[2];
+    for (int i = 0; i < 2; ++i)
+    {
+        json response;
+        if (!sendMsg(fdA, {{"msgid", REG_MSG}, {"name", "roundtrip" + to_string(i) + "_" + suffix}, {"password", "123"}}) ||
+            !recvUntil(fdA, REG_MSG_ACK, response) || response["errno"].get<int>() != 0)
+        {
+            return fail("register");
+        }
+        ids[i] = response["id"].get<int>();
+    }
+
+    // A登录，给还没有登录的B发一条消息
+    json response;
+    if (!sendMsg(fdA, {{"msgid", LOGIN_MSG}, {"id", ids[0]}, {"password", "123"}, {"structured", true}}) ||
+        !recvUntil(fdA, LOGIN_MSG_ACK, response) || response["errno"].get<int>() != 0)
+    {
+        return fail("login A");
+    }
+    string text = "offline roundtrip " + suffix;
+    if (!sendMsg(fdA, {{"msgid", ONE_CHAT_MSG}, {"id", ids[0]}, {"name", "A"}, {"toid", ids[1]},
+                       {"msg", text}, {"time", "2024-01-01 00:00:00"}}))
+    {
+        return fail("send chat");
+    }
+    // 等服务器处理完这条消息
+    this_thread::sleep_for(chrono::milliseconds(200));
+
+    // B登录，收到登录响应和离线消息
+    SeqFilter filter;
+    if (!sendMsg(fdB, {{"msgid", LOGIN_MSG}, {"id", ids[1]}, {"password", "123"}, {"structured", true}}) ||
+        !recvUntil(fdB, LOGIN_MSG_ACK, response) || response["errno"].get<int>() != 0)
+    {
+        return fail("login B");
+    }
+    filter.reset(response.value("seq", 0LL));
+    if (!recvUntil(fdB, OFFLINE_MSG, response))
+    {
+        return fail("no OFFLINE_MSG after login");
+    }
+
+    bool shown = false;
+    for (const json &element : response["offlinemsg"])
+    {
+        json msg = json::parse(element.get<string>());
+        if (msg.value("msg", string()) == text && filter.acceptOffline(msg.value("seq", 0LL)))
+        {
+            shown = true;
+        }
+    }
+    sendMsg(fdB, {{"msgid", OFFLINE_MSG_ACK}, {"cursor", response["cursor"]}});
+    close(fdA);
+    close(fdB);
+
+    if (!shown)
+    {
+        return fail("offline message was not shown");
+    }
+    cout << "PASS" << endl;
+    return 0;
+}
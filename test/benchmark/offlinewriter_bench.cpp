@@ -0,0 +1,92 @@
+/*
+离线群消息写入性能测试
+一条群消息发给group个离线成员，这里对比每秒能处理多少条群消息：
+1. 同步写入：在调用线程上直接执行OfflineMsgModel::insert，即改用OfflineMsgWriter之前groupChat的做法
+2. 批量异步写入：OfflineMsgWriter::write放入队列，由后台线程合并成多行insert写入，最后flush等待全部写完
+同时统计调用线程上单次写入的平均耗时，这部分时间在服务器上是占用I/O线程的
+
+用法：./offlinewriter_bench [群成员数] [群消息条数]
+测试数据写入chat库的offlinemessage表，使用不存在的用户id，测试结束后删除
+*/
+#include "offlinemessagemodel.hpp"
+#include "offlinemsgwriter.hpp"
+#include "connectionpool.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// 测试用的用户id从这里开始，避免和真实用户冲突
+static const int BENCH_USERID_BASE = 900000000;
+
+// 删除测试写入的离线消息，返回删除的行数
+static long cleanup(int members)
+{
+    shared_ptr<MySQL> mysql = ConnectionPool::instance()->getConnection();
+    if (mysql == nullptr)
+    {
+        return 0;
+    }
+    Statement *stmt = mysql->prepare("delete from offlinemessage where userid >= ? and userid < ?");
+    if (stmt == nullptr || !stmt->execute(BENCH_USERID_BASE, BENCH_USERID_BASE + members))
+    {
+        return 0;
+    }
+    return static_cast<long>(stmt->affectedRows());
+}
+
+int main(int argc, char **argv)
+{
+    int members = argc > 1 ? atoi(argv[1]) : 1000;
+    int messages = argc > 2 ? atoi(argv[2]) : 200;
+
+    // 和真实的群消息差不多长，所有接收者共享一份消息内容
+    auto payload = make_shared<const string>(
+        "{\"msgid\":9,\"id\":1,\"name\":\"bench\",\"groupid\":1,"
+        "\"msg\":\"hello everyone, this is a benchmark message\",\"time\":\"2024-01-01 00:00:00\"}");
+    vector<OfflineMsgModel::OfflineMsg> msgs;
+    for (int i = 0; i < members; ++i)
+    {
+        msgs.emplace_back(BENCH_USERID_BASE + i, payload);
+    }
+
+    OfflineMsgModel model;
+    cleanup(members);
+
+    cout << "members\tmessages\tmode\tmsg/s\tcaller(us/msg)\trows" << endl;
+
+    // 1. 同步写入
+    {
+        auto begin = chrono::steady_clock::now();
+        for (int i = 0; i < messages; ++i)
+        {
+            model.insert(msgs);
+        }
+        auto end = chrono::steady_clock::now();
+        double us = chrono::duration_cast<chrono::microseconds>(end - begin).count();
+        cout << members << "\t" << messages << "\tsync\t" << messages / (us / 1e6) << "\t"
+             << us / messages << "\t" << cleanup(members) << endl;
+    }
+
+    // 2. 批量异步写入，吞吐按flush完成的时间计算
+    {
+        OfflineMsgWriter writer(model);
+        auto begin = chrono::steady_clock::now();
+        for (int i = 0; i < messages; ++i)
+        {
+            writer.write(msgs);
+        }
+        auto queued = chrono::steady_clock::now();
+        while (!writer.flush())
+        {
+        }
+        auto end = chrono::steady_clock::now();
+        double callerUs = chrono::duration_cast<chrono::microseconds>(queued - begin).count();
+        double us = chrono::duration_cast<chrono::microseconds>(end - begin).count();
+        cout << members << "\t" << messages << "\tbatched\t" << messages / (us / 1e6) << "\t"
+             << callerUs / messages << "\t" << cleanup(members) << endl;
+    }
+    return 0;
+}
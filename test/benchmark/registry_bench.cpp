@@ -0,0 +1,117 @@
+/*
+在线用户连接表性能测试
+对比：
+1. 一把互斥锁保护的unordered_map，即原来ChatService中的_userConnMap + _connMutex
+2. 按用户id分片加锁的ConnectionRegistry
+每个线程随机访问在线用户，90%是查找(单聊、群聊、redis转发)，10%是登录和注销
+
+用法：./registry_bench [在线用户数] [每个线程的操作次数]
+*/
+#include "connectionregistry.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+// 用shared_ptr<int>代替TcpConnectionPtr，拷贝和比较的开销是一样的
+using FakeConnPtr = shared_ptr<int>;
+
+// 原来的实现：一把锁保护整个表
+class SingleLockMap
+{
+public:
+    bool insertIfAbsent(int userid, const FakeConnPtr &conn)
+    {
+        lock_guard<mutex> lock(_connMutex);
+        return _userConnMap.insert({userid, conn}).second;
+    }
+    bool erase(int userid)
+    {
+        lock_guard<mutex> lock(_connMutex);
+        return _userConnMap.erase(userid) > 0;
+    }
+    FakeConnPtr find(int userid)
+    {
+        lock_guard<mutex> lock(_connMutex);
+        auto it = _userConnMap.find(userid);
+        return it != _userConnMap.end() ? it->second : FakeConnPtr();
+    }
+
+private:
+    unordered_map<int, FakeConnPtr> _userConnMap;
+    mutex _connMutex;
+};
+
+// 多个线程同时访问表，返回每秒的操作次数
+template <typename Map>
+static double run(Map &map, int users, int threads, int opsPerThread)
+{
+    vector<thread> workers;
+    auto begin = chrono::steady_clock::now();
+    for (int t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&, t]() {
+            mt19937 rng(t);
+            uniform_int_distribution<int> userDist(0, users - 1);
+            uniform_int_distribution<int> opDist(0, 9);
+            FakeConnPtr conn = make_shared<int>(t);
+            long found = 0;
+            for (int i = 0; i < opsPerThread; ++i)
+            {
+                int userid = userDist(rng);
+                if (opDist(rng) == 0)
+                {
+                    // 模拟注销后重新登录
+                    map.erase(userid);
+                    map.insertIfAbsent(userid, conn);
+                }
+                else if (map.find(userid))
+                {
+                    ++found;
+                }
+            }
+            // 防止查找被编译器优化掉
+            if (found < 0)
+            {
+                cout << found << endl;
+            }
+        });
+    }
+    for (thread &w : workers)
+    {
+        w.join();
+    }
+    auto end = chrono::steady_clock::now();
+    double seconds = chrono::duration_cast<chrono::microseconds>(end - begin).count() / 1e6;
+    return threads * (double)opsPerThread / seconds;
+}
+
+int main(int argc, char **argv)
+{
+    int users = argc > 1 ? atoi(argv[1]) : 100000;
+    int opsPerThread = argc > 2 ? atoi(argv[2]) : 200000;
+
+    cout << "threads\tsingle-lock(ops/s)\tsharded(ops/s)" << endl;
+    for (int threads : {4, 16, 64})
+    {
+        SingleLockMap single;
+        BasicConnectionRegistry<FakeConnPtr> sharded;
+        FakeConnPtr conn = make_shared<int>(0);
+        for (int userid = 0; userid < users; ++userid)
+        {
+            single.insertIfAbsent(userid, conn);
+            sharded.insertIfAbsent(userid, conn);
+        }
+
+        double singleOps = run(single, users, threads, opsPerThread);
+        double shardedOps = run(sharded, users, threads, opsPerThread);
+        cout << threads << "\t" << (long)singleOps << "\t" << (long)shardedOps << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,124 @@
+/*
+路由字段扫描性能测试
+ChatServer::onMessage收到一条聊天消息，只需要msgid和toid就能转发，这里对比取出这两个字段的耗时：
+1. json::parse：构造整个json对象后读取字段，即改用RouteScanner之前的做法
+2. RouteScanner::scan：一遍扫描校验整条消息并读取路由字段，分别使用逐字节、SSE2、AVX2跳过字符串
+消息长度从64字节到8KB，msg字段分别是ASCII文本和中文文本(非ASCII字节要逐字节校验UTF-8)
+
+用法：./routescanner_bench [每种长度扫描的总字节数(MB)]
+*/
+#include "routescanner.hpp"
+#include "json.hpp"
+#include "public.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+using json = nlohmann::json;
+
+// 生成一条长度约为size字节的一对一聊天消息，msg字段由text重复填充
+static string makeMessage(size_t size, const string &text)
+{
+    json js;
+    js["msgid"] = ONE_CHAT_MSG;
+    js["id"] = 1000001;
+    js["name"] = "bench";
+    js["toid"] = 1000002;
+    js["time"] = "2024-01-01 00:00:00";
+    js["msg"] = "";
+    size_t overhead = js.dump().size();
+    string msg;
+    while (overhead + msg.size() + text.size() <= size)
+    {
+        msg += text;
+    }
+    // 用ASCII补齐，不截断多字节字符
+    while (overhead + msg.size() < size)
+    {
+        msg += 'x';
+    }
+    js["msg"] = msg;
+    return js.dump();
+}
+
+// 重复处理同一条消息，返回每条消息的平均耗时(ns)
+template <typename Fn>
+static double measure(const string &message, long iterations, Fn fn)
+{
+    long sum = 0;
+    auto begin = chrono::steady_clock::now();
+    for (long i = 0; i < iterations; ++i)
+    {
+        sum += fn(message);
+    }
+    auto end = chrono::steady_clock::now();
+    // 使用计算结果，防止被优化掉
+    if (sum != iterations * (ONE_CHAT_MSG + 1000002L))
+    {
+        cerr << "unexpected result " << sum << endl;
+        exit(-1);
+    }
+    return chrono::duration<double, nano>(end - begin).count() / iterations;
+}
+
+static long byJson(const string &message)
+{
+    json js = json::parse(message);
+    return js["msgid"].get<int>() + js["toid"].get<int>();
+}
+
+static long byScanner(const string &message)
+{
+    RouteFields fields;
+    if (!RouteScanner::scan(message, fields))
+    {
+        return 0;
+    }
+    return fields.msgid + fields.toid;
+}
+
+int main(int argc, char **argv)
+{
+    long totalBytes = (argc > 1 ? atol(argv[1]) : 256) * 1024 * 1024;
+    const size_t sizes[] = {64, 256, 1024, 4096, 8192};
+    const pair<const char *, string> texts[] = {
+        {"ascii", "hello everyone, this is a benchmark message. "},
+        {"chinese", "大家好，这是一条用来测试的聊天消息。"},
+    };
+    const pair<const char *, RouteScanner::Isa> isas[] = {
+        {"scalar", RouteScanner::SCALAR},
+        {"sse2", RouteScanner::SSE2},
+        {"avx2", RouteScanner::AVX2},
+    };
+    const RouteScanner::Isa best = RouteScanner::isa();
+
+    cout << "text\tbytes\tmode\tns/msg\tMB/s\tspeedup" << endl;
+    for (const auto &text : texts)
+    {
+        for (size_t size : sizes)
+        {
+            string message = makeMessage(size, text.second);
+            long iterations = max(1000L, totalBytes / static_cast<long>(message.size()));
+
+            double base = measure(message, iterations / 4, byJson);
+            cout << text.first << "\t" << message.size() << "\tjson::parse\t" << base << "\t"
+                 << message.size() * 1000.0 / base << "\t1.0" << endl;
+
+            for (const auto &isa : isas)
+            {
+                if (!RouteScanner::setIsa(isa.second))
+                {
+                    continue;
+                }
+                double cost = measure(message, iterations, byScanner);
+                cout << text.first << "\t" << message.size() << "\t" << isa.first << "\t" << cost << "\t"
+                     << message.size() * 1000.0 / cost << "\t" << base / cost << endl;
+            }
+            RouteScanner::setIsa(best);
+        }
+    }
+    return 0;
+}
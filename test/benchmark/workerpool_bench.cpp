@@ -0,0 +1,216 @@
+/*
+业务线程池性能测试
+模拟服务器在mysql变慢时的聊天延迟：4个I/O线程，连接平均分配到各个I/O线程上，
+大部分消息是聊天(处理很快)，少部分是登录(要查mysql，这里用sleep模拟一次慢查询)
+对比聊天消息从I/O线程收到到处理完成的延迟分布：
+1. inline：业务直接在I/O线程上执行，即改用WorkerPool之前的做法，一次慢查询会卡住同一个I/O线程上的所有连接
+2. pool：I/O线程只把消息提交到连接的串行队列，业务在WorkerPool中执行，同一连接的消息仍然按顺序处理
+不依赖外部服务
+
+用法：./workerpool_bench [慢查询耗时(ms)] [登录消息占比(%)] [每秒消息数] [测试秒数] [业务线程数]
+*/
+#include "workerpool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+using Clock = chrono::steady_clock;
+
+// I/O线程数，和ChatServer一致
+static const int IO_THREADS = 4;
+// 连接数
+static const int CONNECTIONS = 400;
+
+// 一条消息
+struct Frame
+{
+    int conn;
+    bool login;
+    Clock::time_point received;
+};
+
+// 模拟一个I/O线程：按顺序处理投递过来的消息
+class IoThread
+{
+public:
+    explicit IoThread(function<void(const Frame &)> handler) : _handler(handler), _stop(false)
+    {
+        _thread = thread(&IoThread::loop, this);
+    }
+
+    void post(const Frame &frame)
+    {
+        {
+            lock_guard<mutex> lock(_mutex);
+            _frames.push_back(frame);
+        }
+        _cv.notify_one();
+    }
+
+    // 处理完已经投递的消息后退出
+    void stop()
+    {
+        {
+            lock_guard<mutex> lock(_mutex);
+            _stop = true;
+        }
+        _cv.notify_one();
+        _thread.join();
+    }
+
+private:
+    void loop()
+    {
+        for (;;)
+        {
+            Frame frame;
+            {
+                unique_lock<mutex> lock(_mutex);
+                _cv.wait(lock, [this]() { return _stop || !_frames.empty(); });
+                if (_frames.empty())
+                {
+                    return;
+                }
+                frame = _frames.front();
+                _frames.pop_front();
+            }
+            _handler(frame);
+        }
+    }
+
+    function<void(const Frame &)> _handler;
+    deque<Frame> _frames;
+    mutex _mutex;
+    condition_variable _cv;
+    bool _stop;
+    thread _thread;
+};
+
+// 收集聊天消息的延迟
+class LatencyRecorder
+{
+public:
+    void record(Clock::time_point received)
+    {
+        long us = chrono::duration_cast<chrono::microseconds>(Clock::now() - received).count();
+        lock_guard<mutex> lock(_mutex);
+        _latencies.push_back(us);
+    }
+
+    void report(const char *mode)
+    {
+        sort(_latencies.begin(), _latencies.end());
+        auto pct = [this](double p) {
+            return _latencies.empty() ? 0 : _latencies[static_cast<size_t>(p * (_latencies.size() - 1))];
+        };
+        cout << mode << "\t" << _latencies.size() << "\t" << pct(0.5) << "\t" << pct(0.99) << "\t"
+             << pct(0.999) << "\t" << (_latencies.empty() ? 0 : _latencies.back()) << endl;
+    }
+
+private:
+    mutex _mutex;
+    vector<long> _latencies;
+};
+
+// 业务处理：登录模拟一次慢查询，聊天只做很少的计算
+static void handle(const Frame &frame, int dbDelayMs, LatencyRecorder &recorder)
+{
+    if (frame.login)
+    {
+        this_thread::sleep_for(chrono::milliseconds(dbDelayMs));
+        return;
+    }
+    volatile long sum = 0;
+    for (int i = 0; i < 2000; ++i)
+    {
+        sum = sum + i;
+    }
+    recorder.record(frame.received);
+}
+
+// 按固定速率产生消息，投递到连接所在的I/O线程
+static void generate(vector<unique_ptr<IoThread>> &loops, int rate, int seconds, int loginPercent)
+{
+    mt19937 rng(12345);
+    uniform_int_distribution<int> connDist(0, CONNECTIONS - 1);
+    uniform_int_distribution<int> percentDist(0, 99);
+    const auto interval = chrono::nanoseconds(1000000000L / rate);
+    auto next = Clock::now();
+    const long total = static_cast<long>(rate) * seconds;
+    for (long i = 0; i < total; ++i)
+    {
+        next += interval;
+        this_thread::sleep_until(next);
+        Frame frame;
+        frame.conn = connDist(rng);
+        frame.login = percentDist(rng) < loginPercent;
+        frame.received = Clock::now();
+        loops[frame.conn % IO_THREADS]->post(frame);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int dbDelayMs = argc > 1 ? atoi(argv[1]) : 50;
+    int loginPercent = argc > 2 ? atoi(argv[2]) : 1;
+    int rate = argc > 3 ? atoi(argv[3]) : 5000;
+    int seconds = argc > 4 ? atoi(argv[4]) : 5;
+    int workers = argc > 5 ? atoi(argv[5]) : 16;
+
+    cout << "db delay " << dbDelayMs << "ms, login " << loginPercent << "%, " << rate << " msg/s, "
+         << seconds << "s, " << workers << " workers" << endl;
+    cout << "mode\tchats\tp50(us)\tp99(us)\tp999(us)\tmax(us)" << endl;
+
+    // 1. 业务直接在I/O线程上执行
+    {
+        LatencyRecorder recorder;
+        vector<unique_ptr<IoThread>> loops;
+        for (int i = 0; i < IO_THREADS; ++i)
+        {
+            loops.emplace_back(new IoThread([&](const Frame &frame) { handle(frame, dbDelayMs, recorder); }));
+        }
+        generate(loops, rate, seconds, loginPercent);
+        for (auto &loop : loops)
+        {
+            loop->stop();
+        }
+        recorder.report("inline");
+    }
+
+    // 2. I/O线程提交到连接的串行队列，业务在WorkerPool中执行
+    {
+        LatencyRecorder recorder;
+        WorkerPool pool(workers);
+        pool.start();
+        vector<WorkerPool::SerialQueuePtr> queues;
+        for (int i = 0; i < CONNECTIONS; ++i)
+        {
+            queues.push_back(pool.createQueue());
+        }
+        vector<unique_ptr<IoThread>> loops;
+        for (int i = 0; i < IO_THREADS; ++i)
+        {
+            loops.emplace_back(new IoThread([&](const Frame &frame) {
+                pool.submit(queues[frame.conn], [&, frame]() { handle(frame, dbDelayMs, recorder); });
+            }));
+        }
+        generate(loops, rate, seconds, loginPercent);
+        for (auto &loop : loops)
+        {
+            loop->stop();
+        }
+        while (pool.pendingTasks() > 0)
+        {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+        pool.stop();
+        recorder.report("pool");
+    }
+    return 0;
+}